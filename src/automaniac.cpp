@@ -1,10 +1,8 @@
 #include <iostream>
-#include <fstream>
 #include <string>
 #include <vector>
 #include <cstring>
 #include <memory>
-#include <thread>
 
 #include <boost/algorithm/string.hpp>
 
@@ -12,79 +10,293 @@
 #include "failure.hpp"
 
 #include "jobs.h"
+#include "job-cache.h"
 #include "commands.h"
+#include "command-paths.h"
 #include "jobs-processing.h"
 #include "schedulers.h"
+#include "reloader.h"
+#include "engine.h"
+#include "zygote.h"
+#include "cgroups.h"
 
 using namespace std;
 
-ResultOrError<shared_ptr<ifstream>> openFile(const string & fname) 
+struct Settings
 {
-	shared_ptr<ifstream> file(new ifstream(fname));
-	if (file->fail())
-		return fail(strerror(errno));
-	else
-		return succeed(file);
+	string jobsFile;
+	unsigned workers;
+	size_t queueCapacity;
+	scheduling::Backpressure backpressure;
+	scheduling::ExecutorKind executor;
+	unsigned statsInterval; // in seconds, 0 turns stats off
+	bool zygote;            // whether statements are spawned by the zygote
+	string cacheFile;       // where parsed jobs are cached, empty to parse every time
+	bool reload;            // whether the jobs follow changes to the file
+};
+
+ResultOrError<scheduling::Backpressure> parseBackpressure(const string & policy)
+{
+	if (policy.compare("queue") == 0)
+		return succeed(scheduling::QUEUE);
+	else if (policy.compare("drop") == 0)
+		return succeed(scheduling::DROP);
+	else if (policy.compare("coalesce") == 0)
+		return succeed(scheduling::COALESCE);
+
+	return fail("Invalid backpressure policy " + policy + "; only 'queue', 'drop' and 'coalesce' are accepted");
 }
 
-ResultOrError<vector<string>> readFile(const string & fname)
+ResultOrError<scheduling::ExecutorKind> parseExecutorKind(const string & kind)
 {
-	auto inputOrError = openFile(fname);
+	if (kind.compare("pool") == 0)
+		return succeed(scheduling::POOL);
+	else if (kind.compare("stealing") == 0)
+		return succeed(scheduling::STEALING);
+
+	return fail("Invalid executor " + kind + "; only 'pool' and 'stealing' are accepted");
+}
+
+ResultOrError<bool> parseSpawn(const string & spawn)
+{
+	if (spawn.compare("zygote") == 0)
+		return succeed(true);
+	else if (spawn.compare("direct") == 0)
+		return succeed(false);
+
+	return fail("Invalid spawn mode " + spawn + "; only 'zygote' and 'direct' are accepted");
+}
+
+ResultOrError<bool> parseSwitch(const string & option, const string & value)
+{
+	if (value.compare("on") == 0)
+		return succeed(true);
+	else if (value.compare("off") == 0)
+		return succeed(false);
+
+	return fail("Invalid value " + value + " for " + option + "; only 'on' and 'off' are accepted");
+}
+
+ResultOrError<Settings> parseArguments(int argc, char const *argv[])
+{
+	Settings settings { 
+		"", scheduling::defaultWorkerCount(), 1024, scheduling::QUEUE, scheduling::STEALING, 0, true, "", true
+	};
+	bool cacheGiven = false;
+
+	for (int i = 1; i < argc; ++i) {
+		const string arg = argv[i];
 
-	return inputOrError.mapSuccess<vector<string>>([](const auto & input) {
-		vector<string> lines;
-		string line;
+		if (arg.compare(0, 2, "--") != 0) {
+			if (!settings.jobsFile.empty())
+				return fail("Needs one file");
 
-		while (getline(*input, line)) {
-			lines.push_back(line);
+			settings.jobsFile = arg;
+			continue;
 		}
 
-		input->close();
+		if (i + 1 >= argc)
+			return fail("Option " + arg + " requires a value");
+
+		const string value = argv[++i];
+
+		try {
+			if (arg.compare("--workers") == 0) {
+				settings.workers = stoul(value);
+			}
+			else if (arg.compare("--queue-size") == 0) {
+				settings.queueCapacity = stoul(value);
+			}
+			else if (arg.compare("--stats") == 0) {
+				settings.statsInterval = stoul(value);
+			}
+			else if (arg.compare("--backpressure") == 0) {
+				auto policy = parseBackpressure(value);
+				if (policy.failed())
+					return policy.getError();
+
+				settings.backpressure = policy.getResult();
+			}
+			else if (arg.compare("--executor") == 0) {
+				auto kind = parseExecutorKind(value);
+				if (kind.failed())
+					return kind.getError();
+
+				settings.executor = kind.getResult();
+			}
+			else if (arg.compare("--spawn") == 0) {
+				auto spawn = parseSpawn(value);
+				if (spawn.failed())
+					return spawn.getError();
+
+				settings.zygote = spawn.getResult();
+			}
+			else if (arg.compare("--cache") == 0) {
+				settings.cacheFile = value.compare("off") == 0 ? "" : value;
+				cacheGiven = true;
+			}
+			else if (arg.compare("--reload") == 0) {
+				auto reload = parseSwitch(arg, value);
+				if (reload.failed())
+					return reload.getError();
+
+				settings.reload = reload.getResult();
+			}
+			else {
+				return fail("Unknown option " + arg);
+			}
+		}
+		catch (const std::invalid_argument &) {
+			return fail(value + " isn't a valid number");
+		}
+		catch (const std::out_of_range &) {
+			return fail(value + " is beyond the limits");
+		}
+	}
+
+	if (settings.jobsFile.empty())
+		return fail("Needs one file");
+
+	if (!cacheGiven)
+		settings.cacheFile = jobparsers::defaultCachePath(settings.jobsFile);
+
+	return succeed(settings);
+}
+
+void printStats(scheduling::Engine & engine)
+{
+	scheduling::ExecutorMetrics metrics = engine.executor().metrics();
+
+	println("[executor] queued " + to_string(metrics.depth) + " (max " + to_string(metrics.maxDepth) + 
+			"), running " + to_string(metrics.running) + ", submitted " + to_string(metrics.submitted) + 
+			", executed " + to_string(metrics.executed) + ", dropped " + to_string(metrics.dropped) + 
+			", coalesced " + to_string(metrics.coalesced));
 
-		return succeed(lines);
+	auto now = chrono::steady_clock::now();
+	vector<processes::TrackedProcess> table = engine.reaper().table();
+
+	println("[processes] " + to_string(table.size()) + " running");
+	for (const auto & process : table) {
+		auto age = chrono::duration_cast<chrono::seconds>(now - process.started);
+		println("  " + to_string(process.pid) + " [" + process.owner + "] " + process.command + 
+				", for " + to_string(age.count()) + "s");
+	}
+
+	for (const auto & owner : engine.reaper().usage()) {
+		const processes::OwnerUsage & usage = owner.second;
+		println("  [" + owner.first + "] exited " + to_string(usage.exited) + " (failed " + 
+				to_string(usage.failed) + ", last " + to_string(usage.lastCode) + "), cpu " + 
+				to_string(usage.cpuSeconds) + "s, max rss " + to_string(usage.maxResidentKb) + " KiB");
+
+		if (usage.limitedRuns > 0) {
+			println("  [" + owner.first + "] limited runs " + to_string(usage.limitedRuns) + ", cpu " + 
+					to_string(usage.groupCpuSeconds) + "s (last " + to_string(usage.lastRunCpuSeconds) + 
+					"s), peak memory " + to_string(usage.groupPeakKb) + " KiB (last " + 
+					to_string(usage.lastRunPeakKb) + " KiB)");
+		}
+	}
+}
+
+void reportStats(scheduling::Engine & engine, unsigned interval)
+{
+	engine.timers().scheduleAfter(chrono::seconds(interval), [&engine, interval]() {
+		printStats(engine);
+		reportStats(engine, interval);
 	});
 }
 
+/*
+ * Commands are looked up once and then remembered, until something
+ * changes in one of the PATH directories.
+ */
+void watchCommandPaths(scheduling::Engine & engine)
+{
+	commands::CommandPaths & paths = commands::commandPaths();
+
+	for (const auto & directory : paths.directories()) {
+		engine.watcher().watch(directory, [&paths](const watchers::WatchEvent &) {
+			paths.invalidate();
+		});
+	}
+
+	paths.setTimeToLive(timeutil::DurationUnit::zero());
+}
+
 int main(int argc, char const *argv[])
 {
-	if (argc != 2) {
-		printerr("Needs one file");
+	auto settingsOrError = parseArguments(argc, argv);
+	if (settingsOrError.failed()) {
+		printerr(settingsOrError.getError().message);
+		printerr("Usage: automaniac [--workers N] [--queue-size N] "
+				 "[--backpressure queue|drop|coalesce] [--executor pool|stealing] "
+				 "[--spawn zygote|direct] [--stats SECONDS] [--cache PATH|off] [--reload on|off] FILE");
 		return 1;
 	}
 
-	vector<std::thread> threads;
-	vector<Job> jobs;
+	const Settings settings = settingsOrError.getResult();
 
-	for (int i = 1; i < argc; ++i) {
-		readFile(argv[i])
-			.onSuccess([&](const vector<string> & lines) {
-				auto jobsLines = jobparsers::separateJobsLines(lines);
-
-				for (const auto & jobLines : jobsLines) {
-					jobparsers::parseJob(jobLines)
-						.onSuccess([&jobs] (const auto & job) {
-							jobs.push_back(job);
-						})
-						.onFailure([] (const auto & err) {
-							printerr(err.message);
-							std::terminate();
-						});
-				}
-
-				threads.reserve(jobs.size());
-
-				for (const auto & job : jobs) {
-					threads.emplace_back(std::thread(schedulers::scheduleJobThread, job));
-				}
-
-				for (auto & td : threads) {
-					td.join();
-				}
-			})
+	// forked before any thread exists, statements fall back to spawning directly without it
+	if (settings.zygote) {
+		processes::zygote().launch()
 			.onFailure([](const Error & err) {
-				printerr("Error: " + err.message);
+				printerr(err.message);
 			});
 	}
 
+	scheduling::Engine engine(scheduling::makeExecutor(settings.executor, settings.workers, 
+													   settings.queueCapacity, settings.backpressure));
+	watchCommandPaths(engine);
+	vector<Job> jobs;
+
+	bool loaded = false;
+	size_t errors = 0;
+
+	// whatever the jobs were read from goes as soon as they're out of it, only they stay around
+	jobparsers::loadJobFile(settings.jobsFile, settings.cacheFile, settings.workers)
+		.onSuccess([&](const shared_ptr<jobparsers::LoadedJobs> & loadedJobs) {
+			ParsedJobs & parsed = loadedJobs->parsed;
+
+			for (const auto & err : parsed.errors) {
+				printerr(settings.jobsFile + ":" + err.message);
+			}
+
+			if (!loadedJobs->cacheProblem.empty())
+				printerr("The jobs weren't cached: " + loadedJobs->cacheProblem);
+
+			errors = parsed.errors.size();
+			jobs = std::move(parsed.jobs);
+			loaded = true;
+		})
+		.onFailure([](const Error & err) {
+			printerr("Error: " + err.message);
+		});
+
+	if (!loaded)
+		return 0;
+
+	// all of them are reported first, a file is fixed in one go rather than one error at a time
+	if (errors > 0) {
+		printerr(to_string(errors) + (errors == 1 ? " error" : " errors") + " in " + settings.jobsFile + 
+				 ", nothing was scheduled");
+		return 1;
+	}
+
+	// the file is watched only while its jobs keep the engine going, it's not a job of its own
+	schedulers::JobReloader reloader(engine, settings.jobsFile);
+	reloader.schedule(jobs);
+	jobs.clear();
+
+	if (settings.reload)
+		reloader.watch();
+
+	if (settings.statsInterval > 0)
+		reportStats(engine, settings.statsInterval);
+
+	engine.run();
+	processes::controlGroups().close();
+
+	if (settings.statsInterval > 0)
+		printStats(engine);
+
 	return 0;
-}
\ No newline at end of file
+}
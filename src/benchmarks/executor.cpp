@@ -0,0 +1,87 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "../executor.h"
+
+using namespace scheduling;
+using namespace std::chrono;
+
+/*
+ * 10k jobs firing at the same instant: the dispatcher thread submits
+ * them back to back and every task records how long it waited between
+ * being submitted and starting to run.
+ */
+const size_t FIRINGS = 10000;
+const unsigned ROUNDS = 5;
+
+void spin(nanoseconds duration)
+{
+	auto until = steady_clock::now() + duration;
+	while (steady_clock::now() < until) {}
+}
+
+void runBurst(Executor & executor, std::vector<nanoseconds> & latencies)
+{
+	std::vector<steady_clock::time_point> submitted(FIRINGS);
+	std::vector<nanoseconds> waited(FIRINGS);
+	std::atomic<size_t> remaining(FIRINGS);
+
+	for (size_t i = 0; i < FIRINGS; i++) {
+		submitted[i] = steady_clock::now();
+		executor.submit(&submitted[i], [&, i]() {
+			waited[i] = duration_cast<nanoseconds>(steady_clock::now() - submitted[i]);
+			spin(microseconds(2));
+			remaining--;
+		});
+	}
+
+	while (remaining.load() > 0)
+		std::this_thread::yield();
+
+	latencies.insert(latencies.end(), waited.begin(), waited.end());
+}
+
+void benchmark(const std::string & name, ExecutorKind kind, unsigned workers)
+{
+	std::vector<nanoseconds> latencies;
+	auto executor = makeExecutor(kind, workers, FIRINGS, QUEUE);
+	executor->start();
+
+	auto start = steady_clock::now();
+	for (unsigned round = 0; round < ROUNDS; round++)
+		runBurst(*executor, latencies);
+	auto end = steady_clock::now();
+
+	executor->stop();
+
+	std::sort(latencies.begin(), latencies.end());
+	auto percentile = [&](double p) {
+		return duration_cast<microseconds>(latencies.at(size_t(p * (latencies.size() - 1)))).count();
+	};
+
+	std::cout << std::setw(10) << name << std::setw(9) << workers
+			  << std::setw(10) << percentile(0.5) << std::setw(10) << percentile(0.99)
+			  << std::setw(10) << percentile(1.0)
+			  << std::setw(12) << duration_cast<milliseconds>(end - start).count() / ROUNDS << '\n';
+}
+
+int main(int argc, char const *argv[])
+{
+	unsigned workers = argc > 1 ? std::stoul(argv[1]) : defaultWorkerCount();
+
+	std::cout << FIRINGS << " simultaneous firings, " << ROUNDS << " rounds, latencies in us\n";
+	std::cout << std::setw(10) << "executor" << std::setw(9) << "workers"
+			  << std::setw(10) << "p50" << std::setw(10) << "p99" << std::setw(10) << "max"
+			  << std::setw(12) << "burst ms" << '\n';
+
+	benchmark("pool", POOL, workers);
+	benchmark("stealing", STEALING, workers);
+
+	return 0;
+}
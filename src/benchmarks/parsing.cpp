@@ -0,0 +1,409 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <regex>
+#include <fstream>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <boost/algorithm/string.hpp>
+
+#include "../jobs.h"
+#include "../mapped-file.h"
+#include "../job-cache.h"
+#include "../executor.h"
+
+using namespace jobparsers;
+using namespace std::chrono;
+
+/*
+ * How job files were parsed before the scanner, kept as it was: the
+ * file read line by line, each line matched against a std::regex and
+ * then taken apart again piece by piece.
+ */
+namespace legacy
+{
+	bool
+	validateDescriptionLine(const std::string & description)
+	{
+		static const std::string segments[] = {
+			"\\s*[a-zA-Z]+(\\s+\\S+)*\\s*\\(.*\\)\\s*:\\s*",
+			"\\s*[a-zA-Z]+(\\s+\\S+)*\\s*:\\s*"
+		};
+		static const std::string combined = "(" + segments[0] + "|" + segments[1] + ")(\\n|$)";
+		static const std::regex lineregex(combined);
+
+		return std::regex_match(description, lineregex);
+	}
+
+	bool
+	validateOptionsString(const std::string & optionsString)
+	{
+		static const std::string firstOne = "\\s*\\S+\\s*=\\s*\\S+\\s*";
+		static const std::string subsequentOnes = "\\s*\\," + firstOne;
+		static const std::string combined = firstOne + "(" + subsequentOnes + ")*($|\\n)";
+		static const std::regex optionsregex(combined);
+
+		return std::regex_match(optionsString, optionsregex);
+	}
+
+	ExtractionResult
+	extractScheduler(const std::string & description)
+	{
+		std::string trimmed = boost::trim_copy(description);
+		size_t optionStartPos = trimmed.find_first_of("(");
+		size_t len = trimmed.length() - 1;
+		size_t splitPoint = std::min(optionStartPos, len);
+
+		return ExtractionResult { boost::trim_copy(trimmed.substr(0, splitPoint)), 0, splitPoint };
+	}
+
+	std::vector<std::string>
+	splitWords(const std::string & text)
+	{
+		std::vector<std::string> words;
+		std::string word;
+		bool inWord = false;
+		char quote = '\0';
+
+		for (char c : text) {
+			if (quote != '\0') {
+				if (c == quote)
+					quote = '\0';
+				else
+					word += c;
+			}
+			else if (c == '"' || c == '\'') {
+				quote = c;
+				inWord = true;
+			}
+			else if (c == ' ' || c == '\t') {
+				if (inWord)
+					words.push_back(word);
+
+				word.clear();
+				inWord = false;
+			}
+			else {
+				word += c;
+				inWord = true;
+			}
+		}
+
+		if (inWord)
+			words.push_back(word);
+
+		return words;
+	}
+
+	ResultOrError<Statement>
+	parseStatement(const std::string & statementText)
+	{
+		ExtractionResult runner = extractCommand(statementText);
+		std::string rest = runner.endIndex + 1 < statementText.size()
+				? boost::trim_left_copy(statementText.substr(runner.endIndex + 1)) : "";
+
+		timeutil::DurationUnit timeout(0);
+		if (!rest.empty() && rest.at(0) == '(') {
+			size_t closing = rest.find(')');
+			if (closing == std::string::npos)
+				return fail("Unclosed options in statement '" + statementText + "'");
+
+			OptionsMap options = mapOptions(rest.substr(1, closing - 1), splitByCommas);
+			rest = rest.substr(closing + 1);
+
+			auto timeoutIter = options.find("timeout");
+			if (timeoutIter != options.end()) {
+				auto durationOrError = timeutil::parseCompactDuration(timeoutIter->second);
+				if (durationOrError.failed())
+					return fail("Invalid value for option 'timeout'; " + durationOrError.getError().message);
+
+				timeout = durationOrError.getResult();
+			}
+		}
+
+		return succeed(Statement { runner.extractedText, splitWords(rest), timeout });
+	}
+
+	ResultOrError<JobDescription>
+	parseDescription(const std::string & descriptionLine)
+	{
+		if (!validateDescriptionLine(descriptionLine))
+			return fail("Invalid description line");
+
+		ExtractionResult scheduler = extractScheduler(descriptionLine);
+		if (scheduler.extractedText.empty())
+			return fail("Couldn't extract scheduler");
+
+		std::vector<std::string> schedulerParts = splitScheduler(scheduler.extractedText);
+
+		ExtractionResult optionsString = extractOptions(descriptionLine);
+		if (!optionsString.extractedText.empty() && !validateOptionsString(optionsString.extractedText))
+			return fail("Invalid options text");
+
+		OptionsMap optionsStringMap = mapOptions(optionsString.extractedText, splitByCommas);
+
+		return mapJobOptions(optionsStringMap)
+				.mapSuccess<JobDescription>([&] (const JobOptions & options) {
+					return succeed(JobDescription { schedulerParts.at(0), schedulerParts.at(1), options });
+				});
+	}
+
+	ResultOrError<Job>
+	parseJob(const std::vector<std::string> & jobLines)
+	{
+		auto descriptionOrError = parseDescription(jobLines.at(0));
+
+		return descriptionOrError.mapSuccess<Job>([&](const auto & description) -> ResultOrError<Job> {
+			Job job;
+			job.description = description;
+
+			for (auto iter = jobLines.begin() + 1; iter != jobLines.end(); iter++) {
+				auto statement = parseStatement(boost::trim_copy(*iter));
+				if (statement.failed())
+					return fail(statement.getError());
+
+				job.statements.push_back(statement.getResult());
+			}
+
+			return succeed(job);
+		});
+	}
+
+	/* The way main went over the file, getline() included */
+	std::vector<Job>
+	parseFile(std::istream & input)
+	{
+		std::vector<std::string> lines;
+		std::string line;
+
+		while (std::getline(input, line))
+			lines.push_back(line);
+
+		std::vector<Job> jobs;
+		for (const auto & jobLines : separateJobsLines(lines)) {
+			parseJob(jobLines)
+				.onSuccess([&jobs](const Job & job) {
+					jobs.push_back(job);
+				});
+		}
+
+		return jobs;
+	}
+}
+
+/* A mix of what job files usually have: options or not, arguments with colons, quoting */
+std::string
+generateJobs(size_t count)
+{
+	std::string text;
+
+	for (size_t i = 0; i < count; i++) {
+		switch (i % 4) {
+		case 0:
+			text += "# job " + std::to_string(i) + "\n";
+			text += "every " + std::to_string(i % 60 + 1) + " seconds (name = job" + std::to_string(i) +
+					", overrun = skip, timeout = 30s):\n";
+			text += "\texec echo 'tick " + std::to_string(i) + "'\n";
+			text += "\texec (timeout = 5s) sleep 1\n";
+			break;
+		case 1:
+			text += "daily 12:30:00 (output = /tmp/job" + std::to_string(i) + ".log, memory_max = 64M):\n";
+			text += "\trun backup.sh --target \"/var/backups/" + std::to_string(i) + "\"\n";
+			break;
+		case 2:
+			text += "watch /tmp/in" + std::to_string(i) + " (debounce = 200ms, recursive = yes):\n";
+			text += "\texec make -C /tmp/in" + std::to_string(i) + " all\n\n";
+			break;
+		default:
+			text += "once:\n";
+			text += "\texec true\n";
+			break;
+		}
+	}
+
+	return text;
+}
+
+template <typename Parse>
+double
+timeMillis(Parse parse, size_t & parsed)
+{
+	auto start = steady_clock::now();
+	parsed = parse();
+	auto end = steady_clock::now();
+
+	return duration_cast<microseconds>(end - start).count() / 1000.0;
+}
+
+void printResult(const std::string & name, size_t jobs, size_t parsed, double millis)
+{
+	std::cout << std::setw(8) << name << std::setw(9) << jobs << std::setw(9) << parsed
+			  << std::setw(12) << std::fixed << std::setprecision(1) << millis
+			  << std::setw(14) << std::setprecision(0) << millis * 1e6 / jobs << '\n';
+}
+
+/*
+ * Loading a whole file the way each path does, keeping the jobs; run in
+ * a process of its own so that its peak RSS is only its own.
+ */
+size_t
+loadJobs(const std::string & loader, const std::string & path)
+{
+	if (loader.compare("regex") == 0) {
+		std::ifstream input(path);
+		return legacy::parseFile(input).size();
+	}
+
+	if (loader.compare("string") == 0) {
+		std::ifstream input(path);
+		std::stringstream content;
+		content << input.rdbuf();
+
+		std::string text = content.str();
+		return parseJobs(text).jobs.size();
+	}
+
+	if (loader.compare("mmap") == 0) {
+		auto file = MappedFile::open(path);
+		if (file.failed())
+			return 0;
+
+		return parseJobFile(*file.getResult()).jobs.size();
+	}
+
+	if (loader.compare("cache") == 0) {
+		auto loaded = loadJobFile(path, path + ".jobs");
+		if (loaded.failed() || !loaded.getResult()->fromCache)
+			return 0;
+
+		return loaded.getResult()->parsed.jobs.size();
+	}
+
+	if (loader.compare("pool") == 0) {
+		auto file = MappedFile::open(path);
+		if (file.failed())
+			return 0;
+
+		return parseJobFile(*file.getResult(), scheduling::defaultWorkerCount()).jobs.size();
+	}
+
+	return 0;
+}
+
+/* Our own peak RSS in KiB, as the kernel keeps track of it since exec() */
+long
+peakResidentKb()
+{
+	std::ifstream status("/proc/self/status");
+	std::string line;
+
+	while (std::getline(status, line)) {
+		if (line.compare(0, 6, "VmHWM:") == 0)
+			return std::stol(line.substr(6));
+	}
+
+	return -1;
+}
+
+/*
+ * A fresh process per loader: a forked child's rusage would count the
+ * parent's pages too, even after exec().
+ */
+long
+measureLoad(const std::string & self, const std::string & loader, const std::string & path)
+{
+	std::string command = self + " --load " + loader + " " + path;
+	FILE * child = popen(command.c_str(), "r");
+	if (child == nullptr)
+		return -1;
+
+	long peak = -1;
+	if (fscanf(child, "%ld", &peak) != 1)
+		peak = -1;
+
+	pclose(child);
+	return peak;
+}
+
+int main(int argc, char const *argv[])
+{
+	if (argc == 4 && std::string(argv[1]).compare("--load") == 0) {
+		std::string loader = argv[2];
+		if (loader.compare("none") != 0 && loadJobs(loader, argv[3]) == 0)
+			return 1;
+
+		std::cout << peakResidentKb() << '\n';
+		return 0;
+	}
+
+	size_t count = argc > 1 ? std::stoul(argv[1]) : 100000;
+	unsigned workers = argc > 2 ? std::stoul(argv[2]) : scheduling::defaultWorkerCount();
+	std::string text = generateJobs(count);
+
+	char path[] = "/tmp/parsing-bench-XXXXXX";
+	int fd = mkstemp(path);
+	if (fd < 0 || write(fd, text.data(), text.size()) != ssize_t(text.size())) {
+		std::cerr << "Couldn't write the jobs out to " << path << '\n';
+		return 1;
+	}
+	close(fd);
+
+	std::cout << count << " jobs, " << text.size() / 1024 << " KiB, " << workers << " workers in the pool\n";
+	std::cout << std::setw(8) << "parser" << std::setw(9) << "jobs" << std::setw(9) << "parsed"
+			  << std::setw(12) << "total ms" << std::setw(14) << "ns/job" << '\n';
+
+	size_t parsed;
+	double millis = timeMillis([&text]() {
+		std::istringstream input(text);
+		return legacy::parseFile(input).size();
+	}, parsed);
+	printResult("regex", count, parsed, millis);
+
+	millis = timeMillis([&text]() { return parseJobs(text).jobs.size(); }, parsed);
+	printResult("scanner", count, parsed, millis);
+
+	auto file = MappedFile::open(path);
+	millis = timeMillis([&file]() { return parseJobFile(*file.getResult()).jobs.size(); }, parsed);
+	printResult("mmap", count, parsed, millis);
+
+	millis = timeMillis([&file, workers]() { return parseJobFile(*file.getResult(), workers).jobs.size(); }, parsed);
+	printResult("pool", count, parsed, millis);
+
+	// what starting up takes: parsing and writing the cache, then reading it back
+	std::string cachePath = std::string(path) + ".jobs";
+	unlink(cachePath.c_str());
+
+	std::cout << '\n' << std::setw(8) << "startup" << std::setw(9) << "jobs" << std::setw(9) << "loaded"
+			  << std::setw(12) << "total ms" << std::setw(14) << "ns/job" << '\n';
+
+	auto loadWith = [&path, &cachePath, workers]() {
+		auto loaded = loadJobFile(path, cachePath, workers);
+		return loaded.succeeded() ? loaded.getResult()->parsed.jobs.size() : 0;
+	};
+
+	millis = timeMillis(loadWith, parsed);
+	printResult("cold", count, parsed, millis);
+
+	millis = timeMillis(loadWith, parsed);
+	printResult("cached", count, parsed, millis);
+
+	struct timeval times[2] = { { 1, 0 }, { 1, 0 } };
+	utimes(path, times);
+	millis = timeMillis(loadWith, parsed);
+	printResult("touched", count, parsed, millis);
+
+	std::cout << '\n' << std::setw(8) << "loader" << std::setw(16) << "peak RSS KiB" << '\n';
+	for (const std::string loader : { "none", "regex", "string", "mmap", "pool", "cache" })
+		std::cout << std::setw(8) << loader << std::setw(16) << measureLoad(argv[0], loader, path) << '\n';
+
+	unlink(path);
+	unlink(cachePath.c_str());
+	return 0;
+}
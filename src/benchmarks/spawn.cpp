@@ -0,0 +1,60 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <functional>
+#include <chrono>
+
+#include <boost/process.hpp>
+#include <boost/process/search_path.hpp>
+
+#include "../commands.h"
+#include "../process.h"
+
+using namespace std::chrono;
+
+/*
+ * How many `exec true` statements a single thread gets through per
+ * second: through boost::process::system with the arguments joined
+ * into one string (how statements used to run), through posix_spawn
+ * looking the command up in PATH every time, and through exec, which
+ * looks it up once.
+ */
+const unsigned STATEMENTS = 2000;
+
+void benchmark(const std::string & name, std::function<void()> statement)
+{
+	auto start = steady_clock::now();
+	for (unsigned i = 0; i < STATEMENTS; i++)
+		statement();
+	auto end = steady_clock::now();
+
+	double seconds = duration_cast<duration<double>>(end - start).count();
+
+	std::cout << std::setw(24) << name 
+			  << std::setw(14) << std::fixed << std::setprecision(0) << STATEMENTS / seconds
+			  << std::setw(12) << std::setprecision(1) << seconds * 1e6 / STATEMENTS << '\n';
+}
+
+int main(int argc, char const *argv[])
+{
+	std::vector<std::string> arguments = { "true" };
+
+	std::cout << STATEMENTS << " statements each\n";
+	std::cout << std::setw(24) << "path" << std::setw(14) << "per second" << std::setw(12) << "us each" << '\n';
+
+	benchmark("process::system", [&]() {
+		boost::process::search_path("true");
+		boost::process::system("true");
+	});
+
+	benchmark("posix_spawn, lookups", [&]() {
+		processes::run(boost::process::search_path("true").string(), arguments);
+	});
+
+	benchmark("exec, cached lookup", [&]() {
+		commands::exec(arguments);
+	});
+
+	return 0;
+}
@@ -0,0 +1,95 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <memory>
+#include <chrono>
+#include <functional>
+
+#include "../timer-store.h"
+#include "../timing-wheel.h"
+
+using namespace scheduling;
+using namespace std::chrono;
+
+/*
+ * Simulates `every N seconds` jobs on a synthetic clock: every timer
+ * is re-armed with its own period as soon as it expires, and the
+ * clock moves in 1 ms steps the way the dispatcher would.
+ */
+struct BenchResult
+{
+	double insertNanos;
+	double rearmNanos;
+	double totalMillis;
+	size_t expirations;
+};
+
+BenchResult runBenchmark(TimerStore & store, Clock::time_point origin, size_t count)
+{
+	std::mt19937 generator(7);
+	std::uniform_int_distribution<long> periods(1, 60);
+	std::vector<milliseconds> timerPeriods;
+
+	for (size_t i = 0; i < count; i++)
+		timerPeriods.push_back(seconds(periods(generator)));
+
+	auto insertStart = steady_clock::now();
+	for (TimerId id = 0; id < count; id++)
+		store.add(id, origin + timerPeriods.at(id));
+	auto insertEnd = steady_clock::now();
+
+	std::vector<TimerId> expired;
+	size_t expirations = 0;
+	Clock::time_point now = origin;
+	Clock::time_point end = origin + seconds(120);
+
+	auto rearmStart = steady_clock::now();
+	while (now < end) {
+		now += milliseconds(1);
+		store.expire(now, expired);
+
+		for (TimerId id : expired)
+			store.add(id, now + timerPeriods.at(id));
+
+		expirations += expired.size();
+		expired.clear();
+	}
+	auto rearmEnd = steady_clock::now();
+
+	return BenchResult {
+		duration_cast<nanoseconds>(insertEnd - insertStart).count() / double(count),
+		duration_cast<nanoseconds>(rearmEnd - rearmStart).count() / double(expirations),
+		duration_cast<microseconds>(rearmEnd - rearmStart).count() / 1000.0,
+		expirations
+	};
+}
+
+void printResult(const std::string & name, size_t count, const BenchResult & result)
+{
+	std::cout << std::setw(6) << name << std::setw(8) << count 
+			  << std::setw(14) << std::fixed << std::setprecision(1) << result.insertNanos
+			  << std::setw(20) << result.rearmNanos
+			  << std::setw(12) << result.totalMillis
+			  << std::setw(14) << result.expirations << '\n';
+}
+
+int main(int argc, char const *argv[])
+{
+	std::cout << std::setw(6) << "store" << std::setw(8) << "timers" 
+			  << std::setw(14) << "insert ns/op" << std::setw(20) << "expire+rearm ns/op"
+			  << std::setw(12) << "120s in ms"
+			  << std::setw(14) << "expirations" << '\n';
+
+	for (size_t count : { 1000, 10000, 100000 }) {
+		Clock::time_point origin = Clock::now();
+
+		TimerHeap heap;
+		printResult("heap", count, runBenchmark(heap, origin, count));
+
+		TimingWheel wheel(origin);
+		printResult("wheel", count, runBenchmark(wheel, origin, count));
+	}
+
+	return 0;
+}
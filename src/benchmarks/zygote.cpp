@@ -0,0 +1,97 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <functional>
+#include <chrono>
+#include <memory>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../process.h"
+#include "../zygote.h"
+
+using namespace std::chrono;
+
+/*
+ * How long it takes to start `/bin/true` and see it exit, as the
+ * scheduler's memory grows: with fork and exec from the scheduler,
+ * with posix_spawn from the scheduler, and through the zygote,
+ * which was forked while the process was still small.
+ */
+const unsigned STARTS = 500;
+const char * TRUE_PATH = "/bin/true";
+
+void benchmark(const std::string & name, size_t megabytes, std::function<void()> start)
+{
+	std::vector<nanoseconds> latencies;
+	latencies.reserve(STARTS);
+
+	for (unsigned i = 0; i < STARTS; i++) {
+		auto before = steady_clock::now();
+		start();
+		latencies.push_back(steady_clock::now() - before);
+	}
+
+	std::sort(latencies.begin(), latencies.end());
+
+	auto percentile = [&latencies](double fraction) {
+		size_t index = std::min(latencies.size() - 1, (size_t) (fraction * latencies.size()));
+		return duration_cast<microseconds>(latencies[index]).count();
+	};
+
+	std::cout << std::setw(12) << name << std::setw(8) << megabytes
+			  << std::setw(10) << percentile(0.5) << std::setw(10) << percentile(0.99) << '\n';
+}
+
+void forkAndExec()
+{
+	pid_t pid = fork();
+	if (pid == 0) {
+		execl(TRUE_PATH, TRUE_PATH, (char *) nullptr);
+		_exit(127);
+	}
+
+	waitpid(pid, nullptr, 0);
+}
+
+int main(int argc, char const *argv[])
+{
+	std::vector<std::string> arguments = { "true" };
+
+	processes::Zygote zygote;
+	if (zygote.launch().failed()) {
+		std::cerr << "Couldn't launch the zygote\n";
+		return 1;
+	}
+
+	std::cout << STARTS << " starts each, latencies in us\n";
+	std::cout << std::setw(12) << "path" << std::setw(8) << "MiB"
+			  << std::setw(10) << "p50" << std::setw(10) << "p99" << '\n';
+
+	std::vector<std::unique_ptr<char[]>> heap;
+
+	for (size_t megabytes : { 0, 256, 1024 }) {
+		// touch every page so they all have to be mapped in the child
+		while (heap.size() < megabytes) {
+			heap.emplace_back(new char[1 << 20]);
+			std::fill(heap.back().get(), heap.back().get() + (1 << 20), 1);
+		}
+
+		benchmark("fork", megabytes, forkAndExec);
+
+		benchmark("posix_spawn", megabytes, [&]() {
+			processes::startDirectly(TRUE_PATH, arguments)
+				.onSuccess([](const pid_t & pid) { waitpid(pid, nullptr, 0); });
+		});
+
+		benchmark("zygote", megabytes, [&]() {
+			zygote.start(TRUE_PATH, arguments)
+				.onSuccess([&zygote](const pid_t & pid) { zygote.wait(pid); });
+		});
+	}
+
+	return 0;
+}
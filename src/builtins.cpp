@@ -0,0 +1,163 @@
+#include <iostream>
+#include <unordered_map>
+#include <functional>
+#include <thread>
+#include <cstring>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "builtins.h"
+
+typedef std::function<ResultOrError<int>(const std::vector<std::string> &,
+										 std::shared_ptr<output::OutputFile>)> Builtin;
+
+Error
+systemError(const std::string & what, const std::string & path)
+{
+	int error = errno;
+	return Error(error, "Couldn't " + what + " '" + path + "': " + std::strerror(error));
+}
+
+/* The arguments after the first skipped ones, separated by spaces like echo does */
+std::string
+joinFrom(const std::vector<std::string> & arguments, size_t first)
+{
+	std::string text;
+
+	for (size_t i = first; i < arguments.size(); i++) {
+		if (i > first)
+			text += ' ';
+		text += arguments[i];
+	}
+
+	return text;
+}
+
+ResultOrError<int>
+builtinEcho(const std::vector<std::string> & arguments, std::shared_ptr<output::OutputFile> output)
+{
+	std::string line = joinFrom(arguments, 1) + '\n';
+
+	if (output != nullptr)
+		output->append(line.data(), line.size());
+	else
+		std::cout << line;
+
+	return succeed(0);
+}
+
+ResultOrError<int>
+builtinWrite(const std::vector<std::string> & arguments, std::shared_ptr<output::OutputFile>)
+{
+	if (arguments.size() < 2)
+		return fail("builtin write needs a file");
+
+	const std::string & path = arguments[1];
+	std::string content = joinFrom(arguments, 2) + '\n';
+
+	int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0)
+		return fail(systemError("open", path));
+
+	size_t written = 0;
+	while (written < content.size()) {
+		ssize_t count = ::write(fd, content.data() + written, content.size() - written);
+		if (count < 0 && errno == EINTR)
+			continue;
+
+		if (count < 0) {
+			Error error = systemError("write to", path);
+			close(fd);
+			return fail(error);
+		}
+
+		written += count;
+	}
+
+	close(fd);
+	return succeed(0);
+}
+
+ResultOrError<int>
+builtinTouch(const std::vector<std::string> & arguments, std::shared_ptr<output::OutputFile>)
+{
+	if (arguments.size() < 2)
+		return fail("builtin touch needs a file");
+
+	for (size_t i = 1; i < arguments.size(); i++) {
+		const std::string & path = arguments[i];
+
+		int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+		if (fd < 0)
+			return fail(systemError("create", path));
+
+		// both times become now
+		int result = futimens(fd, nullptr);
+		close(fd);
+		if (result < 0)
+			return fail(systemError("touch", path));
+	}
+
+	return succeed(0);
+}
+
+ResultOrError<int>
+builtinSleep(const std::vector<std::string> & arguments, std::shared_ptr<output::OutputFile>)
+{
+	return builtins::sleepDuration(arguments)
+			.mapSuccess<int>([](const timeutil::DurationUnit & duration) {
+				std::this_thread::sleep_for(duration);
+				return succeed(0);
+			});
+}
+
+const std::unordered_map<std::string, Builtin>
+		builtinsByName = {
+			{ "true", [](const std::vector<std::string> &, std::shared_ptr<output::OutputFile>) {
+				return ResultOrError<int>(succeed(0));
+			} },
+			{ "false", [](const std::vector<std::string> &, std::shared_ptr<output::OutputFile>) {
+				return ResultOrError<int>(succeed(1));
+			} },
+			{ "echo", builtinEcho },
+			{ "write", builtinWrite },
+			{ "touch", builtinTouch },
+			{ "sleep", builtinSleep }
+		};
+
+bool
+builtins::exists(const std::string & name)
+{
+	return builtinsByName.count(name) > 0;
+}
+
+ResultOrError<timeutil::DurationUnit>
+builtins::sleepDuration(const std::vector<std::string> & arguments)
+{
+	if (arguments.size() != 2)
+		return fail("builtin sleep needs one duration");
+
+	const std::string & duration = arguments[1];
+
+	// a bare number is in seconds, like sleep(1)
+	if (!duration.empty() && duration.find_first_not_of("0123456789") == std::string::npos)
+		return timeutil::parseCompactDuration(duration + "s");
+
+	return timeutil::parseCompactDuration(duration);
+}
+
+ResultOrError<int>
+builtins::run(const std::vector<std::string> & arguments, std::shared_ptr<output::OutputFile> output)
+{
+	if (arguments.empty())
+		return fail("Needs at least one argument");
+
+	auto builtinIter = builtinsByName.find(arguments[0]);
+	if (builtinIter == builtinsByName.end())
+		return fail("Unknown builtin '" + arguments[0] + "'");
+
+	return builtinIter->second(arguments, output);
+}
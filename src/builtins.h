@@ -0,0 +1,39 @@
+#ifndef BUILTINS_H
+#define BUILTINS_H
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "failure.hpp"
+#include "timeutil.h"
+#include "output.h"
+
+/*
+ * Statements run with `builtin` instead of `exec` are done right
+ * inside the scheduler, without starting a process:
+ *
+ *   builtin true / builtin false
+ *   builtin echo TEXT...         prints to the job's output
+ *   builtin write FILE TEXT...   replaces FILE's content with TEXT
+ *   builtin touch FILE...        creates FILE or updates its times
+ *   builtin sleep DURATION       5 (seconds), or 500ms, 30s, 5m, 2h
+ */
+namespace builtins
+{
+	bool exists(const std::string & name);
+
+	/* How long a sleep statement pauses the run for */
+	ResultOrError<timeutil::DurationUnit> sleepDuration(const std::vector<std::string> & arguments);
+
+	/*
+	 * Runs the builtin the first argument names; a sleep blocks the
+	 * calling thread, runs which can be resumed later rather go
+	 * through sleepDuration(). What gets printed goes to output, or to
+	 * our stdout without one.
+	 */
+	ResultOrError<int> run(const std::vector<std::string> & arguments,
+						   std::shared_ptr<output::OutputFile> output = nullptr);
+}
+
+#endif
@@ -0,0 +1,410 @@
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cgroups.h"
+#include "zygote.h"
+
+using namespace processes;
+
+/* The controllers limits can be set with, all of them are asked for once the hierarchy is set up */
+const std::vector<std::string> LIMIT_CONTROLLERS = { "cpu", "memory", "pids", "io" };
+
+Error
+controlError(const std::string & what, const std::string & path)
+{
+	int error = errno;
+	return Error(error, "Couldn't " + what + " '" + path + "': " + std::strerror(error));
+}
+
+ResultOrError<std::string>
+readControlFile(const std::string & path)
+{
+	std::ifstream file(path);
+	if (file.fail())
+		return fail(controlError("read", path));
+
+	std::stringstream content;
+	content << file.rdbuf();
+
+	return succeed(content.str());
+}
+
+/* Control files take one value per write(), it is applied or refused as a whole */
+ResultOrError<bool>
+writeControlFile(const std::string & path, const std::string & value)
+{
+	int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+	if (fd < 0)
+		return fail(controlError("open", path));
+
+	ssize_t written;
+	while ((written = write(fd, value.data(), value.size())) < 0 && errno == EINTR) {}
+
+	if (written < 0) {
+		Error error = controlError("write '" + value + "' to", path);
+		close(fd);
+		return fail(error);
+	}
+
+	close(fd);
+	return succeed(true);
+}
+
+std::vector<std::string>
+splitControllers(const std::string & text)
+{
+	std::vector<std::string> controllers;
+	std::istringstream words(text);
+	std::string word;
+
+	while (words >> word)
+		controllers.push_back(word);
+
+	return controllers;
+}
+
+/* Where cgroup v2 is mounted and the group we're in under it */
+ResultOrError<std::string>
+findOwnGroup()
+{
+	std::ifstream mounts("/proc/self/mounts");
+	std::string line, mountPoint;
+
+	while (mountPoint.empty() && std::getline(mounts, line)) {
+		std::istringstream fields(line);
+		std::string device, path, type;
+
+		if (fields >> device >> path >> type && type.compare("cgroup2") == 0)
+			mountPoint = path;
+	}
+
+	if (mountPoint.empty())
+		return fail("cgroup v2 isn't mounted");
+
+	// the v2 hierarchy is the one with the number 0 and no controller names
+	std::ifstream groups("/proc/self/cgroup");
+	while (std::getline(groups, line)) {
+		if (line.compare(0, 3, "0::") != 0)
+			continue;
+
+		std::string path = line.substr(3);
+		return succeed(path.compare("/") == 0 ? mountPoint : mountPoint + path);
+	}
+
+	return fail("We aren't in any cgroup v2 group");
+}
+
+/* Anything but what is safe in a directory name becomes an underscore */
+std::string
+leafName(const std::string & owner)
+{
+	std::string name = owner;
+
+	for (char & c : name) {
+		if (!std::isalnum(static_cast<unsigned char>(c)) && c != '-' && c != '_' && c != '.')
+			c = '_';
+	}
+
+	return name;
+}
+
+bool
+ResourceLimits::any() const
+{
+	return cpuQuota > 0 || memoryMax > 0 || pidsMax > 0 || ioWeight > 0;
+}
+
+std::vector<std::string>
+processes::controllersFor(const ResourceLimits & limits)
+{
+	std::vector<std::string> controllers;
+
+	if (limits.cpuQuota > 0)
+		controllers.push_back("cpu");
+	if (limits.memoryMax > 0)
+		controllers.push_back("memory");
+	if (limits.pidsMax > 0)
+		controllers.push_back("pids");
+	if (limits.ioWeight > 0)
+		controllers.push_back("io");
+
+	return controllers;
+}
+
+/* ---------- */
+
+ControlGroup::ControlGroup(ControlGroups & groups, const std::string & path):
+	m_groups(groups), m_path(path), m_descriptor(open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)) {}
+
+ControlGroup::~ControlGroup()
+{
+	if (m_descriptor >= 0)
+		close(m_descriptor);
+
+	m_groups.remove(m_path);
+}
+
+const std::string &
+ControlGroup::path() const
+{
+	return m_path;
+}
+
+int
+ControlGroup::descriptor() const
+{
+	return m_descriptor;
+}
+
+ResultOrError<bool>
+ControlGroup::add(pid_t pid)
+{
+	auto added = writeControlFile(m_path + "/cgroup.procs", std::to_string(pid));
+
+	// it exited already, there's nothing left to limit
+	if (added.failed() && added.getError().code == ESRCH)
+		return succeed(false);
+
+	return added;
+}
+
+GroupUsage
+ControlGroup::usage()
+{
+	GroupUsage usage;
+
+	readControlFile(m_path + "/cpu.stat")
+		.onSuccess([&usage](const std::string & stat) {
+			std::istringstream lines(stat);
+			std::string key;
+			uint64_t value;
+
+			while (lines >> key >> value) {
+				if (key.compare("usage_usec") == 0)
+					usage.cpuSeconds = value / 1e6;
+			}
+		});
+
+	// only there since Linux 5.19, and with the memory controller
+	readControlFile(m_path + "/memory.peak")
+		.onSuccess([&usage](const std::string & peak) {
+			usage.memoryPeak = std::strtoull(peak.c_str(), nullptr, 10);
+		});
+
+	return usage;
+}
+
+/* ---------- */
+
+ControlGroups::ControlGroups(const std::string & base):
+	m_base(base), m_tried(false), m_failure(""), m_nextLeaf(1) {}
+
+ResultOrError<ResourceLimits>
+ControlGroups::enforceable(const ResourceLimits & limits)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	auto ready = setUp();
+	if (ready.failed())
+		return fail(ready.getError());
+
+	ResourceLimits enforced = limits;
+	if (m_controllers.count("cpu") == 0)
+		enforced.cpuQuota = 0;
+	if (m_controllers.count("memory") == 0)
+		enforced.memoryMax = 0;
+	if (m_controllers.count("pids") == 0)
+		enforced.pidsMax = 0;
+	if (m_controllers.count("io") == 0)
+		enforced.ioWeight = 0;
+
+	if (limits.any() && !enforced.any())
+		return fail("None of the controllers the limits need are delegated to us");
+
+	return succeed(enforced);
+}
+
+ResultOrError<std::shared_ptr<ControlGroup>>
+ControlGroups::create(const std::string & owner, const ResourceLimits & limits)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	auto ready = setUp();
+	if (ready.failed())
+		return fail(ready.getError());
+
+	removeLingering();
+
+	std::string path = m_runs + "/" + leafName(owner) + "-" + std::to_string(m_nextLeaf++);
+	if (mkdir(path.c_str(), 0755) < 0)
+		return fail(controlError("create", path));
+
+	std::vector<std::pair<std::string, std::string>> settings;
+	if (limits.cpuQuota > 0 && m_controllers.count("cpu") > 0)
+		settings.emplace_back("cpu.max", std::to_string(limits.cpuQuota) + " " + std::to_string(CPU_PERIOD));
+	if (limits.memoryMax > 0 && m_controllers.count("memory") > 0)
+		settings.emplace_back("memory.max", std::to_string(limits.memoryMax));
+	if (limits.pidsMax > 0 && m_controllers.count("pids") > 0)
+		settings.emplace_back("pids.max", std::to_string(limits.pidsMax));
+	if (limits.ioWeight > 0 && m_controllers.count("io") > 0)
+		settings.emplace_back("io.weight", "default " + std::to_string(limits.ioWeight));
+
+	for (const auto & setting : settings) {
+		auto written = writeControlFile(path + "/" + setting.first, setting.second);
+		if (written.failed()) {
+			rmdir(path.c_str());
+			return fail(written.getError());
+		}
+	}
+
+	return succeed(std::make_shared<ControlGroup>(*this, path));
+}
+
+void
+ControlGroups::close()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_runs.empty())
+		return;
+
+	removeLingering();
+	rmdir(m_runs.c_str());
+}
+
+/*
+ * Done once, the first time limits come up; a failure sticks, later
+ * runs aren't any luckier.
+ */
+ResultOrError<bool>
+ControlGroups::setUp()
+{
+	if (m_tried) {
+		if (m_runs.empty())
+			return fail(m_failure);
+
+		return succeed(true);
+	}
+
+	m_tried = true;
+
+	auto enabled = enableControllers();
+	if (enabled.failed()) {
+		m_failure = enabled.getError();
+		m_runs.clear();
+		return enabled;
+	}
+
+	return succeed(true);
+}
+
+ResultOrError<bool>
+ControlGroups::enableControllers()
+{
+	if (m_base.empty()) {
+		auto base = findOwnGroup();
+		if (base.failed())
+			return fail(base.getError());
+
+		m_base = base.getResult();
+	}
+
+	auto available = readControlFile(m_base + "/cgroup.controllers");
+	if (available.failed())
+		return fail(available.getError());
+
+	std::vector<std::string> controllers = splitControllers(available.getResult());
+	std::vector<std::string> wanted;
+	for (const auto & controller : LIMIT_CONTROLLERS) {
+		if (std::find(controllers.begin(), controllers.end(), controller) != controllers.end())
+			wanted.push_back(controller);
+	}
+
+	if (wanted.empty())
+		return fail("None of the cpu, memory, pids and io controllers are available in " + m_base);
+
+	if (access((m_base + "/cgroup.subtree_control").c_str(), W_OK) < 0)
+		return fail(m_base + " isn't delegated to us");
+
+	std::string pid = std::to_string(getpid());
+	std::string subtree = m_base + "/cgroup.subtree_control";
+	bool moved = false;
+
+	for (const auto & controller : wanted) {
+		auto written = writeControlFile(subtree, "+" + controller);
+		bool enabled = written.succeeded();
+
+		// a group with processes of its own can't hand controllers down, ours go to a leaf next to the runs
+		if (!enabled && written.getError().code == EBUSY && !moved) {
+			std::string scheduler = m_base + "/automaniac-" + pid + ".scheduler";
+			if (mkdir(scheduler.c_str(), 0755) < 0 && errno != EEXIST)
+				return fail(controlError("create", scheduler));
+
+			auto movedOurs = writeControlFile(scheduler + "/cgroup.procs", pid);
+			if (movedOurs.failed())
+				return fail(movedOurs.getError());
+
+			if (zygote().pid() > 0)
+				writeControlFile(scheduler + "/cgroup.procs", std::to_string(zygote().pid()));
+
+			moved = true;
+			enabled = writeControlFile(subtree, "+" + controller).succeeded();
+		}
+
+		// another process in our group, or a controller the parent doesn't let through
+		if (enabled)
+			m_controllers.insert(controller);
+	}
+
+	m_runs = m_base + "/automaniac-" + pid;
+	if (mkdir(m_runs.c_str(), 0755) < 0 && errno != EEXIST)
+		return fail(controlError("create", m_runs));
+
+	for (auto controllerIter = m_controllers.begin(); controllerIter != m_controllers.end();) {
+		if (writeControlFile(m_runs + "/cgroup.subtree_control", "+" + *controllerIter).failed())
+			controllerIter = m_controllers.erase(controllerIter);
+		else
+			controllerIter++;
+	}
+
+	if (m_controllers.empty()) {
+		rmdir(m_runs.c_str());
+		return fail("Couldn't enable any of the cpu, memory, pids and io controllers under " + m_base);
+	}
+
+	return succeed(true);
+}
+
+void
+ControlGroups::remove(const std::string & path)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	// a spawned process outlives its run, its leaf goes once it's gone
+	if (rmdir(path.c_str()) < 0 && errno == EBUSY)
+		m_lingering.push_back(path);
+}
+
+void
+ControlGroups::removeLingering()
+{
+	m_lingering.erase(std::remove_if(m_lingering.begin(), m_lingering.end(), [](const std::string & path) {
+		return rmdir(path.c_str()) == 0 || errno != EBUSY;
+	}), m_lingering.end());
+}
+
+ControlGroups &
+processes::controlGroups()
+{
+	// never destroyed, leaves might still be released from detached threads at exit
+	static ControlGroups * instance = new ControlGroups();
+	return *instance;
+}
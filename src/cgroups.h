@@ -0,0 +1,131 @@
+#ifndef CGROUPS_H
+#define CGROUPS_H
+
+#include <string>
+#include <vector>
+#include <set>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+
+#include <sys/types.h>
+
+#include "failure.hpp"
+
+namespace processes
+{
+	/* The period cpu.max quotas are given for, in microseconds */
+	const uint64_t CPU_PERIOD = 100000;
+
+	/* What a run's processes may use together; zero leaves a resource unlimited */
+	struct ResourceLimits
+	{
+		uint64_t cpuQuota = 0;  // microseconds of CPU time per CPU_PERIOD
+		uint64_t memoryMax = 0; // bytes
+		uint64_t pidsMax = 0;
+		unsigned ioWeight = 0;  // 1 to 10000, relative to the default 100
+
+		bool any() const;
+	};
+
+	/* The controllers the limits set need, as cgroup.controllers names them */
+	std::vector<std::string> controllersFor(const ResourceLimits & limits);
+
+	/* What a run's processes used, whatever they started included */
+	struct GroupUsage
+	{
+		double cpuSeconds = 0;
+		uint64_t memoryPeak = 0; // bytes, zero when the kernel doesn't keep track of it
+	};
+
+	class ControlGroups;
+
+	/*
+	 * The transient leaf a single run's processes are started in; it
+	 * is removed once the last reference to it goes and the processes
+	 * in it are gone.
+	 */
+	class ControlGroup
+	{
+	public:
+		ControlGroup(ControlGroups & groups, const std::string & path);
+		~ControlGroup();
+
+		const std::string & path() const;
+
+		/* The leaf's directory, which processes are started in; -1 if it couldn't be opened */
+		int descriptor() const;
+
+		/*
+		 * Moves pid in; whatever it starts from then on stays in. Only
+		 * for a process which couldn't be started in the leaf: it is
+		 * moved once it already runs, so one which forks right away
+		 * might leave a child behind in ours.
+		 */
+		ResultOrError<bool> add(pid_t pid);
+
+		GroupUsage usage();
+
+	private:
+		ControlGroups & m_groups;
+		std::string m_path;
+		int m_descriptor;
+	};
+
+	/*
+	 * The part of the cgroup v2 hierarchy the scheduler was delegated:
+	 * runs with limits get a leaf of their own under a directory made
+	 * for them, with the controllers they need enabled. As cgroup v2
+	 * only lets a group without processes of its own hand resources
+	 * down, the scheduler and the zygote move to a leaf of their own
+	 * first if they have to.
+	 *
+	 * Nothing is touched until a job with limits shows up. Without a
+	 * cgroup v2 mount, or without write access to our own group, the
+	 * jobs just run without their limits.
+	 */
+	class ControlGroups
+	{
+	public:
+		/* The group to work under; found through /proc/self/cgroup when empty */
+		ControlGroups(const std::string & base = "");
+
+		/*
+		 * The part of limits which can be enforced, the others are left
+		 * at zero; fails if none can or the hierarchy isn't usable.
+		 */
+		ResultOrError<ResourceLimits> enforceable(const ResourceLimits & limits);
+
+		/* A new leaf for one of owner's runs, with limits applied */
+		ResultOrError<std::shared_ptr<ControlGroup>> create(const std::string & owner,
+															const ResourceLimits & limits);
+
+		/* Removes what was created, as far as nothing is still running in it */
+		void close();
+
+	private:
+		friend class ControlGroup;
+
+		ResultOrError<bool> setUp();
+		ResultOrError<bool> enableControllers();
+		void remove(const std::string & path);
+		void removeLingering();
+
+		std::string m_base;
+		std::string m_runs;
+		bool m_tried;
+		Error m_failure;
+		std::set<std::string> m_controllers;
+		uint64_t m_nextLeaf;
+
+		// leaves which still had processes in them when their run was over
+		std::vector<std::string> m_lingering;
+
+		std::mutex m_mutex;
+	};
+
+	/* The one runs are placed under */
+	ControlGroups & controlGroups();
+}
+
+#endif
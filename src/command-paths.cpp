@@ -0,0 +1,94 @@
+#include <cstdlib>
+
+#include <boost/process/search_path.hpp>
+#include <boost/algorithm/string.hpp>
+
+#include "command-paths.h"
+
+using namespace commands;
+using namespace std::chrono;
+
+const timeutil::DurationUnit DEFAULT_TIME_TO_LIVE = minutes(1);
+
+CommandPaths &
+commands::commandPaths()
+{
+	static CommandPaths paths(DEFAULT_TIME_TO_LIVE);
+	return paths;
+}
+
+CommandPaths::CommandPaths(timeutil::DurationUnit timeToLive):
+	m_timeToLive(timeToLive) {}
+
+ResultOrError<std::string>
+CommandPaths::resolve(const std::string & command)
+{
+	steady_clock::time_point now = steady_clock::now();
+
+	{
+		std::shared_lock<std::shared_timed_mutex> lock(m_mutex);
+
+		auto entryIter = m_entries.find(command);
+		if (entryIter != m_entries.end()) {
+			const Entry & entry = entryIter->second;
+			bool fresh = m_timeToLive == timeutil::DurationUnit::zero() || now - entry.resolved < m_timeToLive;
+
+			if (fresh && entry.path.empty())
+				return fail("Couldn't locate command '" + command + "'");
+			if (fresh)
+				return succeed(entry.path);
+		}
+	}
+
+	// two threads might look the same command up, they'd find the same thing
+	std::string path = boost::process::search_path(command).string();
+
+	{
+		std::unique_lock<std::shared_timed_mutex> lock(m_mutex);
+		m_entries[command] = Entry { path, now };
+	}
+
+	if (path.empty())
+		return fail("Couldn't locate command '" + command + "'");
+
+	return succeed(path);
+}
+
+void
+CommandPaths::invalidate()
+{
+	std::unique_lock<std::shared_timed_mutex> lock(m_mutex);
+	m_entries.clear();
+}
+
+void
+CommandPaths::forget(const std::string & command)
+{
+	std::unique_lock<std::shared_timed_mutex> lock(m_mutex);
+	m_entries.erase(command);
+}
+
+void
+CommandPaths::setTimeToLive(timeutil::DurationUnit timeToLive)
+{
+	std::unique_lock<std::shared_timed_mutex> lock(m_mutex);
+	m_timeToLive = timeToLive;
+}
+
+std::vector<std::string>
+CommandPaths::directories()
+{
+	const char * path = std::getenv("PATH");
+	std::vector<std::string> directories;
+
+	if (path == nullptr)
+		return directories;
+
+	boost::split(directories, path, boost::is_any_of(":"));
+	for (auto & directory : directories) {
+		if (directory.empty())
+			directory = ".";
+	}
+
+	return directories;
+}
@@ -0,0 +1,53 @@
+#ifndef COMMANDPATHS_H
+#define COMMANDPATHS_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <shared_mutex>
+#include <chrono>
+
+#include "failure.hpp"
+#include "timeutil.h"
+
+namespace commands
+{
+	/*
+	 * Where commands were found in PATH, so running a statement 
+	 * doesn't stat every PATH directory again. Whoever can tell when
+	 * the PATH directories change calls invalidate(); until then (or 
+	 * when nobody can) entries are trusted for the time to live.
+	 * Commands which weren't found are remembered too.
+	 */
+	class CommandPaths
+	{
+	public:
+		CommandPaths(timeutil::DurationUnit timeToLive);
+
+		ResultOrError<std::string> resolve(const std::string & command);
+
+		void invalidate();
+		void forget(const std::string & command);
+
+		/* Zero keeps entries until they are invalidated */
+		void setTimeToLive(timeutil::DurationUnit timeToLive);
+
+		/* The directories lookups go through */
+		std::vector<std::string> directories();
+
+	private:
+		struct Entry
+		{
+			std::string path; // empty when the command wasn't found
+			std::chrono::steady_clock::time_point resolved;
+		};
+
+		std::unordered_map<std::string, Entry> m_entries;
+		timeutil::DurationUnit m_timeToLive;
+		std::shared_timed_mutex m_mutex;
+	};
+
+	CommandPaths & commandPaths();
+}
+
+#endif
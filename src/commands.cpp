@@ -1,29 +1,85 @@
-#include <boost/process.hpp>
-#include <boost/filesystem.hpp>
-#include <boost/process/search_path.hpp>
-#include <boost/algorithm/string/join.hpp>
-
 #include <unordered_map>
 #include <string>
+#include <thread>
+#include <future>
+#include <memory>
+#include <cerrno>
 
 #include "commands.h"
+#include "command-paths.h"
+#include "process.h"
+#include "util.hpp"
 
-using namespace boost;
 
 namespace process_wrappers
 {
-	int system(const std::string & fullCommand)
+	/* Starts the process in the run's control group if it has one, or moves it in there if it can't */
+	ResultOrError<pid_t> start(const std::string & path, const std::vector<std::string> & arguments, 
+							   const commands::ExecContext & context)
 	{
-		return process::system(fullCommand);
+		int cgroup = context.group != nullptr ? context.group->descriptor() : -1;
+		bool placed = false;
+
+		ResultOrError<pid_t> started = processes::start(path, arguments, context.environment, context.output, 
+														context.ownGroup, cgroup, &placed);
+
+		// the process runs anyway, just without the run's limits
+		if (started.succeeded() && context.group != nullptr && !placed) {
+			context.group->add(started.getResult())
+				.onFailure([&context](const Error & error) {
+					printerr("[" + context.owner + "] " + error.message);
+				});
+		}
+
+		return started;
+	}
+
+	ResultOrError<int> system(const std::string & path, const std::vector<std::string> & arguments, 
+							  const commands::ExecContext & context)
+	{
+		if (context.reaper == nullptr) {
+			return start(path, arguments, context)
+					.mapSuccess<int>([](const pid_t & pid) {
+						return processes::wait(pid);
+					});
+		}
+
+		return start(path, arguments, context)
+				.mapSuccess<int>([&](const pid_t & pid) {
+					auto exited = std::make_shared<std::promise<int>>();
+					std::future<int> code = exited->get_future();
+
+					context.reaper->track(pid, context.owner, path, [exited](const processes::ProcessExit & exit) {
+						exited->set_value(exit.code);
+					});
+
+					int result = code.get();
+					if (result < 0)
+						return ResultOrError<int>(fail("Lost track of '" + path + "' before it exited"));
+
+					return succeed(result);
+				});
 	}
 
-	int spawn(const std::string & fullCommand)
+	/* Nothing waits for a spawned command, it's reaped whenever it exits */
+	ResultOrError<int> spawn(const std::string & path, const std::vector<std::string> & arguments, 
+							 const commands::ExecContext & context)
 	{
-		process::spawn(fullCommand);
-		return 0;
+		return start(path, arguments, context)
+				.mapSuccess<int>([&](const pid_t & pid) {
+					if (context.reaper != nullptr)
+						context.reaper->track(pid, context.owner, path);
+					else
+						std::thread([pid]() { processes::wait(pid); }).detach();
+
+					return succeed(0);
+				});
 	}
 }
 
+typedef std::function<ResultOrError<int>(const std::string &, const std::vector<std::string> &, 
+										 const commands::ExecContext &)> Launcher;
+
 /*
  * TODO: move this map to a file so that it could 
  *       changed without having to recompile the 
@@ -43,55 +99,101 @@ ResultOrError<std::string> getFileExtension(const std::string & filename) {
 	return succeed(filename.substr(index + 1));
 }
 
-ResultOrError<boost::filesystem::path> getCommandPath(const std::string & command)
+
+std::vector<std::string> withCommand(const std::string & command, const std::vector<std::string> & args)
 {
-	filesystem::path path = process::search_path(command);
-	if (path.native().empty())
-		return fail("Couldn't locate command '" + command + "'");
+	std::vector<std::string> arguments = { command };
+	arguments.insert(arguments.end(), args.begin(), args.end());
 
-	return succeed(path);
+	return arguments;
 }
 
-ResultOrError<int> executeCommand(const std::string & command, const std::string & commandWithArgs, 
-									std::function<int(const std::string &)> executor)
+std::vector<std::string> withCommand(const std::string & command, const std::string & file, 
+									 const std::vector<std::string> & args)
 {
-	return getCommandPath(command)
-			.mapSuccess<int>([&](const auto &) {
-				return succeed(executor(commandWithArgs));
+	std::vector<std::string> arguments = { command, file };
+	arguments.insert(arguments.end(), args.begin(), args.end());
+
+	return arguments;
+}
+
+/* The arguments go to the command as they were split, the first one names it */
+ResultOrError<int> executeCommand(const std::vector<std::string> & arguments, 
+									const commands::ExecContext & context, Launcher launcher)
+{
+	const std::string & command = arguments.at(0);
+
+	ResultOrError<int> result = commands::commandPaths().resolve(command)
+			.mapSuccess<int>([&](const std::string & path) {
+				return launcher(path, arguments, context);
+			});
+
+	// the command was moved or removed since it was looked up
+	if (result.failed() && (result.getError().code == ENOENT || result.getError().code == EACCES)) {
+		commands::commandPaths().forget(command);
+
+		return commands::commandPaths().resolve(command)
+				.mapSuccess<int>([&](const std::string & path) {
+					return launcher(path, arguments, context);
+				});
+	}
+
+	return result;
+}
+
+ResultOrError<std::string>
+commands::commandFor(const std::string & runner, const std::vector<std::string> & allArgs)
+{
+	if (allArgs.size() < 1)
+		return fail("Needs at least one argument");
+
+	if (runner.compare("run") != 0)
+		return succeed(allArgs.at(0));
+
+	return getFileExtension(allArgs.at(0))
+			.mapSuccess<std::string>([&](const auto & ext) {
+				auto runnerIter = scriptRunners.find(ext);
+				if (runnerIter == scriptRunners.end())
+					return ResultOrError<std::string>(fail("Couldn't run script with extention " + ext));
+
+				return succeed(runnerIter->second);
 			});
 }
 
 ResultOrError<int> 
-commands::exec(const std::string & command, const std::vector<std::string> & args)
+commands::exec(const std::string & command, const std::vector<std::string> & args,
+					const ExecContext & context)
 {
-	return executeCommand(command, command + ' ' + algorithm::join(args, " "), process_wrappers::system);
+	return executeCommand(withCommand(command, args), context, process_wrappers::system);
 }
 
 ResultOrError<int> 
 commands::exec(const std::string & command, const std::string & file, 
-					const std::vector<std::string> & args)
+					const std::vector<std::string> & args,
+					const ExecContext & context)
 {
-	return executeCommand(command, command + ' ' + file + ' ' + algorithm::join(args, " "), 
-							process_wrappers::system);
+	return executeCommand(withCommand(command, file, args), context, process_wrappers::system);
 }
 
 ResultOrError<int> 
-commands::exec(const std::vector<std::string> & allArgs)
+commands::exec(const std::vector<std::string> & allArgs,
+					const ExecContext & context)
 {
 	if (allArgs.size() < 1)
 		return fail("Needs at least one argument");
 
-	return executeCommand(allArgs.at(0), algorithm::join(allArgs, " "), process_wrappers::system);
+	return executeCommand(allArgs, context, process_wrappers::system);
 }
 
 ResultOrError<int>
-commands::run(const std::string & script, const std::vector<std::string> & args)
+commands::run(const std::string & script, const std::vector<std::string> & args,
+					const ExecContext & context)
 {
 	return getFileExtension(script)
 			.mapSuccess<int>([&](const auto & ext) {
 				try {
 					const std::string & runner = scriptRunners.at(ext);
-					return exec(runner, script, args);
+					return exec(runner, script, args, context);
 				} catch (const std::out_of_range &) {
 					return ResultOrError<int>(fail("Couldn't run script with extention " + ext));
 				}
@@ -99,7 +201,8 @@ commands::run(const std::string & script, const std::vector<std::string> & args)
 }
 
 ResultOrError<int>
-commands::run(const std::vector<std::string> & allArgs)
+commands::run(const std::vector<std::string> & allArgs,
+					const ExecContext & context)
 {
 	if (allArgs.size() < 1)
 		return fail("Needs at least one argument");
@@ -108,7 +211,7 @@ commands::run(const std::vector<std::string> & allArgs)
 			.mapSuccess<int>([&](const auto & ext) {
 				try {
 					const std::string & runner = scriptRunners.at(ext);
-					return exec(runner, allArgs);
+					return exec(runner, allArgs, context);
 				} catch (const std::out_of_range &) {
 					return ResultOrError<int>(fail("Couldn't run script with extention " + ext));
 				}
@@ -117,24 +220,56 @@ commands::run(const std::vector<std::string> & allArgs)
 
 
 ResultOrError<int> 
-commands::spawn(const std::string & command, const std::vector<std::string> & args)
+commands::spawn(const std::string & command, const std::vector<std::string> & args,
+					const ExecContext & context)
 {
-	return executeCommand(command, command + ' ' + algorithm::join(args, " "), process_wrappers::spawn);
+	return executeCommand(withCommand(command, args), context, process_wrappers::spawn);
 }
 
 ResultOrError<int> 
 commands::spawn(const std::string & command, const std::string & file, 
-					const std::vector<std::string> & args)
+					const std::vector<std::string> & args,
+					const ExecContext & context)
 {
-	return executeCommand(command, command + ' ' + file + ' ' + algorithm::join(args, " "), 
-							process_wrappers::spawn);
+	return executeCommand(withCommand(command, file, args), context, process_wrappers::spawn);
 }
 
 ResultOrError<int> 
-commands::spawn(const std::vector<std::string> & allArgs)
+commands::spawn(const std::vector<std::string> & allArgs,
+					const ExecContext & context)
 {
 	if (allArgs.size() < 1)
 		return fail("Needs at least one argument");
 
-	return executeCommand(allArgs.at(0), algorithm::join(allArgs, " "), process_wrappers::spawn);
+	return executeCommand(allArgs, context, process_wrappers::spawn);
+}
+
+ResultOrError<pid_t>
+commands::launch(const std::string & runner, const std::vector<std::string> & allArgs,
+				 const ExecContext & context, processes::ExitCallback exited)
+{
+	if (context.reaper == nullptr)
+		return fail("Needs a reaper to launch without waiting");
+
+	if (allArgs.size() < 1)
+		return fail("Needs at least one argument");
+
+	std::vector<std::string> arguments = allArgs;
+	if (runner.compare("run") == 0) {
+		auto command = commandFor(runner, allArgs);
+		if (command.failed())
+			return fail(command.getError());
+
+		arguments = withCommand(command.getResult(), allArgs);
+	}
+
+	return executeCommand(arguments, context, [exited](const std::string & path, 
+													   const std::vector<std::string> & arguments, 
+													   const ExecContext & context) {
+		return process_wrappers::start(path, arguments, context)
+				.mapSuccess<int>([&](const pid_t & pid) {
+					context.reaper->track(pid, context.owner, path, exited);
+					return succeed(pid);
+				});
+	});
 }
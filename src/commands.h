@@ -3,29 +3,69 @@
 
 #include <string>
 #include <vector>
+#include <memory>
 
 #include "failure.hpp"
+#include "process.h"
+#include "reaper.h"
+#include "cgroups.h"
 
 namespace commands
 {
 
-ResultOrError<int> exec(const std::string & command, const std::vector<std::string> & args);
+typedef processes::Environment Environment;
+
+/* What a command gets besides its arguments */
+struct ExecContext
+{
+	Environment environment;
+	int output = -1; // stdout and stderr; -1 keeps ours
+	bool ownGroup = false; // whether the process gets a process group of its own
+
+	// takes the started processes over, along with the job they were started for
+	processes::Reaper * reaper = nullptr;
+	std::string owner;
+
+	// the run's control group, started processes start out in it
+	std::shared_ptr<processes::ControlGroup> group;
+};
+
+ResultOrError<int> exec(const std::string & command, const std::vector<std::string> & args,
+						const ExecContext & context = ExecContext());
 
 ResultOrError<int> exec(const std::string & command, const std::string & file, 
-						const std::vector<std::string> & args);
+						const std::vector<std::string> & args,
+						const ExecContext & context = ExecContext());
 
-ResultOrError<int> exec(const std::vector<std::string> & allArgs);
+ResultOrError<int> exec(const std::vector<std::string> & allArgs,
+						const ExecContext & context = ExecContext());
 
-ResultOrError<int> run(const std::string & script, const std::vector<std::string> & args);
+ResultOrError<int> run(const std::string & script, const std::vector<std::string> & args,
+						const ExecContext & context = ExecContext());
 
-ResultOrError<int> run(const std::vector<std::string> & allArgs);
+ResultOrError<int> run(const std::vector<std::string> & allArgs,
+						const ExecContext & context = ExecContext());
 
-ResultOrError<int> spawn(const std::string & command, const std::vector<std::string> & args);
+ResultOrError<int> spawn(const std::string & command, const std::vector<std::string> & args,
+						const ExecContext & context = ExecContext());
 
 ResultOrError<int> spawn(const std::string & command, const std::string & file, 
-						const std::vector<std::string> & args);
+						const std::vector<std::string> & args,
+						const ExecContext & context = ExecContext());
+
+/*
+ * Starts what a statement names, for any of the runners, without 
+ * waiting for it: the context's reaper (which it can't do without) 
+ * calls exited once it's over. Returns the pid.
+ */
+ResultOrError<pid_t> launch(const std::string & runner, const std::vector<std::string> & allArgs,
+							const ExecContext & context, processes::ExitCallback exited);
+
+ResultOrError<int> spawn(const std::vector<std::string> & allArgs,
+						const ExecContext & context = ExecContext());
 
-ResultOrError<int> spawn(const std::vector<std::string> & allArgs);
+/* The command a statement's runner ends up starting, the script runner for run */
+ResultOrError<std::string> commandFor(const std::string & runner, const std::vector<std::string> & allArgs);
 
 } // namespace
 
@@ -0,0 +1,92 @@
+#include "engine.h"
+
+using namespace scheduling;
+
+Engine::Engine(std::unique_ptr<Executor> executor):
+	m_executor(std::move(executor)), m_watcher(m_loop, m_timers), m_reaper(m_loop), m_holds(0) {}
+
+TimerQueue &
+Engine::timers()
+{
+	return m_timers;
+}
+
+Executor &
+Engine::executor()
+{
+	return *m_executor;
+}
+
+EventLoop &
+Engine::loop()
+{
+	return m_loop;
+}
+
+watchers::FileWatcher &
+Engine::watcher()
+{
+	return m_watcher;
+}
+
+output::OutputWriter &
+Engine::output()
+{
+	return m_output;
+}
+
+processes::Reaper &
+Engine::reaper()
+{
+	return m_reaper;
+}
+
+bool
+Engine::dispatch(const void * key, Task task, Admission admission)
+{
+	hold();
+
+	bool queued = m_executor->submit(key, [this, task]() {
+		task();
+		release();
+	}, admission);
+
+	if (!queued)
+		release();
+
+	return queued;
+}
+
+void
+Engine::hold()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_holds++;
+}
+
+void
+Engine::release()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (--m_holds == 0)
+		m_released.notify_all();
+}
+
+void
+Engine::run()
+{
+	m_executor->start();
+	m_output.start();
+	m_loop.start();
+	m_timers.start();
+
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_released.wait(lock, [this]() { return m_holds == 0; });
+	}
+
+	m_timers.stop();
+	m_loop.stop();
+	m_output.stop();
+	m_executor->stop();
+}
@@ -0,0 +1,64 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+
+#include "timer-queue.h"
+#include "executor.h"
+#include "event-loop.h"
+#include "file-watch.h"
+#include "output.h"
+#include "reaper.h"
+
+namespace scheduling
+{
+	/*
+	 * The central scheduler: jobs register their deadlines with the
+	 * timer queue and their watched paths with the file watcher, both
+	 * hand fired jobs over to the executor.
+	 * Every job which might still fire holds the engine, and run()
+	 * returns once nothing holds it anymore.
+	 */
+	class Engine
+	{
+	public:
+		Engine(std::unique_ptr<Executor> executor);
+
+		TimerQueue & timers();
+		Executor & executor();
+		EventLoop & loop();
+		watchers::FileWatcher & watcher();
+		output::OutputWriter & output();
+		processes::Reaper & reaper();
+
+		/*
+		 * Returns false if the executor turned the task down. Everything
+		 * dispatched comes from the engine's own threads, so it's never
+		 * held up by a full queue: a new run is dropped, the rest of one
+		 * going on is always taken.
+		 */
+		bool dispatch(const void * key, Task task, Admission admission = INTERNAL);
+
+		void hold();
+		void release();
+
+		void run();
+
+	private:
+		TimerQueue m_timers;
+		std::unique_ptr<Executor> m_executor;
+		EventLoop m_loop;
+		watchers::FileWatcher m_watcher;
+		output::OutputWriter m_output;
+		processes::Reaper m_reaper;
+
+		unsigned m_holds;
+		std::mutex m_mutex;
+		std::condition_variable m_released;
+	};
+}
+
+#endif
@@ -0,0 +1,116 @@
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <cerrno>
+
+#include "event-loop.h"
+
+using namespace scheduling;
+
+EventLoop::EventLoop():
+	m_epoll(epoll_create1(EPOLL_CLOEXEC)), m_wakeup(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+	m_stopping(false)
+{
+	if (m_epoll >= 0 && m_wakeup >= 0) {
+		epoll_event event = {};
+		event.events = EPOLLIN;
+		event.data.fd = m_wakeup;
+		epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_wakeup, &event);
+	}
+}
+
+EventLoop::~EventLoop()
+{
+	stop();
+
+	if (m_wakeup >= 0)
+		close(m_wakeup);
+	if (m_epoll >= 0)
+		close(m_epoll);
+}
+
+bool
+EventLoop::add(int fd, uint32_t events, EventHandler handler)
+{
+	if (m_epoll < 0)
+		return false;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	epoll_event event = {};
+	event.events = events;
+	event.data.fd = fd;
+
+	if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &event) != 0)
+		return false;
+
+	m_handlers[fd] = std::make_shared<EventHandler>(std::move(handler));
+	return true;
+}
+
+void
+EventLoop::remove(int fd)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (m_handlers.erase(fd) > 0)
+		epoll_ctl(m_epoll, EPOLL_CTL_DEL, fd, nullptr);
+}
+
+void
+EventLoop::start()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_thread.joinable() || m_epoll < 0)
+		return;
+
+	m_stopping = false;
+	m_thread = std::thread(&EventLoop::loop, this);
+}
+
+void
+EventLoop::stop()
+{
+	m_stopping = true;
+
+	uint64_t one = 1;
+	if (m_wakeup >= 0 && write(m_wakeup, &one, sizeof(one)) < 0) {
+		// the counter can only be full if the loop is already being woken up
+	}
+
+	if (m_thread.joinable() && m_thread.get_id() != std::this_thread::get_id())
+		m_thread.join();
+}
+
+void
+EventLoop::loop()
+{
+	const int MAX_EVENTS = 64;
+	epoll_event events[MAX_EVENTS];
+
+	while (!m_stopping) {
+		int ready = epoll_wait(m_epoll, events, MAX_EVENTS, -1);
+		if (ready < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		for (int i = 0; i < ready && !m_stopping; i++) {
+			int fd = events[i].data.fd;
+			if (fd == m_wakeup)
+				continue;
+
+			std::shared_ptr<EventHandler> handler;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				auto handlerIter = m_handlers.find(fd);
+				if (handlerIter == m_handlers.end())
+					continue;
+				handler = handlerIter->second;
+			}
+
+			(*handler)(events[i].events);
+		}
+	}
+}
@@ -0,0 +1,47 @@
+#ifndef EVENTLOOP_H
+#define EVENTLOOP_H
+
+#include <functional>
+#include <unordered_map>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <cstdint>
+
+namespace scheduling
+{
+	typedef std::function<void(uint32_t)> EventHandler;
+
+	/*
+	 * One epoll instance and the thread waiting on it, shared by
+	 * everything which waits on file descriptors. Handlers get the
+	 * epoll events and run on the loop thread, so just like timer
+	 * callbacks they should hand work off rather than block.
+	 */
+	class EventLoop
+	{
+	public:
+		EventLoop();
+		~EventLoop();
+
+		bool add(int fd, uint32_t events, EventHandler handler);
+		void remove(int fd);
+
+		void start();
+		void stop();
+
+	private:
+		void loop();
+
+		int m_epoll;
+		int m_wakeup;
+		std::atomic<bool> m_stopping;
+
+		std::unordered_map<int, std::shared_ptr<EventHandler>> m_handlers;
+		std::mutex m_mutex;
+		std::thread m_thread;
+	};
+}
+
+#endif
@@ -0,0 +1,376 @@
+#include "executor.h"
+
+using namespace scheduling;
+
+unsigned
+scheduling::defaultWorkerCount()
+{
+	unsigned cores = std::thread::hardware_concurrency();
+	return cores > 0 ? cores : 1;
+}
+
+std::unique_ptr<Executor>
+scheduling::makeExecutor(ExecutorKind kind, unsigned workers, size_t capacity, Backpressure policy)
+{
+	if (kind == POOL)
+		return std::make_unique<WorkerPool>(workers, capacity, policy);
+
+	return std::make_unique<StealingExecutor>(workers, capacity, policy);
+}
+
+/* ---------- */
+
+Executor::Executor(size_t capacity, Backpressure policy):
+	m_capacity(capacity > 0 ? capacity : 1), m_policy(policy),
+	m_depth(0), m_maxDepth(0), m_running(0),
+	m_submitted(0), m_executed(0), m_dropped(0), m_coalesced(0),
+	m_waitingForRoom(0), m_stopping(false) {}
+
+bool
+Executor::submit(const void * key, Task task, Admission admission)
+{
+	m_submitted++;
+
+	// dropping one would leave whatever it's the rest of hanging
+	if (admission == CONTINUATION) {
+		size_t depth = m_depth++;
+
+		size_t maxDepth = m_maxDepth.load();
+		while (depth + 1 > maxDepth && !m_maxDepth.compare_exchange_weak(maxDepth, depth + 1)) {}
+
+		enqueue([this, key, task]() {
+			started(key);
+			task();
+			finished();
+		});
+
+		return true;
+	}
+
+	std::unique_lock<std::mutex> keysLock(m_keysMutex, std::defer_lock);
+	if (m_policy == COALESCE) {
+		keysLock.lock();
+		if (m_queuedKeys.count(key) > 0) {
+			m_coalesced++;
+			return false;
+		}
+	}
+
+	size_t depth = m_depth.load();
+	while (1) {
+		if (depth < m_capacity) {
+			if (m_depth.compare_exchange_weak(depth, depth + 1))
+				break;
+			continue;
+		}
+
+		if (m_policy != QUEUE || admission == INTERNAL) {
+			m_dropped++;
+			return false;
+		}
+
+		std::unique_lock<std::mutex> lock(m_roomMutex);
+		m_waitingForRoom++;
+		m_room.wait(lock, [this]() { return m_depth.load() < m_capacity || m_stopping; });
+		m_waitingForRoom--;
+
+		if (m_stopping) {
+			m_dropped++;
+			return false;
+		}
+
+		depth = m_depth.load();
+	}
+
+	size_t maxDepth = m_maxDepth.load();
+	while (depth + 1 > maxDepth && !m_maxDepth.compare_exchange_weak(maxDepth, depth + 1)) {}
+
+	if (m_policy == COALESCE) {
+		m_queuedKeys.insert(key);
+		keysLock.unlock();
+	}
+
+	enqueue([this, key, task]() {
+		started(key);
+		task();
+		finished();
+	});
+
+	return true;
+}
+
+void
+Executor::started(const void * key)
+{
+	if (m_policy == COALESCE) {
+		std::lock_guard<std::mutex> lock(m_keysMutex);
+		m_queuedKeys.erase(key);
+	}
+
+	m_depth--;
+	m_running++;
+
+	// the lock makes sure a waiter which just saw a full queue is already waiting
+	if (m_waitingForRoom.load() > 0) {
+		std::lock_guard<std::mutex> lock(m_roomMutex);
+		m_room.notify_one();
+	}
+}
+
+void
+Executor::finished()
+{
+	m_running--;
+	m_executed++;
+}
+
+void
+Executor::stopAdmitting()
+{
+	std::lock_guard<std::mutex> lock(m_roomMutex);
+	m_stopping = true;
+	m_room.notify_all();
+}
+
+ExecutorMetrics
+Executor::metrics()
+{
+	return ExecutorMetrics {
+		m_depth.load(),
+		m_maxDepth.load(),
+		m_running.load(),
+		m_submitted.load(),
+		m_executed.load(),
+		m_dropped.load(),
+		m_coalesced.load()
+	};
+}
+
+/* ---------- */
+
+WorkerPool::WorkerPool(unsigned workers, size_t capacity, Backpressure policy):
+	Executor(capacity, policy), m_workerCount(workers > 0 ? workers : 1), m_stopping(false) {}
+
+WorkerPool::~WorkerPool()
+{
+	stop();
+}
+
+void
+WorkerPool::enqueue(Task task)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_queue.push_back(std::move(task));
+	m_notEmpty.notify_one();
+}
+
+void
+WorkerPool::start()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_workers.empty())
+		return;
+
+	m_stopping = false;
+	for (unsigned i = 0; i < m_workerCount; i++)
+		m_workers.emplace_back(&WorkerPool::work, this);
+}
+
+void
+WorkerPool::stop()
+{
+	stopAdmitting();
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+		m_notEmpty.notify_all();
+	}
+
+	for (auto & worker : m_workers)
+		worker.join();
+	m_workers.clear();
+}
+
+void
+WorkerPool::work()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	while (1) {
+		m_notEmpty.wait(lock, [this]() { return !m_queue.empty() || m_stopping; });
+		if (m_queue.empty())
+			break;
+
+		Task task = std::move(m_queue.front());
+		m_queue.pop_front();
+
+		lock.unlock();
+		task();
+		lock.lock();
+	}
+}
+
+/* ---------- */
+
+std::atomic<uint64_t> executorIds(1);
+
+/*
+ * The deque the current thread pushes to, tagged with the executor it
+ * belongs to since a thread might feed more than one over its life.
+ */
+struct ThreadDeque
+{
+	uint64_t executorId;
+	WorkStealingDeque<Task *> * deque;
+};
+
+thread_local ThreadDeque currentDeque { 0, nullptr };
+
+StealingExecutor::StealingExecutor(unsigned workers, size_t capacity, Backpressure policy):
+	Executor(capacity, policy), m_workerCount(workers > 0 ? workers : 1), m_id(executorIds++),
+	m_deques(m_workerCount + MAX_PRODUCERS), m_dequeCount(m_workerCount), m_sharedSize(0),
+	m_stopping(false), m_sleeping(0)
+{
+	for (unsigned i = 0; i < m_workerCount; i++)
+		m_deques[i].reset(new Deque());
+}
+
+StealingExecutor::~StealingExecutor()
+{
+	stop();
+}
+
+StealingExecutor::Deque *
+StealingExecutor::ownDeque()
+{
+	if (currentDeque.executorId == m_id)
+		return currentDeque.deque;
+
+	std::lock_guard<std::mutex> lock(m_registerMutex);
+
+	size_t index = m_dequeCount.load();
+	if (index >= m_deques.size())
+		return nullptr;
+
+	m_deques[index].reset(new Deque());
+	m_dequeCount.store(index + 1, std::memory_order_release);
+
+	currentDeque = ThreadDeque { m_id, m_deques[index].get() };
+	return currentDeque.deque;
+}
+
+void
+StealingExecutor::enqueue(Task task)
+{
+	Task * item = new Task(std::move(task));
+	Deque * deque = ownDeque();
+
+	if (deque != nullptr) {
+		deque->push(item);
+	}
+	else {
+		std::lock_guard<std::mutex> lock(m_sharedMutex);
+		m_shared.push_back(item);
+		m_sharedSize++;
+	}
+
+	// pairs with the fence of a worker going to sleep: either it sees the task or we see it
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (m_sleeping.load() > 0) {
+		std::lock_guard<std::mutex> lock(m_parkMutex);
+		m_wake.notify_one();
+	}
+}
+
+Task *
+StealingExecutor::findTask(size_t self)
+{
+	Task * task = m_deques[self]->take();
+	if (task != nullptr)
+		return task;
+
+	size_t count = m_dequeCount.load(std::memory_order_acquire);
+	for (size_t i = 1; i < count; i++) {
+		task = m_deques[(self + i) % count]->steal();
+		if (task != nullptr)
+			return task;
+	}
+
+	if (m_sharedSize.load() > 0) {
+		std::lock_guard<std::mutex> lock(m_sharedMutex);
+		if (!m_shared.empty()) {
+			task = m_shared.front();
+			m_shared.pop_front();
+			m_sharedSize--;
+		}
+	}
+
+	return task;
+}
+
+void
+StealingExecutor::start()
+{
+	std::lock_guard<std::mutex> lock(m_registerMutex);
+	if (!m_workers.empty())
+		return;
+
+	m_stopping = false;
+	for (unsigned i = 0; i < m_workerCount; i++)
+		m_workers.emplace_back(&StealingExecutor::work, this, i);
+}
+
+void
+StealingExecutor::stop()
+{
+	stopAdmitting();
+
+	{
+		std::lock_guard<std::mutex> lock(m_parkMutex);
+		m_stopping = true;
+		m_wake.notify_all();
+	}
+
+	for (auto & worker : m_workers)
+		worker.join();
+	m_workers.clear();
+
+	// the workers are gone, so nothing races for whatever is left over
+	Task * leftover;
+	while ((leftover = findTask(0)) != nullptr)
+		delete leftover;
+}
+
+void
+StealingExecutor::work(size_t index)
+{
+	currentDeque = ThreadDeque { m_id, m_deques[index].get() };
+
+	while (!m_stopping) {
+		Task * task = findTask(index);
+
+		// bursts tend to come in waves, so don't go to sleep right away
+		for (int spin = 0; spin < 64 && task == nullptr; spin++) {
+			std::this_thread::yield();
+			task = findTask(index);
+		}
+
+		if (task == nullptr) {
+			std::unique_lock<std::mutex> lock(m_parkMutex);
+			m_sleeping++;
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+
+			task = findTask(index);
+			if (task == nullptr && !m_stopping)
+				m_wake.wait(lock);
+
+			m_sleeping--;
+			if (task == nullptr)
+				continue;
+		}
+
+		(*task)();
+		delete task;
+	}
+}
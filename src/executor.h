@@ -0,0 +1,188 @@
+#ifndef EXECUTOR_H
+#define EXECUTOR_H
+
+#include <functional>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <unordered_set>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <cstdint>
+
+#include "work-stealing-deque.hpp"
+
+namespace scheduling
+{
+	typedef std::function<void()> Task;
+
+	/* What happens to a submission once the queue is full */
+	enum Backpressure
+	{
+		QUEUE,   // an external submitter waits for room, see Admission
+		DROP,    // the submission is dropped
+		COALESCE // like DROP, but a job is never queued twice either
+	};
+
+	/* Where a submission comes from, which decides whether a full queue can hold it up */
+	enum Admission
+	{
+		EXTERNAL,    // a producer of its own, it's up to the backpressure policy
+		INTERNAL,    // a thread the queue is drained by or waits on; never waits, a full queue drops it
+		CONTINUATION // the rest of a task already admitted; always taken, past the bound if need be
+	};
+
+	enum ExecutorKind
+	{
+		POOL,    // one shared queue
+		STEALING // per-thread work-stealing deques
+	};
+
+	struct ExecutorMetrics
+	{
+		size_t depth;
+		size_t maxDepth;
+		size_t running;
+		uint64_t submitted;
+		uint64_t executed;
+		uint64_t dropped;
+		uint64_t coalesced;
+	};
+
+	/*
+	 * Runs tasks on a fixed number of workers. Bounding the number of
+	 * queued tasks and the backpressure policy are handled here, how
+	 * the queued tasks reach the workers is up to the implementations.
+	 */
+	class Executor
+	{
+	public:
+		Executor(size_t capacity, Backpressure policy);
+		virtual ~Executor() {}
+
+		/*
+		 * The key identifies the job a task belongs to and is only used
+		 * for coalescing; returns whether the task was queued. Only an
+		 * external submission ever waits for room: a worker, the timer
+		 * dispatcher or the event loop waiting on a full queue might be
+		 * what would have drained it.
+		 */
+		bool submit(const void * key, Task task, Admission admission = EXTERNAL);
+		ExecutorMetrics metrics();
+
+		virtual void start() = 0;
+		virtual void stop() = 0;
+
+	protected:
+		/* Hands an admitted task over to the workers */
+		virtual void enqueue(Task task) = 0;
+
+		void stopAdmitting();
+
+	private:
+		void started(const void * key);
+		void finished();
+
+		const size_t m_capacity;
+		const Backpressure m_policy;
+
+		std::atomic<size_t> m_depth;
+		std::atomic<size_t> m_maxDepth;
+		std::atomic<size_t> m_running;
+		std::atomic<uint64_t> m_submitted;
+		std::atomic<uint64_t> m_executed;
+		std::atomic<uint64_t> m_dropped;
+		std::atomic<uint64_t> m_coalesced;
+
+		std::mutex m_keysMutex;
+		std::unordered_set<const void *> m_queuedKeys;
+
+		std::atomic<unsigned> m_waitingForRoom;
+		bool m_stopping;
+		std::mutex m_roomMutex;
+		std::condition_variable m_room;
+	};
+
+	/* Workers sharing one queue behind a lock */
+	class WorkerPool : public Executor
+	{
+	public:
+		WorkerPool(unsigned workers, size_t capacity, Backpressure policy);
+		~WorkerPool();
+
+		void start() override;
+		void stop() override;
+
+	protected:
+		void enqueue(Task task) override;
+
+	private:
+		void work();
+
+		const unsigned m_workerCount;
+
+		std::deque<Task> m_queue;
+		bool m_stopping;
+
+		std::mutex m_mutex;
+		std::condition_variable m_notEmpty;
+		std::vector<std::thread> m_workers;
+	};
+
+	/*
+	 * Every thread submitting tasks (the timer dispatcher, the workers
+	 * themselves) pushes to a Chase-Lev deque of its own without any
+	 * lock; idle workers steal from the top of the others' deques, so
+	 * a burst of firings spreads over the workers without them all
+	 * contending on one queue.
+	 */
+	class StealingExecutor : public Executor
+	{
+	public:
+		StealingExecutor(unsigned workers, size_t capacity, Backpressure policy);
+		~StealingExecutor();
+
+		void start() override;
+		void stop() override;
+
+	protected:
+		void enqueue(Task task) override;
+
+	private:
+		typedef WorkStealingDeque<Task *> Deque;
+
+		static const size_t MAX_PRODUCERS = 64;
+
+		Deque * ownDeque();
+		Task * findTask(size_t self);
+		void work(size_t index);
+
+		const unsigned m_workerCount;
+		const uint64_t m_id;
+
+		// workers own the first slots, producers are added as they show up
+		std::vector<std::unique_ptr<Deque>> m_deques;
+		std::atomic<size_t> m_dequeCount;
+		std::mutex m_registerMutex;
+
+		// an overflow for producers beyond MAX_PRODUCERS
+		std::deque<Task *> m_shared;
+		std::mutex m_sharedMutex;
+		std::atomic<size_t> m_sharedSize;
+
+		std::atomic<bool> m_stopping;
+		std::atomic<unsigned> m_sleeping;
+		std::mutex m_parkMutex;
+		std::condition_variable m_wake;
+		std::vector<std::thread> m_workers;
+	};
+
+	unsigned defaultWorkerCount();
+
+	std::unique_ptr<Executor> makeExecutor(ExecutorKind kind, unsigned workers,
+										   size_t capacity, Backpressure policy);
+}
+
+#endif
@@ -3,6 +3,7 @@
 
 #include <ostream>
 #include <functional>
+#include <new>
 
 struct Error
 {
@@ -10,7 +11,7 @@ struct Error
 	std::string message;
 
 public:
-	Error(int _code, std::string & _msg): 
+	Error(int _code, const std::string & _msg): 
 		code(_code), message(_msg) {}
 
 	Error(const std::string & _msg):
@@ -37,14 +38,15 @@ private:
 public:
 	ResultOrError();
 
+	// only one of the union members is alive, it has to be constructed in place
 	ResultOrError(const ResultOrError & res):
 		m_success(res.m_success)
 	{
 		if (res.m_success) {
-			m_successValue = res.m_successValue;
+			new (&m_successValue) ST(res.m_successValue);
 		}
 		else {
-			m_failValue = res.m_failValue;
+			new (&m_failValue) Error(res.m_failValue);
 		}
 	}
 
@@ -54,7 +56,14 @@ public:
 	ResultOrError(const Error & err):
 		m_success(false), m_failValue(err) {}
 
-	~ResultOrError() {}
+	~ResultOrError() {
+		if (m_success) {
+			m_successValue.~ST();
+		}
+		else {
+			m_failValue.~Error();
+		}
+	}
 	
 	template <typename T>
 	static ResultOrError<ST> succeed(const T & arg) {
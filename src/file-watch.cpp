@@ -0,0 +1,761 @@
+#include <sys/inotify.h>
+#include <sys/epoll.h>
+#include <sys/vfs.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include <boost/filesystem.hpp>
+
+#include "file-watch.h"
+
+using namespace watchers;
+using namespace std::chrono;
+using namespace boost;
+
+const uint32_t WATCH_MASK = IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO;
+const seconds POLL_INTERVAL(5);
+
+std::string
+watchers::describe(WatchEventType type)
+{
+	switch (type) {
+		case CREATED: return "created";
+		case MODIFIED: return "modified";
+		case CLOSED_WRITE: return "written";
+		case MOVED: return "moved in";
+	}
+
+	return "changed";
+}
+
+std::string
+watchers::eventName(WatchEventType type)
+{
+	switch (type) {
+		case CREATED: return "created";
+		case MODIFIED: return "modified";
+		case CLOSED_WRITE: return "closed_write";
+		case MOVED: return "moved";
+	}
+
+	return "changed";
+}
+
+bool
+matchGlob(const char * pattern, const char * path)
+{
+	while (*pattern != '\0') {
+		if (pattern[0] == '*' && pattern[1] == '*') {
+			const char * rest = pattern + 2;
+
+			// "**/" also stands for no directory at all
+			if (*rest == '/' && matchGlob(rest + 1, path))
+				return true;
+
+			for (const char * position = path; ; position++) {
+				if (matchGlob(rest, position))
+					return true;
+				if (*position == '\0')
+					return false;
+			}
+		}
+
+		if (*pattern == '*') {
+			for (const char * position = path; ; position++) {
+				if (matchGlob(pattern + 1, position))
+					return true;
+				if (*position == '\0' || *position == '/')
+					return false;
+			}
+		}
+
+		if (*pattern == '?') {
+			if (*path == '\0' || *path == '/')
+				return false;
+		}
+		else if (*pattern == '[' && std::strchr(pattern + 1, ']') != nullptr) {
+			if (*path == '\0' || *path == '/')
+				return false;
+
+			const char * position = pattern + 1;
+			bool negated = *position == '!' || *position == '^';
+			if (negated)
+				position++;
+
+			bool matched = false;
+			// a ']' right after the opening bracket is part of the class
+			do {
+				if (position[1] == '-' && position[2] != ']' && position[2] != '\0') {
+					matched |= *path >= position[0] && *path <= position[2];
+					position += 3;
+				}
+				else {
+					matched |= *path == *position;
+					position++;
+				}
+			} while (*position != ']' && *position != '\0');
+
+			if (*position == '\0' || matched == negated)
+				return false;
+
+			pattern = position;
+		}
+		else if (*pattern != *path) {
+			return false;
+		}
+
+		pattern++;
+		path++;
+	}
+
+	return *path == '\0';
+}
+
+bool
+watchers::globMatch(const std::string & pattern, const std::string & path)
+{
+	return matchGlob(pattern.c_str(), path.c_str());
+}
+
+bool
+watchers::isGlob(const std::string & path)
+{
+	return path.find_first_of("*?[") != std::string::npos;
+}
+
+std::pair<std::string, std::string>
+watchers::splitGlob(const std::string & glob)
+{
+	size_t wildcard = glob.find_first_of("*?[");
+	if (wildcard == std::string::npos)
+		return { glob, "" };
+
+	size_t slash = glob.rfind('/', wildcard);
+	if (slash == std::string::npos)
+		return { ".", glob };
+
+	return { slash == 0 ? "/" : glob.substr(0, slash), glob.substr(slash + 1) };
+}
+
+/*
+ * inotify only sees changes made through the local kernel, which on
+ * network and FUSE file systems is only a part of them.
+ */
+bool
+inotifySupported(const std::string & directory)
+{
+	struct statfs info;
+	if (statfs(directory.c_str(), &info) != 0)
+		return false;
+
+	switch (info.f_type) {
+		case 0x6969:     // NFS
+		case 0x517B:     // SMB
+		case 0xFF534D42: // CIFS
+		case 0xFE534D42: // SMB2
+		case 0x65735546: // FUSE
+		case 0x73757245: // CODA
+		case 0x5346414F: // AFS
+		case 0x01021997: // 9P
+		case 0x00C36400: // CEPH
+			return false;
+	}
+
+	return true;
+}
+
+WatchEventType
+eventType(uint32_t mask)
+{
+	if (mask & IN_CREATE)
+		return CREATED;
+	else if (mask & IN_MOVED_TO)
+		return MOVED;
+	else if (mask & IN_CLOSE_WRITE)
+		return CLOSED_WRITE;
+
+	return MODIFIED;
+}
+
+/*
+ * Spellings of the same path (relative, through symlinks, with "." 
+ * and ".." in them) all map to one key. A path which doesn't exist 
+ * yet is resolved through its parent, if that exists.
+ */
+std::string
+watchers::canonicalPath(const std::string & path)
+{
+	system::error_code error;
+	std::string trimmed = path;
+
+	while (trimmed.size() > 1 && trimmed.back() == '/')
+		trimmed.pop_back();
+
+	filesystem::path absolute = filesystem::absolute(trimmed);
+
+	filesystem::path canonical = filesystem::canonical(absolute, error);
+	if (!error)
+		return canonical.string();
+
+	filesystem::path parent = filesystem::canonical(absolute.parent_path(), error);
+	if (!error)
+		return (parent / absolute.filename()).string();
+
+	return absolute.lexically_normal().string();
+}
+
+FileWatcher::FileWatcher(scheduling::EventLoop & loop, scheduling::TimerQueue & timers):
+	m_loop(loop), m_timers(timers), m_inotify(inotify_init1(IN_NONBLOCK | IN_CLOEXEC)), m_nextId(1)
+{
+	if (m_inotify >= 0 && !m_loop.add(m_inotify, EPOLLIN, [this](uint32_t) { readEvents(); })) {
+		close(m_inotify);
+		m_inotify = -1;
+	}
+}
+
+FileWatcher::~FileWatcher()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	for (const auto & watched : m_paths) {
+		if (watched.second->wd < 0)
+			m_timers.cancel(watched.second->timer);
+	}
+
+	for (const auto & tree : m_trees) {
+		if (tree.second->polled)
+			m_timers.cancel(tree.second->timer);
+	}
+
+	if (m_inotify >= 0) {
+		m_loop.remove(m_inotify);
+		close(m_inotify);
+	}
+}
+
+WatchId
+FileWatcher::watch(const std::string & path, WatchCallback callback)
+{
+	std::string canonical = canonicalPath(path);
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	WatchId id = m_nextId++;
+	m_watchIds[id] = canonical;
+
+	auto pathIter = m_paths.find(canonical);
+	if (pathIter != m_paths.end()) {
+		pathIter->second->subscribers.push_back(Subscriber { id, callback });
+		return id;
+	}
+
+	std::shared_ptr<WatchedPath> watched = std::make_shared<WatchedPath>();
+	watched->path = canonical;
+	watched->subscribers.push_back(Subscriber { id, callback });
+	watched->wd = -1;
+	m_paths[canonical] = watched;
+
+	if (!watchWithInotify(watched))
+		watchWithPolling(watched);
+
+	return id;
+}
+
+WatchId
+FileWatcher::watchTree(const std::string & root, const std::string & pattern, WatchCallback callback)
+{
+	std::string canonical = canonicalPath(root);
+	std::string key = canonical + '\n' + pattern;
+
+	// a pattern without '**' can only reach as deep as its own components
+	int maxDepth = -1;
+	if (!pattern.empty() && pattern.find("**") == std::string::npos)
+		maxDepth = std::count(pattern.begin(), pattern.end(), '/');
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	WatchId id = m_nextId++;
+	m_watchIds[id] = key;
+
+	auto treeIter = m_trees.find(key);
+	if (treeIter != m_trees.end()) {
+		treeIter->second->subscribers.push_back(Subscriber { id, callback });
+		return id;
+	}
+
+	std::shared_ptr<WatchedTree> tree = std::make_shared<WatchedTree>();
+	tree->key = key;
+	tree->root = canonical;
+	tree->pattern = pattern;
+	tree->maxDepth = maxDepth;
+	tree->subscribers.push_back(Subscriber { id, callback });
+	tree->polled = false;
+	m_trees[key] = tree;
+
+	// whatever is in the tree already isn't reported
+	FiredEvents ignored;
+	if (!watchTreeWithInotify(tree, ignored))
+		watchTreeWithPolling(tree);
+
+	return id;
+}
+
+void
+FileWatcher::unwatch(WatchId id)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	auto idIter = m_watchIds.find(id);
+	if (idIter == m_watchIds.end())
+		return;
+
+	auto pathIter = m_paths.find(idIter->second);
+	auto treeIter = m_trees.find(idIter->second);
+	m_watchIds.erase(idIter);
+
+	if (treeIter != m_trees.end()) {
+		std::shared_ptr<WatchedTree> tree = treeIter->second;
+		std::vector<Subscriber> & subscribers = tree->subscribers;
+
+		subscribers.erase(std::remove_if(subscribers.begin(), subscribers.end(), 
+			[id](const Subscriber & subscriber) { return subscriber.id == id; }), 
+			subscribers.end());
+
+		if (!subscribers.empty())
+			return;
+
+		if (tree->polled)
+			m_timers.cancel(tree->timer);
+		else
+			detachTree(tree);
+
+		m_trees.erase(treeIter);
+		return;
+	}
+
+	if (pathIter == m_paths.end())
+		return;
+
+	std::shared_ptr<WatchedPath> watched = pathIter->second;
+	std::vector<Subscriber> & subscribers = watched->subscribers;
+
+	subscribers.erase(std::remove_if(subscribers.begin(), subscribers.end(), 
+		[id](const Subscriber & subscriber) { return subscriber.id == id; }), 
+		subscribers.end());
+
+	if (!subscribers.empty())
+		return;
+
+	// the path goes with its last subscriber, and the directory with its last path
+	if (watched->wd >= 0) {
+		auto directoryIter = m_directories.find(watched->wd);
+		if (directoryIter != m_directories.end()) {
+			directoryIter->second.entries.erase(watched->entryName);
+			releaseDirectory(watched->wd);
+		}
+	}
+	else {
+		m_timers.cancel(watched->timer);
+	}
+
+	m_paths.erase(pathIter);
+}
+
+size_t
+FileWatcher::size()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_paths.size() + m_trees.size();
+}
+
+bool
+FileWatcher::watchWithInotify(std::shared_ptr<WatchedPath> watched)
+{
+	if (m_inotify < 0)
+		return false;
+
+	system::error_code error;
+	filesystem::path target(watched->path);
+	std::string directory, name;
+
+	if (filesystem::is_directory(target, error)) {
+		directory = target.string();
+	}
+	else {
+		directory = target.parent_path().string();
+		name = target.filename().string();
+	}
+
+	if (!inotifySupported(directory))
+		return false;
+
+	// the kernel returns the same descriptor for a directory which is already watched
+	int wd = inotify_add_watch(m_inotify, directory.c_str(), WATCH_MASK);
+	if (wd < 0)
+		return false;
+
+	WatchedDirectory & watchedDirectory = m_directories[wd];
+	watchedDirectory.path = directory;
+	watchedDirectory.entries[name] = watched;
+
+	watched->entryName = name;
+	watched->wd = wd;
+
+	return true;
+}
+
+void
+FileWatcher::watchWithPolling(std::shared_ptr<WatchedPath> watched)
+{
+	system::error_code error;
+
+	watched->wd = -1;
+	watched->existed = filesystem::exists(watched->path, error);
+	watched->lastModified = watched->existed ? filesystem::last_write_time(watched->path, error) : 0;
+
+	armPoll(watched);
+}
+
+void
+FileWatcher::armPoll(std::shared_ptr<WatchedPath> watched)
+{
+	watched->timer = m_timers.scheduleAfter(POLL_INTERVAL, [this, watched]() {
+		poll(watched);
+	});
+}
+
+void
+FileWatcher::poll(std::shared_ptr<WatchedPath> watched)
+{
+	system::error_code error;
+	std::vector<WatchEvent> events;
+
+	bool exists = filesystem::exists(watched->path, error);
+
+	if (exists) {
+		std::time_t lastModified = filesystem::last_write_time(watched->path, error);
+
+		// created or modified during the interval
+		if (!watched->existed)
+			events.push_back(WatchEvent { watched->path, CREATED });
+		else if (lastModified != watched->lastModified)
+			events.push_back(WatchEvent { watched->path, MODIFIED });
+
+		watched->lastModified = lastModified;
+	}
+
+	watched->existed = exists;
+
+	FiredEvents fired;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		auto pathIter = m_paths.find(watched->path);
+		if (pathIter == m_paths.end() || pathIter->second != watched)
+			return;
+
+		// a directory which was missing might be back, inotify can take over again
+		if (!watchWithInotify(watched))
+			armPoll(watched);
+
+		for (const auto & event : events)
+			notify(watched->subscribers, event, fired);
+	}
+
+	for (const auto & entry : fired)
+		entry.first(entry.second);
+}
+
+void
+FileWatcher::notify(const std::vector<Subscriber> & subscribers, const WatchEvent & event, 
+					 FiredEvents & fired)
+{
+	for (const auto & subscriber : subscribers)
+		fired.push_back({ subscriber.callback, event });
+}
+
+void
+FileWatcher::notifyTree(const WatchedTree & tree, const WatchEvent & event, FiredEvents & fired)
+{
+	if (event.path.size() <= tree.root.size())
+		return;
+
+	// patterns are matched against the path under the root
+	std::string relative = event.path.substr(tree.root.size() == 1 ? 1 : tree.root.size() + 1);
+
+	if (tree.pattern.empty() || globMatch(tree.pattern, relative))
+		notify(tree.subscribers, event, fired);
+}
+
+bool
+FileWatcher::watchTreeWithInotify(std::shared_ptr<WatchedTree> tree, FiredEvents & fired)
+{
+	if (m_inotify < 0)
+		return false;
+
+	system::error_code error;
+	if (!filesystem::is_directory(tree->root, error) || !inotifySupported(tree->root))
+		return false;
+
+	if (!addTreeDirectory(tree, tree->root, 0, false, fired))
+		return false;
+
+	tree->polled = false;
+	tree->snapshot.clear();
+
+	return true;
+}
+
+/*
+ * Watches a directory of the tree, then whatever directories under
+ * it the tree reaches. A directory which was just created might have
+ * been filled before its watch was in place, so reportContents makes
+ * whatever is already in it count as created.
+ */
+bool
+FileWatcher::addTreeDirectory(std::shared_ptr<WatchedTree> tree, const std::string & directory, 
+							  int depth, bool reportContents, FiredEvents & fired)
+{
+	int wd = inotify_add_watch(m_inotify, directory.c_str(), WATCH_MASK);
+	if (wd < 0)
+		return false;
+
+	WatchedDirectory & watchedDirectory = m_directories[wd];
+	watchedDirectory.path = directory;
+
+	for (const auto & membership : watchedDirectory.trees) {
+		if (membership.tree == tree)
+			return true;
+	}
+
+	watchedDirectory.trees.push_back(TreeMembership { tree, depth });
+	tree->descriptors.push_back(wd);
+
+	system::error_code error;
+	filesystem::directory_iterator iter(directory, error), end;
+
+	for (; !error && iter != end; iter.increment(error)) {
+		std::string path = iter->path().string();
+
+		if (reportContents)
+			notifyTree(*tree, WatchEvent { path, CREATED }, fired);
+
+		// symbolic links aren't followed, they could lead back up the tree
+		bool isDirectory = filesystem::is_directory(iter->symlink_status(error));
+		if (isDirectory && (tree->maxDepth < 0 || depth < tree->maxDepth))
+			addTreeDirectory(tree, path, depth + 1, reportContents, fired);
+	}
+
+	return true;
+}
+
+void
+FileWatcher::detachTree(std::shared_ptr<WatchedTree> tree)
+{
+	for (int wd : tree->descriptors) {
+		auto directoryIter = m_directories.find(wd);
+		if (directoryIter == m_directories.end())
+			continue;
+
+		std::vector<TreeMembership> & trees = directoryIter->second.trees;
+		trees.erase(std::remove_if(trees.begin(), trees.end(), 
+			[&tree](const TreeMembership & membership) { return membership.tree == tree; }),
+			trees.end());
+
+		releaseDirectory(wd);
+	}
+
+	tree->descriptors.clear();
+}
+
+void
+FileWatcher::releaseDirectory(int wd)
+{
+	auto directoryIter = m_directories.find(wd);
+	if (directoryIter == m_directories.end())
+		return;
+
+	if (directoryIter->second.entries.empty() && directoryIter->second.trees.empty()) {
+		inotify_rm_watch(m_inotify, wd);
+		m_directories.erase(directoryIter);
+	}
+}
+
+void
+FileWatcher::watchTreeWithPolling(std::shared_ptr<WatchedTree> tree)
+{
+	tree->polled = true;
+	tree->snapshot = scanTree(*tree);
+	armTreePoll(tree);
+}
+
+void
+FileWatcher::armTreePoll(std::shared_ptr<WatchedTree> tree)
+{
+	tree->timer = m_timers.scheduleAfter(POLL_INTERVAL, [this, tree]() {
+		pollTree(tree);
+	});
+}
+
+void
+FileWatcher::pollTree(std::shared_ptr<WatchedTree> tree)
+{
+	std::map<std::string, std::time_t> current = scanTree(*tree);
+	FiredEvents fired;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		auto treeIter = m_trees.find(tree->key);
+		if (treeIter == m_trees.end() || treeIter->second != tree)
+			return;
+
+		for (const auto & entry : current) {
+			auto previous = tree->snapshot.find(entry.first);
+
+			if (previous == tree->snapshot.end())
+				notify(tree->subscribers, WatchEvent { entry.first, CREATED }, fired);
+			else if (previous->second != entry.second)
+				notify(tree->subscribers, WatchEvent { entry.first, MODIFIED }, fired);
+		}
+
+		tree->snapshot = std::move(current);
+
+		if (!watchTreeWithInotify(tree, fired))
+			armTreePoll(tree);
+	}
+
+	for (const auto & entry : fired)
+		entry.first(entry.second);
+}
+
+/* The modification times of whatever the tree's pattern matches */
+std::map<std::string, std::time_t>
+FileWatcher::scanTree(const WatchedTree & tree)
+{
+	std::map<std::string, std::time_t> snapshot;
+	system::error_code error;
+
+	std::vector<std::pair<std::string, int>> directories = { { tree.root, 0 } };
+
+	while (!directories.empty()) {
+		std::pair<std::string, int> directory = directories.back();
+		directories.pop_back();
+
+		filesystem::directory_iterator iter(directory.first, error), end;
+
+		for (; !error && iter != end; iter.increment(error)) {
+			std::string path = iter->path().string();
+			std::string relative = path.substr(tree.root.size() == 1 ? 1 : tree.root.size() + 1);
+
+			if (tree.pattern.empty() || globMatch(tree.pattern, relative))
+				snapshot[path] = filesystem::last_write_time(iter->path(), error);
+
+			bool isDirectory = filesystem::is_directory(iter->symlink_status(error));
+			if (isDirectory && (tree.maxDepth < 0 || directory.second < tree.maxDepth))
+				directories.push_back({ path, directory.second + 1 });
+		}
+	}
+
+	return snapshot;
+}
+
+void
+FileWatcher::readEvents()
+{
+	alignas(inotify_event) char buffer[64 * 1024];
+	FiredEvents fired;
+
+	while (1) {
+		ssize_t length = read(m_inotify, buffer, sizeof(buffer));
+		if (length <= 0)
+			break;
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+
+		for (char * position = buffer; position < buffer + length; ) {
+			const inotify_event * event = reinterpret_cast<const inotify_event *>(position);
+			position += sizeof(inotify_event) + event->len;
+
+			// events were lost, so anything could have changed
+			if (event->mask & IN_Q_OVERFLOW) {
+				for (const auto & watched : m_paths) {
+					if (watched.second->wd >= 0)
+						notify(watched.second->subscribers, WatchEvent { watched.first, MODIFIED }, fired);
+				}
+
+				for (const auto & tree : m_trees) {
+					if (!tree.second->polled)
+						notify(tree.second->subscribers, WatchEvent { tree.second->root, MODIFIED }, fired);
+				}
+				continue;
+			}
+
+			auto directoryIter = m_directories.find(event->wd);
+			if (directoryIter == m_directories.end())
+				continue;
+
+			WatchedDirectory & directory = directoryIter->second;
+
+			// the directory is gone, polling will notice when it comes back
+			if (event->mask & IN_IGNORED) {
+				for (const auto & entry : directory.entries)
+					watchWithPolling(entry.second);
+
+				// the directories under a removed root go with it, so the whole tree is polled
+				for (const auto & membership : directory.trees) {
+					std::shared_ptr<WatchedTree> tree = membership.tree;
+					auto & descriptors = tree->descriptors;
+					descriptors.erase(std::remove(descriptors.begin(), descriptors.end(), event->wd), 
+									  descriptors.end());
+
+					if (directory.path == tree->root) {
+						detachTree(tree);
+						watchTreeWithPolling(tree);
+					}
+				}
+
+				m_directories.erase(directoryIter);
+				continue;
+			}
+
+			std::string name = event->len > 0 ? event->name : "";
+			WatchEventType type = eventType(event->mask);
+			std::string path = name.empty() ? directory.path : directory.path + "/" + name;
+
+			// whoever watches the file itself, then whoever watches the whole directory
+			if (!name.empty()) {
+				auto entryIter = directory.entries.find(name);
+				if (entryIter != directory.entries.end())
+					notify(entryIter->second->subscribers, WatchEvent { path, type }, fired);
+			}
+
+			auto directoryEntryIter = directory.entries.find("");
+			if (directoryEntryIter != directory.entries.end())
+				notify(directoryEntryIter->second->subscribers, WatchEvent { path, type }, fired);
+
+			if (name.empty() || directory.trees.empty())
+				continue;
+
+			// watching a new subdirectory adds to the memberships being walked
+			bool newDirectory = (event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO));
+			std::vector<TreeMembership> trees = directory.trees;
+
+			for (const auto & membership : trees) {
+				const WatchedTree & tree = *membership.tree;
+				notifyTree(tree, WatchEvent { path, type }, fired);
+
+				if (newDirectory && (tree.maxDepth < 0 || membership.depth < tree.maxDepth))
+					addTreeDirectory(membership.tree, path, membership.depth + 1, true, fired);
+			}
+		}
+
+		lock.unlock();
+
+		for (const auto & entry : fired)
+			entry.first(entry.second);
+		fired.clear();
+	}
+}
@@ -0,0 +1,166 @@
+#ifndef FILEWATCH_H
+#define FILEWATCH_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include <map>
+#include <utility>
+#include <memory>
+#include <mutex>
+#include <ctime>
+#include <cstdint>
+
+#include "event-loop.h"
+#include "timer-queue.h"
+
+namespace watchers
+{
+	enum WatchEventType
+	{
+		CREATED,
+		MODIFIED,
+		CLOSED_WRITE,
+		MOVED
+	};
+
+	struct WatchEvent
+	{
+		std::string path;
+		WatchEventType type;
+	};
+
+	typedef std::function<void(const WatchEvent &)> WatchCallback;
+	typedef uint64_t WatchId;
+
+	std::string describe(WatchEventType type);
+
+	/* The name a statement sees in AUTOMANIAC_EVENT_TYPE */
+	std::string eventName(WatchEventType type);
+
+	/*
+	 * Watches paths through a single inotify instance read on the
+	 * event loop. A file is watched through its parent directory so
+	 * it can be created, deleted and renamed over. Paths on file 
+	 * systems where inotify can't see every change (network and FUSE
+	 * mounts), or which inotify refuses, are polled every 5 seconds 
+	 * off the timer queue instead.
+	 *
+	 * Watches are shared by canonical path: however many jobs watch 
+	 * a path, it takes one kernel watch (or one poll) and each event 
+	 * is looked up once and fanned out to every subscriber. Directory
+	 * watches are shared the same way, by inode, since that's what 
+	 * the kernel hands out watch descriptors by.
+	 *
+	 * A tree watch covers every directory under a root, optionally 
+	 * only reporting paths (relative to the root) which match a glob 
+	 * pattern. Directories are watched as deep as the pattern can 
+	 * reach, and ones created later are picked up as they show up.
+	 */
+	class FileWatcher
+	{
+	public:
+		FileWatcher(scheduling::EventLoop & loop, scheduling::TimerQueue & timers);
+		~FileWatcher();
+
+		WatchId watch(const std::string & path, WatchCallback callback);
+		WatchId watchTree(const std::string & root, const std::string & pattern, WatchCallback callback);
+		void unwatch(WatchId id);
+
+		/* The number of distinct paths and trees being watched */
+		size_t size();
+
+	private:
+		struct Subscriber
+		{
+			WatchId id;
+			WatchCallback callback;
+		};
+
+		struct WatchedPath
+		{
+			std::string path;
+			std::string entryName; // empty when the directory itself is watched
+			std::vector<Subscriber> subscribers;
+			int wd; // -1 while polled
+
+			bool existed;
+			std::time_t lastModified;
+			scheduling::TimerId timer;
+		};
+
+		struct WatchedTree
+		{
+			std::string key;
+			std::string root;
+			std::string pattern;
+			int maxDepth; // -1 when unlimited
+			std::vector<Subscriber> subscribers;
+			std::vector<int> descriptors;
+
+			// polling stands in while the root is missing or on a remote file system
+			bool polled;
+			std::map<std::string, std::time_t> snapshot;
+			scheduling::TimerId timer;
+		};
+
+		struct TreeMembership
+		{
+			std::shared_ptr<WatchedTree> tree;
+			int depth;
+		};
+
+		struct WatchedDirectory
+		{
+			std::string path;
+			std::unordered_map<std::string, std::shared_ptr<WatchedPath>> entries;
+			std::vector<TreeMembership> trees;
+		};
+
+		typedef std::vector<std::pair<WatchCallback, WatchEvent>> FiredEvents;
+
+		bool watchWithInotify(std::shared_ptr<WatchedPath> watched);
+		void watchWithPolling(std::shared_ptr<WatchedPath> watched);
+		void armPoll(std::shared_ptr<WatchedPath> watched);
+		void poll(std::shared_ptr<WatchedPath> watched);
+		bool watchTreeWithInotify(std::shared_ptr<WatchedTree> tree, FiredEvents & fired);
+		bool addTreeDirectory(std::shared_ptr<WatchedTree> tree, const std::string & directory, 
+							  int depth, bool reportContents, FiredEvents & fired);
+		void watchTreeWithPolling(std::shared_ptr<WatchedTree> tree);
+		void armTreePoll(std::shared_ptr<WatchedTree> tree);
+		void pollTree(std::shared_ptr<WatchedTree> tree);
+		std::map<std::string, std::time_t> scanTree(const WatchedTree & tree);
+		void detachTree(std::shared_ptr<WatchedTree> tree);
+		void releaseDirectory(int wd);
+
+		void readEvents();
+		void notify(const std::vector<Subscriber> & subscribers, const WatchEvent & event, FiredEvents & fired);
+		void notifyTree(const WatchedTree & tree, const WatchEvent & event, FiredEvents & fired);
+
+		scheduling::EventLoop & m_loop;
+		scheduling::TimerQueue & m_timers;
+		int m_inotify;
+		WatchId m_nextId;
+
+		std::unordered_map<std::string, std::shared_ptr<WatchedPath>> m_paths;
+		std::unordered_map<std::string, std::shared_ptr<WatchedTree>> m_trees;
+		std::unordered_map<int, WatchedDirectory> m_directories;
+		std::unordered_map<WatchId, std::string> m_watchIds;
+		std::mutex m_mutex;
+	};
+
+	std::string canonicalPath(const std::string & path);
+
+	/*
+	 * '*', '?' and '[...]' match within one path component, '**' 
+	 * matches across any number of them (including none).
+	 */
+	bool globMatch(const std::string & pattern, const std::string & path);
+	bool isGlob(const std::string & path);
+
+	/* Splits a glob into the directory it's rooted at and the pattern under it */
+	std::pair<std::string, std::string> splitGlob(const std::string & glob);
+}
+
+#endif
@@ -0,0 +1,581 @@
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <climits>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "job-cache.h"
+
+using namespace jobparsers;
+
+const char CACHE_MAGIC[8] = { 'A', 'M', 'J', 'O', 'B', 'S', '\0', '\0' };
+const uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+/* How many jobs are built out of a cache before the part of it they were in is released */
+const uint64_t CACHE_RELEASE_JOBS = 4096;
+
+/*
+ * The layout, in order: the header, the jobs, their statements, the
+ * statements' arguments and the strings all of them point into. Every
+ * record is a multiple of 8 bytes, so each section stays aligned.
+ */
+struct CacheHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t byteOrder;
+	uint32_t jobRecordSize;
+	uint32_t statementRecordSize;
+	uint64_t sourceSize;
+	int64_t sourceMtime;
+	uint64_t sourceHash;
+	uint64_t jobCount;
+	uint64_t statementCount;
+	uint64_t argumentCount;
+	uint64_t stringsSize;
+};
+
+struct StringRef
+{
+	uint32_t offset;
+	uint32_t length;
+};
+
+struct JobRecord
+{
+	StringRef scheduler;
+	StringRef arguments;
+	StringRef name;
+	StringRef outputFile;
+	int64_t debounce;
+	int64_t maxDelay;
+	int64_t outputRotate;
+	int64_t timeout;
+	int64_t killGrace;
+	uint64_t outputMaxSize;
+	uint64_t cpuMax;
+	uint64_t memoryMax;
+	uint64_t pidsMax;
+	uint32_t outputKeep;
+	uint32_t ioWeight;
+	uint32_t concurrency;
+	uint32_t firstStatement;
+	uint32_t statementCount;
+	uint8_t exitOnFail;
+	uint8_t mode;
+	uint8_t overrun;
+	uint8_t recursive;
+	uint8_t overlap;
+	uint8_t padding[7];
+};
+
+struct StatementRecord
+{
+	StringRef runner;
+	int64_t timeout;
+	uint32_t firstArgument;
+	uint32_t argumentCount;
+};
+
+static_assert(sizeof(CacheHeader) % 8 == 0, "the header has to keep the records after it aligned");
+static_assert(sizeof(JobRecord) % 8 == 0, "job records have to stay aligned");
+static_assert(sizeof(StatementRecord) % 8 == 0, "statement records have to stay aligned");
+
+Error
+cacheError(const std::string & what, const std::string & path)
+{
+	int error = errno;
+	return Error(error, "Couldn't " + what + " '" + path + "': " + std::strerror(error));
+}
+
+/* Only a regular file's size and mtime say anything about what's in it */
+ResultOrError<SourceKey>
+statSource(const std::string & path, bool & regular)
+{
+	struct stat info;
+	if (stat(path.c_str(), &info) < 0)
+		return fail(cacheError("stat", path));
+
+	regular = S_ISREG(info.st_mode);
+
+	return succeed(SourceKey {
+		uint64_t(info.st_size),
+		int64_t(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec,
+		0
+	});
+}
+
+uint64_t
+jobparsers::hashText(StringView text)
+{
+	uint64_t hash = 14695981039346656037ULL;
+
+	for (char c : text) {
+		hash ^= static_cast<unsigned char>(c);
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+std::string
+jobparsers::defaultCachePath(const std::string & jobsFile)
+{
+	std::string directory;
+	const char * cacheHome = std::getenv("XDG_CACHE_HOME");
+	const char * home = std::getenv("HOME");
+
+	if (cacheHome != nullptr && cacheHome[0] == '/')
+		directory = cacheHome;
+	else if (home != nullptr && home[0] != '\0')
+		directory = std::string(home) + "/.cache";
+	else
+		return "";
+
+	char resolved[PATH_MAX];
+	if (realpath(jobsFile.c_str(), resolved) == nullptr)
+		return "";
+
+	// two different files with the same name don't share a cache
+	char name[17];
+	snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hashText(resolved)));
+
+	return directory + "/automaniac/" + name + ".jobs";
+}
+
+/* ---------- */
+
+/* Collects everything a cache holds before it's written out in one go */
+class CacheBuilder
+{
+public:
+	StringRef add(const std::string & text)
+	{
+		StringRef ref { uint32_t(m_strings.size()), uint32_t(text.size()) };
+		m_strings += text;
+		return ref;
+	}
+
+	void addJob(const Job & job)
+	{
+		const JobOptions & options = job.description.options;
+		JobRecord record;
+		std::memset(&record, 0, sizeof(record));
+
+		record.scheduler = add(job.description.scheduler);
+		record.arguments = add(job.description.arguments);
+		record.name = add(options.name);
+		record.outputFile = add(options.outputFile);
+		record.debounce = options.debounce.count();
+		record.maxDelay = options.maxDelay.count();
+		record.outputRotate = options.outputRotate.count();
+		record.timeout = options.timeout.count();
+		record.killGrace = options.killGrace.count();
+		record.outputMaxSize = options.outputMaxSize;
+		record.cpuMax = options.cpuMax;
+		record.memoryMax = options.memoryMax;
+		record.pidsMax = options.pidsMax;
+		record.outputKeep = options.outputKeep;
+		record.ioWeight = options.ioWeight;
+		record.concurrency = options.concurrency;
+		record.firstStatement = m_statements.size();
+		record.statementCount = job.statements.size();
+		record.exitOnFail = options.exitOnFail;
+		record.mode = options.mode;
+		record.overrun = options.overrun;
+		record.recursive = options.recursive;
+		record.overlap = options.overlap;
+		m_jobs.push_back(record);
+
+		for (const auto & statement : job.statements) {
+			StatementRecord statementRecord;
+			std::memset(&statementRecord, 0, sizeof(statementRecord));
+
+			statementRecord.runner = add(statement.runner);
+			statementRecord.timeout = statement.timeout.count();
+			statementRecord.firstArgument = m_arguments.size();
+			statementRecord.argumentCount = statement.arguments.size();
+			m_statements.push_back(statementRecord);
+
+			for (const auto & argument : statement.arguments)
+				m_arguments.push_back(add(argument));
+		}
+	}
+
+	/* String offsets are 32 bits, anything larger can't be cached */
+	bool fits() const
+	{
+		return m_strings.size() <= UINT32_MAX && m_statements.size() <= UINT32_MAX &&
+			   m_arguments.size() <= UINT32_MAX;
+	}
+
+	std::string build(const SourceKey & key) const
+	{
+		CacheHeader header;
+		std::memset(&header, 0, sizeof(header));
+		std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+		header.version = JOB_CACHE_VERSION;
+		header.byteOrder = BYTE_ORDER_MARK;
+		header.jobRecordSize = sizeof(JobRecord);
+		header.statementRecordSize = sizeof(StatementRecord);
+		header.sourceSize = key.size;
+		header.sourceMtime = key.mtime;
+		header.sourceHash = key.hash;
+		header.jobCount = m_jobs.size();
+		header.statementCount = m_statements.size();
+		header.argumentCount = m_arguments.size();
+		header.stringsSize = m_strings.size();
+
+		std::string content;
+		content.reserve(sizeof(header) + m_jobs.size() * sizeof(JobRecord) +
+						m_statements.size() * sizeof(StatementRecord) +
+						m_arguments.size() * sizeof(StringRef) + m_strings.size());
+
+		content.append(reinterpret_cast<const char *>(&header), sizeof(header));
+		content.append(reinterpret_cast<const char *>(m_jobs.data()), m_jobs.size() * sizeof(JobRecord));
+		content.append(reinterpret_cast<const char *>(m_statements.data()),
+					   m_statements.size() * sizeof(StatementRecord));
+		content.append(reinterpret_cast<const char *>(m_arguments.data()), m_arguments.size() * sizeof(StringRef));
+		content.append(m_strings);
+
+		return content;
+	}
+
+private:
+	std::vector<JobRecord> m_jobs;
+	std::vector<StatementRecord> m_statements;
+	std::vector<StringRef> m_arguments;
+	std::string m_strings;
+};
+
+/* Everything in place, and in the order the sections follow each other in */
+struct CacheSections
+{
+	const CacheHeader * header;
+	const JobRecord * jobs;
+	const StatementRecord * statements;
+	const StringRef * arguments;
+	const char * strings;
+};
+
+CacheSections
+sectionsOf(StringView content)
+{
+	const CacheHeader * header = reinterpret_cast<const CacheHeader *>(content.data());
+	const JobRecord * jobs = reinterpret_cast<const JobRecord *>(header + 1);
+	const StatementRecord * statements = reinterpret_cast<const StatementRecord *>(jobs + header->jobCount);
+	const StringRef * arguments = reinterpret_cast<const StringRef *>(statements + header->statementCount);
+	const char * strings = reinterpret_cast<const char *>(arguments + header->argumentCount);
+
+	return CacheSections { header, jobs, statements, arguments, strings };
+}
+
+/* ---------- */
+
+JobCache::JobCache(std::shared_ptr<MappedFile> file):
+	m_file(file), m_key(SourceKey { 0, 0, 0 }) {}
+
+ResultOrError<std::shared_ptr<JobCache>>
+JobCache::open(const std::string & path)
+{
+	auto fileOrError = MappedFile::open(path);
+	if (fileOrError.failed())
+		return fail(fileOrError.getError());
+
+	std::shared_ptr<JobCache> cache(new JobCache(fileOrError.getResult()));
+
+	auto checked = cache->check();
+	if (checked.failed())
+		return fail(Error("'" + path + "' " + checked.getError().message));
+
+	return succeed(cache);
+}
+
+/*
+ * A cache might be cut short by a full disk, or be another version's;
+ * every count and reference is checked against the file's size once,
+ * so that reading the records afterwards can't go past it.
+ */
+ResultOrError<bool>
+JobCache::check()
+{
+	StringView content = m_file->text();
+	if (content.size() < sizeof(CacheHeader))
+		return fail("is too short to be a job cache");
+
+	const CacheHeader * header = reinterpret_cast<const CacheHeader *>(content.data());
+	if (std::memcmp(header->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0)
+		return fail("isn't a job cache");
+
+	if (header->version != JOB_CACHE_VERSION || header->byteOrder != BYTE_ORDER_MARK ||
+		header->jobRecordSize != sizeof(JobRecord) || header->statementRecordSize != sizeof(StatementRecord))
+		return fail("was written by another version");
+
+	// each count is bounded by the size first, the products can't overflow then
+	uint64_t left = content.size() - sizeof(CacheHeader);
+	if (header->jobCount > left / sizeof(JobRecord))
+		return fail("is cut short");
+	left -= header->jobCount * sizeof(JobRecord);
+
+	if (header->statementCount > left / sizeof(StatementRecord))
+		return fail("is cut short");
+	left -= header->statementCount * sizeof(StatementRecord);
+
+	if (header->argumentCount > left / sizeof(StringRef))
+		return fail("is cut short");
+	left -= header->argumentCount * sizeof(StringRef);
+
+	if (header->stringsSize != left)
+		return fail("is cut short");
+
+	CacheSections sections = sectionsOf(content);
+
+	auto validString = [header](const StringRef & ref) {
+		return uint64_t(ref.offset) + ref.length <= header->stringsSize;
+	};
+
+	for (uint64_t i = 0; i < header->jobCount; i++) {
+		const JobRecord & job = sections.jobs[i];
+
+		if (!validString(job.scheduler) || !validString(job.arguments) ||
+			!validString(job.name) || !validString(job.outputFile))
+			return fail("has a string out of place");
+
+		if (uint64_t(job.firstStatement) + job.statementCount > header->statementCount)
+			return fail("has a job with statements out of place");
+
+		if (job.mode > FIXED_DELAY || job.overrun > SKIP || job.overlap > OVERLAP_REPLACE)
+			return fail("has a job with unknown options");
+	}
+
+	for (uint64_t i = 0; i < header->statementCount; i++) {
+		const StatementRecord & statement = sections.statements[i];
+
+		if (!validString(statement.runner) ||
+			uint64_t(statement.firstArgument) + statement.argumentCount > header->argumentCount)
+			return fail("has a statement out of place");
+	}
+
+	for (uint64_t i = 0; i < header->argumentCount; i++) {
+		if (!validString(sections.arguments[i]))
+			return fail("has a string out of place");
+	}
+
+	m_key = SourceKey { header->sourceSize, header->sourceMtime, header->sourceHash };
+
+	// it was all gone through once, the jobs are built from the page cache later
+	m_file->release(0, content.size());
+	return succeed(true);
+}
+
+const SourceKey &
+JobCache::key() const
+{
+	return m_key;
+}
+
+std::vector<Job>
+JobCache::jobs() const
+{
+	CacheSections sections = sectionsOf(m_file->text());
+	const CacheHeader * header = sections.header;
+
+	auto text = [&sections](const StringRef & ref) {
+		return std::string(sections.strings + ref.offset, ref.length);
+	};
+
+	std::vector<Job> jobs;
+	jobs.reserve(header->jobCount);
+
+	// every section is read front to back, what's behind can go as it's built on
+	const char * base = m_file->text().data();
+	auto releaseBehind = [&](const JobRecord & record) {
+		const char * statements = reinterpret_cast<const char *>(sections.statements + record.firstStatement);
+		const char * arguments = record.statementCount > 0 
+				? reinterpret_cast<const char *>(sections.arguments + sections.statements[record.firstStatement].firstArgument)
+				: reinterpret_cast<const char *>(sections.arguments);
+		const char * strings = sections.strings + record.scheduler.offset;
+
+		m_file->release(reinterpret_cast<const char *>(sections.jobs) - base, reinterpret_cast<const char *>(&record) - base);
+		m_file->release(reinterpret_cast<const char *>(sections.statements) - base, statements - base);
+		m_file->release(reinterpret_cast<const char *>(sections.arguments) - base, arguments - base);
+		m_file->release(sections.strings - base, strings - base);
+	};
+
+	for (uint64_t i = 0; i < header->jobCount; i++) {
+		const JobRecord & record = sections.jobs[i];
+		JobOptions options;
+
+		if (i > 0 && i % CACHE_RELEASE_JOBS == 0)
+			releaseBehind(record);
+
+		options.name = text(record.name);
+		options.outputFile = text(record.outputFile);
+		options.exitOnFail = record.exitOnFail;
+		options.mode = RepeatMode(record.mode);
+		options.overrun = OverrunPolicy(record.overrun);
+		options.recursive = record.recursive;
+		options.debounce = timeutil::DurationUnit(record.debounce);
+		options.maxDelay = timeutil::DurationUnit(record.maxDelay);
+		options.outputMaxSize = record.outputMaxSize;
+		options.outputKeep = record.outputKeep;
+		options.outputRotate = timeutil::DurationUnit(record.outputRotate);
+		options.timeout = timeutil::DurationUnit(record.timeout);
+		options.killGrace = timeutil::DurationUnit(record.killGrace);
+		options.cpuMax = record.cpuMax;
+		options.memoryMax = record.memoryMax;
+		options.pidsMax = record.pidsMax;
+		options.ioWeight = record.ioWeight;
+		options.overlap = OverlapPolicy(record.overlap);
+		options.concurrency = record.concurrency;
+
+		jobs.push_back(Job { JobDescription { text(record.scheduler), text(record.arguments), options }, {} });
+
+		std::vector<Statement> & statements = jobs.back().statements;
+		statements.reserve(record.statementCount);
+
+		for (uint32_t s = record.firstStatement; s < record.firstStatement + record.statementCount; s++) {
+			const StatementRecord & statementRecord = sections.statements[s];
+			std::vector<std::string> arguments;
+			arguments.reserve(statementRecord.argumentCount);
+
+			for (uint32_t a = statementRecord.firstArgument;
+				 a < statementRecord.firstArgument + statementRecord.argumentCount; a++)
+				arguments.push_back(text(sections.arguments[a]));
+
+			statements.push_back(Statement {
+				text(statementRecord.runner), std::move(arguments),
+				timeutil::DurationUnit(statementRecord.timeout)
+			});
+		}
+	}
+
+	return jobs;
+}
+
+/* Written next to path first and renamed over it, a reader never sees half a cache */
+ResultOrError<bool>
+JobCache::write(const std::string & path, const SourceKey & key, const std::vector<Job> & jobs)
+{
+	CacheBuilder builder;
+	for (const auto & job : jobs)
+		builder.addJob(job);
+
+	if (!builder.fits())
+		return fail("The jobs are too large to be cached");
+
+	size_t slash = path.rfind('/');
+	if (slash != std::string::npos && slash > 0) {
+		// the cache directory itself and the one above it, nothing deeper is ever made
+		std::string directory = path.substr(0, slash);
+		size_t parentSlash = directory.rfind('/');
+		if (parentSlash != std::string::npos && parentSlash > 0)
+			mkdir(directory.substr(0, parentSlash).c_str(), 0700);
+
+		if (mkdir(directory.c_str(), 0700) < 0 && errno != EEXIST)
+			return fail(cacheError("create", directory));
+	}
+
+	std::string content = builder.build(key);
+	std::string temporary = path + ".tmp." + std::to_string(getpid());
+
+	int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd < 0)
+		return fail(cacheError("create", temporary));
+
+	size_t written = 0;
+	while (written < content.size()) {
+		ssize_t count = ::write(fd, content.data() + written, content.size() - written);
+		if (count < 0 && errno == EINTR)
+			continue;
+
+		if (count < 0) {
+			Error error = cacheError("write", temporary);
+			close(fd);
+			unlink(temporary.c_str());
+			return fail(error);
+		}
+
+		written += count;
+	}
+
+	close(fd);
+
+	if (rename(temporary.c_str(), path.c_str()) < 0) {
+		Error error = cacheError("rename", temporary);
+		unlink(temporary.c_str());
+		return fail(error);
+	}
+
+	return succeed(true);
+}
+
+/* ---------- */
+
+ResultOrError<std::shared_ptr<LoadedJobs>>
+jobparsers::loadJobFile(const std::string & path, const std::string & givenCachePath, unsigned workers)
+{
+	auto loaded = std::make_shared<LoadedJobs>();
+	loaded->fromCache = false;
+
+	bool regular;
+	auto keyOrError = statSource(path, regular);
+	if (keyOrError.failed())
+		return fail(keyOrError.getError());
+
+	SourceKey key = keyOrError.getResult();
+	const std::string cachePath = regular ? givenCachePath : "";
+
+	// a stale cache is just parsed over, it's rebuilt afterwards anyway
+	std::shared_ptr<JobCache> cache;
+	if (!cachePath.empty()) {
+		JobCache::open(cachePath)
+			.onSuccess([&cache](const std::shared_ptr<JobCache> & opened) {
+				cache = opened;
+			});
+	}
+
+	if (cache != nullptr && cache->key().size == key.size && cache->key().mtime == key.mtime) {
+		loaded->parsed.jobs = cache->jobs();
+		loaded->fromCache = true;
+		return succeed(loaded);
+	}
+
+	auto fileOrError = MappedFile::open(path);
+	if (fileOrError.failed())
+		return fail(fileOrError.getError());
+
+	std::shared_ptr<MappedFile> file = fileOrError.getResult();
+	if (!cachePath.empty())
+		key.hash = hashText(file->text());
+
+	// only touched, what's in it is the same; the new mtime is kept so it isn't hashed every time
+	if (cache != nullptr && cache->key().size == key.size && cache->key().hash == key.hash) {
+		loaded->parsed.jobs = cache->jobs();
+		loaded->fromCache = true;
+		cache.reset();
+
+		JobCache::write(cachePath, key, loaded->parsed.jobs)
+			.onFailure([&loaded](const Error & err) {
+				loaded->cacheProblem = err.message;
+			});
+
+		return succeed(loaded);
+	}
+
+	cache.reset();
+	loaded->parsed = parseJobFile(*file, workers);
+	file.reset();
+
+	if (!cachePath.empty() && loaded->parsed.errors.empty()) {
+		JobCache::write(cachePath, key, loaded->parsed.jobs)
+			.onFailure([&loaded](const Error & err) {
+				loaded->cacheProblem = err.message;
+			});
+	}
+
+	return succeed(loaded);
+}
@@ -0,0 +1,77 @@
+#ifndef JOB_CACHE_H
+#define JOB_CACHE_H
+
+#include <string>
+#include <memory>
+#include <cstdint>
+
+#include "failure.hpp"
+#include "jobs.h"
+#include "mapped-file.h"
+
+namespace jobparsers
+{
+	/* Bumped whenever the layout below or what Job holds changes; any other version is rebuilt */
+	const uint32_t JOB_CACHE_VERSION = 2;
+
+	/* The job file a cache was built from, as it was then */
+	struct SourceKey
+	{
+		uint64_t size;
+		int64_t mtime; // nanoseconds
+		uint64_t hash; // FNV-1a of the whole text, zero until it's needed
+	};
+
+	/* The jobs of a job file, and where they came from */
+	struct LoadedJobs
+	{
+		ParsedJobs parsed;
+		bool fromCache;
+		std::string cacheProblem; // why the cache couldn't be written, empty if it could or wasn't needed
+	};
+
+	uint64_t hashText(StringView text);
+
+	/* Under $XDG_CACHE_HOME (or ~/.cache) by the job file's real path; empty if there's no such place */
+	std::string defaultCachePath(const std::string & jobsFile);
+
+	/*
+	 * A parsed job file written out as flat records and a string table,
+	 * all fixed-width and aligned, so that a mapping of it can be read
+	 * as it is. Nothing is parsed again: opening it bounds-checks every
+	 * job, statement and argument record once against the mapping,
+	 * and loading is then no more than building each Job from views
+	 * into it.
+	 */
+	class JobCache
+	{
+	public:
+		/* Fails if the file isn't a cache of this version or doesn't hang together */
+		static ResultOrError<std::shared_ptr<JobCache>> open(const std::string & path);
+
+		static ResultOrError<bool> write(const std::string & path, const SourceKey & key, const std::vector<Job> & jobs);
+
+		const SourceKey & key() const;
+		std::vector<Job> jobs() const;
+
+	private:
+		JobCache(std::shared_ptr<MappedFile> file);
+
+		ResultOrError<bool> check();
+
+		std::shared_ptr<MappedFile> m_file;
+		SourceKey m_key;
+	};
+
+	/*
+	 * The jobs in path: from the cache at cachePath if it was built from
+	 * path as it is now, which only takes a stat() when its size and
+	 * mtime haven't changed, or a hash when only the mtime has; parsed
+	 * otherwise, and cached again if they parsed without errors. An
+	 * empty cachePath parses every time.
+	 */
+	ResultOrError<std::shared_ptr<LoadedJobs>> loadJobFile(const std::string & path, const std::string & cachePath,
+														   unsigned workers = 1);
+}
+
+#endif
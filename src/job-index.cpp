@@ -0,0 +1,248 @@
+#include <algorithm>
+#include <iterator>
+#include <unordered_set>
+#include <cstdio>
+
+#include "job-index.h"
+#include "job-cache.h"
+
+using namespace jobparsers;
+
+/* A job's description line and its statements, or whatever comes before the first job */
+struct JobBlock
+{
+	StringView text;
+	unsigned firstLine;
+	bool preamble; // blank lines and comments, unless the file is wrong
+};
+
+std::vector<JobBlock>
+splitJobBlocks(StringView text)
+{
+	std::vector<JobBlock> blocks;
+	size_t start = nextJobBoundary(text, 0);
+	unsigned firstLine = 1 + std::count(text.begin(), text.begin() + start, '\n');
+
+	if (start > 0)
+		blocks.push_back(JobBlock { text.substr(0, start), 1, true });
+
+	while (start < text.size()) {
+		size_t end = nextJobBoundary(text, start + 1);
+		blocks.push_back(JobBlock { text.substr(start, end - start), firstLine, false });
+
+		firstLine += std::count(text.begin() + start, text.begin() + end, '\n');
+		start = end;
+	}
+
+	return blocks;
+}
+
+/* Up to the end of its first line, without the blanks it ends with */
+StringView
+descriptionLine(StringView block)
+{
+	StringView line = block.substr(0, block.find('\n'));
+	size_t last = line.find_last_not_of(" \t\r");
+
+	return last == StringView::npos ? StringView() : line.substr(0, last + 1);
+}
+
+std::string
+jobparsers::jobIdentity(const std::string & name, StringView descriptionLine, unsigned occurrence)
+{
+	char hash[17];
+	snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(hashText(descriptionLine)));
+
+	std::string identity = name + "@" + hash;
+	if (occurrence > 1)
+		identity += "#" + std::to_string(occurrence);
+
+	return identity;
+}
+
+/* Counts each name and description so that the same job twice gets two identities */
+class IdentityCounter
+{
+public:
+	std::string identify(const Job & job, StringView block)
+	{
+		std::string identity = jobIdentity(job.description.options.name, descriptionLine(block));
+		unsigned occurrence = ++m_seen[identity];
+
+		return occurrence == 1 ? identity : jobIdentity(job.description.options.name, descriptionLine(block), occurrence);
+	}
+
+private:
+	std::unordered_map<std::string, unsigned> m_seen;
+};
+
+bool
+JobIndex::adopt(StringView text, const std::vector<Job> & jobs, IndexedJobs & adopted)
+{
+	std::vector<JobBlock> blocks = splitJobBlocks(text);
+	std::unordered_map<uint64_t, std::vector<Job>> known;
+	IdentityCounter counter;
+
+	adopted = IndexedJobs();
+	adopted.parsedBlocks = 0;
+	adopted.jobs.reserve(jobs.size());
+
+	size_t next = 0;
+	for (const auto & block : blocks) {
+		if (block.preamble) {
+			known[hashText(block.text)];
+			continue;
+		}
+
+		std::vector<Job> blockJobs;
+		size_t match = jobs.size();
+
+		// jobs gone from the file since, or changed in it, are passed over
+		auto description = parseDescription(descriptionLine(block.text), block.firstLine);
+		if (description.succeeded()) {
+			for (match = next; match < jobs.size(); match++) {
+				if (sameDescription(description.getResult(), jobs.at(match).description))
+					break;
+			}
+		}
+
+		if (match < jobs.size()) {
+			blockJobs = { jobs.at(match) };
+			next = match + 1;
+		}
+		else {
+			ParsedJobs parsed = parseJobs(block.text, block.firstLine);
+			adopted.parsedBlocks++;
+
+			if (!parsed.errors.empty()) {
+				adopted = IndexedJobs();
+				return false;
+			}
+
+			blockJobs = std::move(parsed.jobs);
+		}
+
+		for (const auto & job : blockJobs)
+			adopted.jobs.push_back(IdentifiedJob { counter.identify(job, block.text), job });
+
+		known[hashText(block.text)] = std::move(blockJobs);
+	}
+
+	m_blocks = std::move(known);
+	return true;
+}
+
+IndexedJobs
+JobIndex::update(StringView text)
+{
+	std::vector<JobBlock> blocks = splitJobBlocks(text);
+	std::unordered_map<uint64_t, std::vector<Job>> known;
+	IdentityCounter counter;
+
+	IndexedJobs indexed;
+	indexed.parsedBlocks = 0;
+	indexed.jobs.reserve(blocks.size());
+
+	for (const auto & block : blocks) {
+		uint64_t hash = hashText(block.text);
+
+		auto found = known.find(hash);
+		if (found == known.end()) {
+			auto before = m_blocks.find(hash);
+
+			if (before != m_blocks.end()) {
+				found = known.emplace(hash, std::move(before->second)).first;
+				m_blocks.erase(before);
+			}
+			else {
+				// only this block is parsed, the lines it reports are still the file's
+				ParsedJobs parsed = parseJobs(block.text, block.firstLine);
+				indexed.parsedBlocks++;
+
+				if (!parsed.errors.empty()) {
+					std::move(parsed.errors.begin(), parsed.errors.end(), std::back_inserter(indexed.errors));
+					continue;
+				}
+
+				found = known.emplace(hash, std::move(parsed.jobs)).first;
+			}
+		}
+
+		for (const auto & job : found->second)
+			indexed.jobs.push_back(IdentifiedJob { counter.identify(job, block.text), job });
+	}
+
+	m_blocks = std::move(known);
+	return indexed;
+}
+
+size_t
+JobIndex::size() const
+{
+	return m_blocks.size();
+}
+
+bool
+jobparsers::sameStatements(const std::vector<Statement> & first, const std::vector<Statement> & second)
+{
+	if (first.size() != second.size())
+		return false;
+
+	for (size_t i = 0; i < first.size(); i++) {
+		if (first[i].runner != second[i].runner || first[i].arguments != second[i].arguments ||
+			first[i].timeout != second[i].timeout)
+			return false;
+	}
+
+	return true;
+}
+
+bool
+jobparsers::sameDescription(const JobDescription & first, const JobDescription & second)
+{
+	const JobOptions & one = first.options;
+	const JobOptions & other = second.options;
+
+	return first.scheduler == second.scheduler && first.arguments == second.arguments &&
+		one.name == other.name && one.outputFile == other.outputFile && one.exitOnFail == other.exitOnFail &&
+		one.mode == other.mode && one.overrun == other.overrun && one.recursive == other.recursive &&
+		one.debounce == other.debounce && one.maxDelay == other.maxDelay &&
+		one.outputMaxSize == other.outputMaxSize && one.outputKeep == other.outputKeep &&
+		one.outputRotate == other.outputRotate && one.timeout == other.timeout &&
+		one.killGrace == other.killGrace && one.cpuMax == other.cpuMax && one.memoryMax == other.memoryMax &&
+		one.pidsMax == other.pidsMax && one.ioWeight == other.ioWeight && one.overlap == other.overlap &&
+		one.concurrency == other.concurrency;
+}
+
+JobChanges
+jobparsers::diffJobs(const std::unordered_map<std::string, const Job *> & before,
+					 const std::vector<IdentifiedJob> & after)
+{
+	JobChanges changes;
+	changes.unchanged = 0;
+
+	std::unordered_set<std::string> kept;
+	kept.reserve(after.size());
+
+	for (size_t i = 0; i < after.size(); i++) {
+		const IdentifiedJob & job = after[i];
+		kept.insert(job.identity);
+
+		auto running = before.find(job.identity);
+		if (running == before.end())
+			changes.added.push_back(i);
+		else if (!sameStatements(running->second->statements, job.job.statements))
+			changes.changed.push_back(i);
+		else
+			changes.unchanged++;
+	}
+
+	for (const auto & job : before) {
+		if (kept.find(job.first) == kept.end())
+			changes.removed.push_back(job.first);
+	}
+
+	// in a set order, whatever order they were hashed in
+	std::sort(changes.removed.begin(), changes.removed.end());
+	return changes;
+}
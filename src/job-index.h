@@ -0,0 +1,83 @@
+#ifndef JOB_INDEX_H
+#define JOB_INDEX_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+#include "failure.hpp"
+#include "jobs.h"
+
+namespace jobparsers
+{
+	/* A job along with what it's known by from one version of its file to the next */
+	struct IdentifiedJob
+	{
+		std::string identity;
+		Job job;
+	};
+
+	/* The jobs of a job file's text, and an error for each one which didn't parse */
+	struct IndexedJobs
+	{
+		std::vector<IdentifiedJob> jobs;
+		std::vector<Error> errors;
+		size_t parsedBlocks; // the other blocks were known from before
+	};
+
+	/*
+	 * A job is known by its name and a hash of its description line;
+	 * the same two in a changed file are the same job, whatever its
+	 * statements became. occurrence tells apart jobs which share both,
+	 * by the order they're in, it starts at 1.
+	 */
+	std::string jobIdentity(const std::string & name, StringView descriptionLine, unsigned occurrence = 1);
+
+	/*
+	 * Remembers the jobs each block of a job file (a job's description
+	 * line up to the next one) parsed into, by the block's hash, so that
+	 * a changed file only has its changed blocks parsed again.
+	 */
+	class JobIndex
+	{
+	public:
+		/*
+		 * Takes jobs as the ones text parses into, as when they were
+		 * read back from the cache: only each block's description line
+		 * is parsed, and a job is taken for a block whose description
+		 * it has in full. Blocks which no job lines up with, the file
+		 * having changed since, are parsed whole; false, with nothing
+		 * taken, if one of those doesn't parse.
+		 */
+		bool adopt(StringView text, const std::vector<Job> & jobs, IndexedJobs & adopted);
+
+		/* text's jobs in order; blocks which didn't parse aren't remembered */
+		IndexedJobs update(StringView text);
+
+		/* The number of blocks known */
+		size_t size() const;
+
+	private:
+		std::unordered_map<uint64_t, std::vector<Job>> m_blocks;
+	};
+
+	/* What has to change for the jobs running before to become after; jobs are told apart by identity */
+	struct JobChanges
+	{
+		std::vector<size_t> added;        // indexes into after
+		std::vector<size_t> changed;      // the same identity with other statements, indexes into after
+		std::vector<std::string> removed; // identities
+		size_t unchanged;
+	};
+
+	JobChanges diffJobs(const std::unordered_map<std::string, const Job *> & before,
+						const std::vector<IdentifiedJob> & after);
+
+	bool sameStatements(const std::vector<Statement> & first, const std::vector<Statement> & second);
+
+	/* The scheduler, its arguments and every option */
+	bool sameDescription(const JobDescription & first, const JobDescription & second);
+}
+
+#endif
@@ -1,30 +1,446 @@
 
+#include <atomic>
+#include <mutex>
+
+#include <signal.h>
+
 #include "jobs-processing.h"
+#include "command-paths.h"
+#include "builtins.h"
+#include "util.hpp"
+
+// children a statement left behind might keep its pipe open, its next statement doesn't wait for them
+const std::chrono::milliseconds DRAIN_TIMEOUT(1000);
 
 bool commandFailed(ResultOrError<int> commandResult)
 {
 	return commandResult.failed() || (commandResult.succeeded() && commandResult.getResult() != 0);
 }
 
-#include <iostream>
-void
-jobs::runJobStatements(const std::vector<Statement> & statements, bool stopOnFail)
+ResultOrError<int> runStatement(const Statement & statement, const commands::ExecContext & context)
 {
-	for (const auto & statement : statements) {
-		if (statement.runner.compare("exec") == 0) {
-			if (commandFailed(commands::exec(statement.arguments)) && stopOnFail)
-				break;
+	if (statement.runner.compare("exec") == 0)
+		return commands::exec(statement.arguments, context);
+	else if (statement.runner.compare("run") == 0)
+		return commands::run(statement.arguments, context);
+
+	return commands::spawn(statement.arguments, context);
+}
+
+bool knownRunner(const std::string & runner)
+{
+	return runner.compare("exec") == 0 || runner.compare("run") == 0 || runner.compare("spawn") == 0
+		|| runner.compare("builtin") == 0;
+}
+
+struct StatementEnding;
+
+/* Where a run is at, for when it is picked up again after a sleep or a process */
+struct StatementsRun
+{
+	const std::vector<Statement> & statements;
+	size_t next;
+	bool stopOnFail;
+	jobs::RunContext context;
+	std::function<void()> done;
+
+	// what the run's timeout has to cut short once it's up
+	std::mutex mutex;
+	bool expired = false;
+	std::shared_ptr<StatementEnding> running;
+	scheduling::TimerId sleeping = 0;
+	scheduling::TimerId deadline = 0;
+};
+
+/* The process exited and our end of its pipe is closed, in whichever order */
+struct StatementEnding
+{
+	std::atomic<int> pending;
+	int code;
+	pid_t pid;
+	std::atomic<bool> exited;
+	std::atomic<bool> timedOut;
+	std::atomic<scheduling::TimerId> timeout;
+};
+
+bool runExpired(std::shared_ptr<StatementsRun> run)
+{
+	std::lock_guard<std::mutex> lock(run->mutex);
+	return run->expired;
+}
+
+/* SIGTERM to the process and whatever it started, SIGKILL to any of them still around after the grace period */
+void terminateStatement(std::shared_ptr<StatementsRun> run, std::shared_ptr<StatementEnding> ending, 
+						const std::string & reason)
+{
+	if (ending->exited)
+		return;
+
+	printerr("[" + run->context.owner + "] " + reason + ", terminating process " + std::to_string(ending->pid));
+	ending->timedOut = true;
+	kill(-ending->pid, SIGTERM);
+
+	// the leader might be gone while what it started ignores SIGTERM and holds the pipe; a pgid isn't
+	// reused while its group has members, so an empty one only gets ESRCH
+	run->context.timers->scheduleAfter(run->context.killGrace, [ending]() {
+		kill(-ending->pid, SIGKILL);
+	});
+}
+
+bool isSleep(const Statement & statement)
+{
+	return statement.runner.compare("builtin") == 0 && !statement.arguments.empty() 
+		&& statement.arguments[0].compare("sleep") == 0;
+}
+
+/* Whether the run can let go of its thread and be picked up again later */
+bool canResume(const jobs::RunContext & context)
+{
+	return context.timers != nullptr && static_cast<bool>(context.resume);
+}
+
+/* Whether the statement's process can be left to the reaper rather than waited for */
+bool canLaunch(const Statement & statement, const jobs::RunContext & context)
+{
+	return (statement.runner.compare("exec") == 0 || statement.runner.compare("run") == 0)
+		&& context.reaper != nullptr && canResume(context);
+}
+
+commands::ExecContext execContextFor(const jobs::RunContext & context)
+{
+	commands::ExecContext execContext;
+	execContext.environment = context.environment;
+	execContext.reaper = context.reaper;
+	execContext.owner = context.owner;
+	execContext.group = context.group;
+
+	return execContext;
+}
+
+std::shared_ptr<output::Capture> openCapture(const jobs::RunContext & context)
+{
+	if (context.output == nullptr || context.loop == nullptr)
+		return nullptr;
+
+	return output::Capture::open(*context.loop, context.output);
+}
+
+ResultOrError<int> runBuiltin(const Statement & statement, const jobs::RunContext & context)
+{
+	ResultOrError<int> result = builtins::run(statement.arguments, context.output);
+	if (result.failed())
+		printerr(result.getError().message);
+
+	return result;
+}
+
+ResultOrError<int> runProcess(const Statement & statement, const jobs::RunContext & context)
+{
+	commands::ExecContext execContext = execContextFor(context);
+
+	std::shared_ptr<output::Capture> capture = openCapture(context);
+	if (capture != nullptr)
+		execContext.output = capture->childEnd();
+
+	ResultOrError<int> result = runStatement(statement, execContext);
+
+	// the next statement's output goes after this one's
+	if (capture != nullptr) {
+		capture->closeChildEnd();
+		if (statement.runner.compare("spawn") != 0)
+			capture->waitDrained(DRAIN_TIMEOUT);
+	}
+
+	return result;
+}
+
+void continueRun(std::shared_ptr<StatementsRun> run);
+void resumeRun(std::shared_ptr<StatementsRun> run, bool failed);
+
+void finishRun(std::shared_ptr<StatementsRun> run)
+{
+	if (run->deadline != 0)
+		run->context.timers->cancel(run->deadline);
+
+	if (run->context.handle != nullptr)
+		run->context.handle->detach();
+
+	if (run->done)
+		run->done();
+}
+
+/* The run's time is up, or it was cancelled: whatever it's waiting for is cut short and nothing after it runs */
+void expireRun(std::shared_ptr<StatementsRun> run, const std::string & reason)
+{
+	std::shared_ptr<StatementEnding> running;
+	scheduling::TimerId sleeping;
+	{
+		std::lock_guard<std::mutex> lock(run->mutex);
+		run->expired = true;
+		running = run->running;
+		sleeping = run->sleeping;
+	}
+
+	if (running != nullptr)
+		terminateStatement(run, running, reason);
+	else
+		printerr("[" + run->context.owner + "] " + reason);
+
+	if (sleeping != 0 && run->context.timers->cancel(sleeping))
+		resumeRun(run, true);
+}
+
+/* Hands the rest of the run back to a worker, once the statement which let go of it is over */
+void resumeRun(std::shared_ptr<StatementsRun> run, bool failed)
+{
+	bool resumed = run->context.resume([run, failed]() {
+		if (failed && run->stopOnFail)
+			finishRun(run);
+		else
+			continueRun(run);
+	});
+
+	if (!resumed) {
+		printerr("[" + run->context.owner + "] the rest of the run was dropped, too many runs are queued");
+		finishRun(run);
+	}
+}
+
+/* Calls next once the capture has everything, or after the drain timeout if something holds on to the pipe */
+void afterDrained(std::shared_ptr<StatementsRun> run, std::shared_ptr<output::Capture> capture,
+				  std::function<void()> next)
+{
+	std::shared_ptr<std::atomic<bool>> called = std::make_shared<std::atomic<bool>>(false);
+	auto once = [called, next]() {
+		if (!called->exchange(true))
+			next();
+	};
+
+	scheduling::TimerQueue * timers = run->context.timers;
+	scheduling::TimerId timeout = timers->scheduleAfter(DRAIN_TIMEOUT, once);
+
+	capture->whenDrained([timers, timeout, once]() {
+		timers->cancel(timeout);
+		once();
+	});
+}
+
+/*
+ * Starts the statement's process and lets go of the thread; the run
+ * is resumed once the process exits and its output is drained.
+ * Returns false if nothing could be started.
+ */
+bool launchStatement(std::shared_ptr<StatementsRun> run, const Statement & statement)
+{
+	commands::ExecContext execContext = execContextFor(run->context);
+
+	std::shared_ptr<output::Capture> capture = openCapture(run->context);
+	if (capture != nullptr)
+		execContext.output = capture->childEnd();
+
+	bool timed = statement.timeout.count() > 0 || run->context.timeout.count() > 0 
+			|| run->context.handle != nullptr;
+	execContext.ownGroup = timed;
+
+	std::shared_ptr<StatementEnding> ending = std::make_shared<StatementEnding>();
+	ending->pending = 2;
+	ending->code = -1;
+	ending->pid = -1;
+	ending->exited = false;
+	ending->timedOut = false;
+	ending->timeout = 0;
+
+	auto ended = [run, capture, ending]() {
+		{
+			std::lock_guard<std::mutex> lock(run->mutex);
+			run->running = nullptr;
+		}
+
+		bool failed = ending->code != 0 || ending->timedOut;
+
+		if (capture == nullptr)
+			resumeRun(run, failed);
+		else
+			afterDrained(run, capture, [run, failed]() { resumeRun(run, failed); });
+	};
+
+	ResultOrError<pid_t> started = commands::launch(statement.runner, statement.arguments, execContext,
+		[run, ending, ended](const processes::ProcessExit & exit) {
+			ending->code = exit.code;
+			ending->exited = true;
+			if (ending->timeout != 0)
+				run->context.timers->cancel(ending->timeout);
+
+			if (--ending->pending == 0)
+				ended();
+		});
+
+	if (capture != nullptr)
+		capture->closeChildEnd();
+
+	if (started.failed())
+		return false;
+
+	ending->pid = started.getResult();
+
+	if (timed) {
+		bool expired;
+		{
+			std::lock_guard<std::mutex> lock(run->mutex);
+			run->running = ending;
+			expired = run->expired;
 		}
-		else if (statement.runner.compare("run") == 0) {
-			if (commandFailed(commands::run(statement.arguments)) && stopOnFail)
-				break;
+
+		if (expired)
+			terminateStatement(run, ending, "run was cut short");
+
+		if (statement.timeout.count() > 0) {
+			std::string reason = "'" + statement.arguments.at(0) + "' timed out after " 
+					+ std::to_string(statement.timeout.count()) + " ms";
+
+			// no thread watches the process, the timer queue does
+			ending->timeout = run->context.timers->scheduleAfter(statement.timeout, [run, ending, reason]() {
+				terminateStatement(run, ending, reason);
+			});
+		}
+	}
+
+	if (--ending->pending == 0)
+		ended();
+
+	return true;
+}
+
+void continueRun(std::shared_ptr<StatementsRun> run)
+{
+	while (run->next < run->statements.size()) {
+		const Statement & statement = run->statements[run->next++];
+		if (!knownRunner(statement.runner) || runExpired(run))
+			break;
+
+		bool failed;
+
+		// the worker is given back for the sleep, a timer picks the run up where it left off
+		if (isSleep(statement) && canResume(run->context)) {
+			auto duration = builtins::sleepDuration(statement.arguments);
+			if (duration.succeeded()) {
+				std::lock_guard<std::mutex> lock(run->mutex);
+				run->sleeping = run->context.timers->scheduleAfter(duration.getResult(), [run]() {
+					{
+						std::lock_guard<std::mutex> lock(run->mutex);
+						run->sleeping = 0;
+					}
+					resumeRun(run, false);
+				});
+				return;
+			}
+
+			printerr(duration.getError().message);
+			failed = true;
 		}
-		else if (statement.runner.compare("spawn") == 0) {
-			if (commandFailed(commands::spawn(statement.arguments)) && stopOnFail)
-				break;
+		// and for a process, its exit does
+		else if (canLaunch(statement, run->context)) {
+			if (launchStatement(run, statement))
+				return;
+
+			failed = true;
 		}
 		else {
+			failed = commandFailed(statement.runner.compare("builtin") == 0 
+					? runBuiltin(statement, run->context) : runProcess(statement, run->context));
+		}
+
+		if (failed && run->stopOnFail)
 			break;
+	}
+
+	finishRun(run);
+}
+
+void
+jobs::RunHandle::cancel(const std::string & reason)
+{
+	std::function<void(const std::string &)> cancel;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_cancelled)
+			return;
+
+		m_cancelled = true;
+		m_reason = reason;
+		cancel = m_cancel;
+	}
+
+	if (cancel)
+		cancel(reason);
+}
+
+void
+jobs::RunHandle::attach(std::function<void(const std::string &)> cancel)
+{
+	bool cancelled;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_cancel = cancel;
+		cancelled = m_cancelled;
+	}
+
+	if (cancelled)
+		cancel(m_reason);
+}
+
+void
+jobs::RunHandle::detach()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_cancel = nullptr;
+}
+
+void
+jobs::runJobStatements(const std::vector<Statement> & statements, bool stopOnFail,
+					   const RunContext & context, std::function<void()> done)
+{
+	std::shared_ptr<StatementsRun> run(new StatementsRun { statements, 0, stopOnFail, context, done });
+
+	if (context.timeout.count() > 0 && canResume(context)) {
+		run->deadline = context.timers->scheduleAfter(context.timeout, [run]() {
+			expireRun(run, "run timed out after " + std::to_string(run->context.timeout.count()) + " ms");
+		});
+	}
+
+	if (context.handle != nullptr && canResume(context)) {
+		std::weak_ptr<StatementsRun> cancellable = run;
+		context.handle->attach([cancellable](const std::string & reason) {
+			std::shared_ptr<StatementsRun> run = cancellable.lock();
+			if (run != nullptr)
+				expireRun(run, reason);
+		});
+	}
+
+	continueRun(run);
+}
+
+std::vector<std::string>
+jobs::resolveCommands(const std::vector<Statement> & statements)
+{
+	std::vector<std::string> errors;
+
+	for (const auto & statement : statements) {
+		if (statement.runner.compare("builtin") == 0) {
+			if (statement.arguments.empty() || !builtins::exists(statement.arguments[0]))
+				errors.push_back("Unknown builtin '" + 
+								 (statement.arguments.empty() ? "" : statement.arguments[0]) + "'");
+			continue;
 		}
+
+		commands::commandFor(statement.runner, statement.arguments)
+			.mapSuccess<std::string>([](const std::string & command) {
+				return commands::commandPaths().resolve(command);
+			})
+			.onFailure([&errors](const Error & error) {
+				errors.push_back(error.message);
+			});
 	}
-}
\ No newline at end of file
+
+	return errors;
+}
@@ -1,12 +1,82 @@
 #ifndef JOBSPROCESSING_H
 #define JOBSPROCESSING_H
 
+#include <memory>
+#include <functional>
+#include <string>
+#include <mutex>
+
 #include "commands.h"
 #include "jobs.h"
+#include "event-loop.h"
+#include "output.h"
+#include "timer-queue.h"
 
 namespace jobs 
 {
-	void runJobStatements(const std::vector<Statement> & statements, bool stopOnFail = true);
+	/*
+	 * Lets whoever started a run cut it short later, the way its
+	 * timeout would: what it's waiting on is terminated and nothing
+	 * after that runs. A run cancelled before it started does nothing.
+	 */
+	class RunHandle
+	{
+	public:
+		void cancel(const std::string & reason);
+
+		/* What cancel() does for the run, called right away if it was cancelled already */
+		void attach(std::function<void(const std::string &)> cancel);
+
+		/* Once the run is over, there's nothing left to cancel */
+		void detach();
+
+	private:
+		bool m_cancelled = false;
+		std::string m_reason;
+		std::function<void(const std::string &)> m_cancel;
+		std::mutex m_mutex;
+	};
+
+	struct RunContext
+	{
+		commands::Environment environment;
+
+		// whoever the statements' processes are handed to, and the job they belong to
+		processes::Reaper * reaper = nullptr;
+		std::string owner;
+
+		// where the statements' output goes; without a file it's left on our stdout
+		scheduling::EventLoop * loop = nullptr;
+		std::shared_ptr<output::OutputFile> output;
+
+		// a builtin sleep re-arms a timer and a process is left to the reaper, either hands the
+		// rest of the run back through resume (false if it was turned down); without them they block
+		scheduling::TimerQueue * timers = nullptr;
+		std::function<bool(std::function<void()>)> resume;
+
+		// for the whole run, on top of the statements' own; like those only enforced with the above
+		timeutil::DurationUnit timeout = timeutil::DurationUnit(0);
+		timeutil::DurationUnit killGrace = std::chrono::seconds(5);
+
+		// the leaf the run's processes are limited by, if the job has limits; builtins aren't
+		std::shared_ptr<processes::ControlGroup> group;
+
+		// to cancel the run with; its processes get a process group of their own then, like with a timeout
+		std::shared_ptr<RunHandle> handle;
+	};
+
+	/*
+	 * Runs the statements in order and calls done once they're over,
+	 * which might be after this returns and from another thread when
+	 * the run sleeps or waits for a process; the statements have to be
+	 * around until then.
+	 */
+	void runJobStatements(const std::vector<Statement> & statements, bool stopOnFail = true,
+						  const RunContext & context = RunContext(), 
+						  std::function<void()> done = std::function<void()>());
+
+	/* Looks up the statements' commands ahead of their first run; returns what couldn't be found */
+	std::vector<std::string> resolveCommands(const std::vector<Statement> & statements);
 }
 
 #endif
\ No newline at end of file
@@ -1,5 +1,4 @@
 #include <boost/algorithm/string.hpp>
-#include <regex>
 #include <array>
 #include <functional>
 #include <algorithm>
@@ -9,46 +8,439 @@
 using namespace jobparsers;
 
 bool
-jobparsers::validateDescriptionLine(const std::string & description)
+isBlank(char c)
 {
-	static const std::string segments[] = {
-		"\\s*[a-zA-Z]+(\\s+\\S+)*\\s*\\(.*\\)\\s*:\\s*", // matches with options
-		"\\s*[a-zA-Z]+(\\s+\\S+)*\\s*:\\s*" // matches without options
-	};
-	static const std::string combined = "(" + segments[0] + "|" + segments[1] + ")(\\n|$)";
-	static const std::regex lineregex(combined);
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+bool
+isLetter(char c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+/*
+ * Goes over one line once, left to right, keeping track of where it is
+ * so errors can say which line and column they're about. Everything it
+ * hands out is a view into the line.
+ */
+class LineScanner
+{
+public:
+	LineScanner(StringView line, unsigned lineNumber, unsigned firstColumn = 1):
+		m_line(line), m_lineNumber(lineNumber), m_firstColumn(firstColumn), m_offset(0) {}
+
+	bool atEnd() const { return m_offset >= m_line.size(); }
+	char peek() const { return m_line[m_offset]; }
+	size_t offset() const { return m_offset; }
+	void advance() { m_offset++; }
+
+	void skipBlanks()
+	{
+		while (!atEnd() && isBlank(peek()))
+			m_offset++;
+	}
+
+	/* Whether nothing but blanks is left after skipping count characters */
+	bool blankAfter(size_t count) const
+	{
+		for (size_t i = m_offset + count; i < m_line.size(); i++) {
+			if (!isBlank(m_line[i]))
+				return false;
+		}
+
+		return true;
+	}
+
+	template <typename Predicate>
+	StringView takeWhile(Predicate predicate)
+	{
+		size_t start = m_offset;
+		while (!atEnd() && predicate(peek()))
+			m_offset++;
+
+		return m_line.substr(start, m_offset - start);
+	}
+
+	Error error(const std::string & message) const
+	{
+		return errorAt(m_offset, message);
+	}
+
+	Error errorAt(size_t offset, const std::string & message) const
+	{
+		return Error(std::to_string(m_lineNumber) + ":" + std::to_string(m_firstColumn + offset) + ": " + message);
+	}
+
+private:
+	StringView m_line;
+	unsigned m_lineNumber;
+	unsigned m_firstColumn;
+	size_t m_offset;
+};
+
+/*
+ * name = value pairs separated by commas, a trailing comma is fine;
+ * when closed they end at a ')', which is consumed, otherwise at the
+ * end of the line.
+ */
+ResultOrError<OptionsMap>
+scanOptions(LineScanner & scanner, bool closed)
+{
+	OptionsMap options;
+
+	while (1) {
+		scanner.skipBlanks();
+
+		if (scanner.atEnd()) {
+			if (closed)
+				return fail(scanner.error("Unclosed options, expected ')'"));
+			break;
+		}
+
+		if (closed && scanner.peek() == ')') {
+			scanner.advance();
+			break;
+		}
+
+		StringView name = scanner.takeWhile([](char c) { 
+			return !isBlank(c) && c != '=' && c != ',' && c != ')'; 
+		});
+		if (name.empty())
+			return fail(scanner.error("Expected an option name"));
+
+		scanner.skipBlanks();
+		if (scanner.atEnd() || scanner.peek() != '=')
+			return fail(scanner.error("Expected '=' after option '" + name.to_string() + "'"));
+
+		scanner.advance();
+		scanner.skipBlanks();
+
+		StringView value = scanner.takeWhile([](char c) { return !isBlank(c) && c != ',' && c != ')'; });
+		if (value.empty())
+			return fail(scanner.error("Missing value for option '" + name.to_string() + "'"));
+
+		options[name.to_string()] = value.to_string();
+
+		scanner.skipBlanks();
+		if (scanner.atEnd() || (closed && scanner.peek() == ')'))
+			continue;
+
+		if (scanner.peek() != ',')
+			return fail(scanner.error("Expected ',' or ')' after the value of option '" + name.to_string() + "'"));
+
+		scanner.advance();
+	}
+
+	return succeed(options);
+}
+
+/*
+ * Splits on blanks the way a shell would as far as quoting goes:
+ * whatever is between single or double quotes stays one word. The 
+ * offset of a quote left open goes to unclosed, npos if there's none.
+ */
+std::vector<std::string>
+scanWords(LineScanner & scanner, size_t & unclosed)
+{
+	std::vector<std::string> words;
+	std::string word;
+	bool inWord = false;
+	char quote = '\0';
+	unclosed = std::string::npos;
+
+	for (; !scanner.atEnd(); scanner.advance()) {
+		char c = scanner.peek();
+
+		if (quote != '\0') {
+			if (c == quote)
+				quote = '\0';
+			else
+				word += c;
+		}
+		else if (c == '"' || c == '\'') {
+			quote = c;
+			unclosed = scanner.offset();
+			inWord = true;
+		}
+		else if (isBlank(c)) {
+			if (inWord)
+				words.push_back(word);
+
+			word.clear();
+			inWord = false;
+		}
+		else {
+			word += c;
+			inWord = true;
+		}
+	}
+
+	if (quote == '\0')
+		unclosed = std::string::npos;
+
+	if (inWord)
+		words.push_back(word);
+
+	return words;
+}
+
+/* ---------- */
+
+ResultOrError<JobDescription>
+jobparsers::parseDescription(StringView line, unsigned lineNumber)
+{
+	LineScanner scanner(line, lineNumber);
+	scanner.skipBlanks();
+
+	StringView scheduler = scanner.takeWhile(isLetter);
+	if (scheduler.empty())
+		return fail(scanner.error("Expected a scheduler name"));
+
+	if (!scanner.atEnd() && !isBlank(scanner.peek()) && scanner.peek() != '(' && scanner.peek() != ':')
+		return fail(scanner.error("Unexpected '" + std::string(1, scanner.peek()) + "' in the scheduler name"));
+
+	size_t argumentsStart = std::string::npos;
+	size_t argumentsEnd = std::string::npos;
+	OptionsMap options;
+	size_t optionsOffset = std::string::npos;
+	bool ended = false;
+
+	// the description ends at a colon with nothing after it, arguments like 10:30 have their own
+	while (!ended) {
+		scanner.skipBlanks();
+		if (scanner.atEnd())
+			break;
+
+		if (scanner.peek() == ':' && scanner.blankAfter(1)) {
+			scanner.advance();
+			ended = true;
+			break;
+		}
+
+		if (optionsOffset != std::string::npos)
+			return fail(scanner.error("Expected ':' after the options"));
+
+		if (scanner.peek() == '(') {
+			optionsOffset = scanner.offset();
+			scanner.advance();
+
+			auto optionsOrError = scanOptions(scanner, true);
+			if (optionsOrError.failed())
+				return fail(optionsOrError.getError());
+
+			options = optionsOrError.getResult();
+			continue;
+		}
+
+		size_t start = scanner.offset();
+		StringView argument = scanner.takeWhile([](char c) { return !isBlank(c) && c != '('; });
+
+		size_t closing = argument.find(')');
+		if (closing != StringView::npos)
+			return fail(scanner.errorAt(start + closing, "Unexpected ')'"));
+
+		if (argument.back() == ':' && scanner.blankAfter(0)) {
+			argument.remove_suffix(1);
+			ended = true;
+		}
+
+		if (argumentsStart == std::string::npos)
+			argumentsStart = start;
+		argumentsEnd = start + argument.size();
+	}
+
+	if (!ended)
+		return fail(scanner.error("Expected ':' at the end of the description"));
+
+	StringView arguments = argumentsStart != std::string::npos 
+			? line.substr(argumentsStart, argumentsEnd - argumentsStart) : StringView();
+
+	auto optionsOrError = mapJobOptions(options);
+	if (optionsOrError.failed())
+		return fail(scanner.errorAt(optionsOffset, optionsOrError.getError().message));
+
+	return succeed(JobDescription { scheduler.to_string(), arguments.to_string(), optionsOrError.getResult() });
+}
+
+/*
+ * A statement might have options of its own right after the runner,
+ * the same way a job does: exec (timeout = 30s) make all
+ */
+ResultOrError<Statement>
+jobparsers::parseStatement(StringView text, unsigned lineNumber, unsigned firstColumn)
+{
+	LineScanner scanner(text, lineNumber, firstColumn);
+	scanner.skipBlanks();
+
+	StringView runner = scanner.takeWhile([](char c) { return !isBlank(c) && c != '('; });
+	if (runner.empty())
+		return fail(scanner.error("Expected a statement"));
+
+	timeutil::DurationUnit timeout(0);
+
+	scanner.skipBlanks();
+	if (!scanner.atEnd() && scanner.peek() == '(') {
+		size_t optionsOffset = scanner.offset();
+		scanner.advance();
+
+		auto optionsOrError = scanOptions(scanner, true);
+		if (optionsOrError.failed())
+			return fail(optionsOrError.getError());
+
+		const OptionsMap & options = optionsOrError.getResult();
+		auto timeoutIter = options.find("timeout");
+		if (timeoutIter != options.end()) {
+			auto durationOrError = timeutil::parseCompactDuration(timeoutIter->second);
+			if (durationOrError.failed())
+				return fail(scanner.errorAt(optionsOffset, "Invalid value for option 'timeout'; " + 
+											durationOrError.getError().message));
+
+			timeout = durationOrError.getResult();
+		}
+	}
+
+	size_t unclosed;
+	std::vector<std::string> arguments = scanWords(scanner, unclosed);
+	if (unclosed != std::string::npos)
+		return fail(scanner.errorAt(unclosed, "Unclosed quote"));
 
-	return std::regex_match(description, lineregex);
+	return succeed(Statement { runner.to_string(), arguments, timeout });
 }
 
+/*
+ * The whole file in one pass: a line starting with anything but a blank
+ * or a '#' describes a job and the indented lines after it are its 
+ * statements; blank lines and comments can be anywhere. A job with an 
+ * error is left out, and parsing goes on with the next one.
+ */
+ParsedJobs
+jobparsers::parseJobs(StringView text, unsigned firstLine)
+{
+	ParsedJobs parsed;
+	bool skipping = false; // the statements of a job which is left out
+
+	// a Job is a few hundred bytes, growing the vector as they come would take up to twice that
+	parsed.jobs.reserve(countJobs(text));
+	unsigned lineNumber = firstLine - 1;
+	size_t start = 0;
+
+	while (start < text.size()) {
+		size_t end = text.find('\n', start);
+		if (end == StringView::npos)
+			end = text.size();
+
+		StringView line = text.substr(start, end - start);
+		start = end + 1;
+		lineNumber++;
+
+		size_t first = line.find_first_not_of(" \t\r");
+		if (first == StringView::npos || line[first] == '#')
+			continue;
+
+		if (first == 0) {
+			auto description = parseDescription(line, lineNumber);
+			skipping = description.failed();
+
+			if (description.failed())
+				parsed.errors.push_back(description.getError());
+			else
+				parsed.jobs.push_back(Job { description.getResult(), {} });
+
+			continue;
+		}
+
+		if (skipping)
+			continue;
+
+		if (parsed.jobs.empty()) {
+			parsed.errors.push_back(Error(std::to_string(lineNumber) + ":" + std::to_string(first + 1) + 
+										  ": Statement outside of any job"));
+			continue;
+		}
+
+		auto statement = parseStatement(line.substr(first), lineNumber, first + 1);
+		if (statement.failed()) {
+			parsed.errors.push_back(statement.getError());
+			parsed.jobs.pop_back();
+			skipping = true;
+			continue;
+		}
+
+		parsed.jobs.back().statements.push_back(statement.getResult());
+	}
+
+	return parsed;
+}
+
+/* A line not indented, and neither blank nor a comment */
+size_t
+jobparsers::nextJobBoundary(StringView text, size_t from)
+{
+	size_t start = from;
+	if (start > 0 && start < text.size() && text[start - 1] != '\n') {
+		start = text.find('\n', start);
+		start = start == StringView::npos ? text.size() : start + 1;
+	}
+
+	while (start < text.size()) {
+		char first = text[start];
+		if (!isBlank(first) && first != '#')
+			return start;
+
+		start = text.find('\n', start);
+		start = start == StringView::npos ? text.size() : start + 1;
+	}
+
+	return text.size();
+}
+
+size_t
+jobparsers::countJobs(StringView text)
+{
+	size_t count = 0;
+
+	for (size_t start = nextJobBoundary(text, 0); start < text.size(); start = nextJobBoundary(text, start + 1))
+		count++;
+
+	return count;
+}
+
+/* ---------- */
+
 bool
-jobparsers::validateOptionsString(const std::string & optionsString)
+jobparsers::validateDescriptionLine(const std::string & description)
 {
-	static const std::string firstOne = "\\s*\\S+\\s*=\\s*\\S+\\s*";
-	static const std::string subsequentOnes = "\\s*\\," + firstOne;
-	static const std::string combined = firstOne + "(" + subsequentOnes + ")*($|\\n)";
-	static const std::regex optionsregex(combined);
+	return parseDescription(description, 1).succeeded();
+}
 
-	return std::regex_match(optionsString, optionsregex);
+bool
+jobparsers::validateOptionsString(const std::string & optionsString)
+{
+	LineScanner scanner(optionsString, 1);
+	return scanOptions(scanner, false).succeeded();
 }
 
+/* The scheduler's name, as long as the line goes on with options or a colon */
 ExtractionResult
 jobparsers::extractScheduler(const std::string & description, int from)
 {
-	std::string trimmed = boost::trim_copy(description);
-	size_t optionStartPos = trimmed.find_first_of("(");
-	size_t len = trimmed.length() - 1;
-	size_t splitPoint = std::min(optionStartPos, len);
+	size_t start = description.find_first_not_of(" \t", from);
+	if (start == std::string::npos || description.find_first_of("(:", start) == std::string::npos)
+		return ExtractionResult { "", std::string::npos, std::string::npos };
 
-	return ExtractionResult { boost::trim_copy(trimmed.substr(0, splitPoint)), 0, splitPoint };
-}
+	size_t end = start;
+	while (end < description.size() && isLetter(description[end]))
+		end++;
 
+	return ExtractionResult { description.substr(start, end - start), start, end };
+}
 
 ExtractionResult
 jobparsers::extractOptions(const std::string & description, int from)
 {
-	size_t startPos = description.find('(');
-	size_t endPos = description.find(')');
+	size_t startPos = description.find('(', from);
+	size_t endPos = description.find(')', from);
 
 	if (startPos == std::string::npos || endPos == std::string::npos)
 		return ExtractionResult { "", startPos, endPos };
@@ -59,7 +451,6 @@ jobparsers::extractOptions(const std::string & description, int from)
 	};
 }
 
-
 OptionsMap 
 jobparsers::mapOptions(const std::string & optionsText, 
 		std::function<std::vector<std::string>(const std::string &)> splitter)
@@ -115,24 +506,28 @@ jobparsers::extractCommand(const std::string & statementText)
 	return ExtractionResult { statementText.substr(0, firstDelim) , 0, firstDelim - 1 };
 }
 
+/* A runner and at least one argument */
 bool 
 jobparsers::validateStatementString(const std::string & statementString)
 {
-	static const std::regex statementregex("\\S+\\s+\\S+(\\s+\\S+)*\\s*($|\\n)");
+	auto statement = parseStatement(statementString, 1, 1);
+	return statement.succeeded() && !statement.getResult().arguments.empty();
+}
+
+/* A quote left open takes the rest of the text */
+std::vector<std::string>
+jobparsers::splitWords(const std::string & text)
+{
+	LineScanner scanner(text, 1);
+	size_t unclosed;
 
-	return std::regex_match(statementString, statementregex);
+	return scanWords(scanner, unclosed);
 }
 
-Statement
+ResultOrError<Statement>
 jobparsers::parseStatement(const std::string & statementText)
 {
-	std::vector<std::string> parts;
-	boost::split(parts, statementText, boost::is_any_of(" \t"), boost::token_compress_on);
-
-	if (parts.size() < 1)
-		return Statement { "", std::vector<std::string>() };
- 
-	return Statement { parts.at(0), std::vector<std::string>(parts.begin() + 1, parts.end()) };
+	return parseStatement(statementText, 1, 1);
 }
 
 int
@@ -153,20 +548,21 @@ jobparsers::skipToJobDescription(const std::vector<std::string> & lines, int fro
 	return -1;
 }
 
+/* The job's lines and the index of the line after them */
 std::pair<std::vector<std::string>, unsigned>
 jobparsers::getNextJob(const std::vector<std::string> & lines, unsigned fromIndex)
 {
 	std::vector<std::string> jobLines;
-	unsigned offset = 0;
 
-	unsigned jobDescriptionIndex = skipToJobDescription(lines, fromIndex);
-	offset += jobDescriptionIndex;
+	int jobDescriptionIndex = skipToJobDescription(lines, fromIndex);
+	if (jobDescriptionIndex < 0)
+		return { jobLines, lines.size() };
 
 	jobLines.push_back(lines.at(jobDescriptionIndex));
 
-	for (auto iter = lines.begin() + jobDescriptionIndex + 1; iter != lines.end(); iter++) {
-		const std::string & line = *iter;
-		offset++;
+	unsigned next = jobDescriptionIndex + 1;
+	for (; next < lines.size(); next++) {
+		const std::string & line = lines.at(next);
 
 		if (line.empty())
 			continue;
@@ -181,7 +577,7 @@ jobparsers::getNextJob(const std::vector<std::string> & lines, unsigned fromInde
 		jobLines.push_back(trimmed);
 	}
 
-	return { jobLines, fromIndex + offset };
+	return { jobLines, next };
 }
 
 std::vector<std::vector<std::string>>
@@ -193,11 +589,10 @@ jobparsers::separateJobsLines(const std::vector<std::string> & allLines)
 
 	while (nextIndex < allLines.size()) {
 		std::pair<std::vector<std::string>, unsigned> nextJobLines = getNextJob(allLines, nextIndex);
-		jobsLines.push_back(nextJobLines.first);
-
-		if (nextJobLines.second == nextIndex || nextJobLines.second >= allLines.size() - 1)
+		if (nextJobLines.first.empty())
 			break;
 
+		jobsLines.push_back(nextJobLines.first);
 		nextIndex = nextJobLines.second;
 	}
 
@@ -207,64 +602,147 @@ jobparsers::separateJobsLines(const std::vector<std::string> & allLines)
 ResultOrError<JobDescription> 
 jobparsers::parseDescription(const std::string & descriptionLine)
 {
-	if (!validateDescriptionLine(descriptionLine)) 
-		return fail("Invalid description line");
-
-	ExtractionResult scheduler = extractScheduler(descriptionLine);
-	if (scheduler.extractedText.empty())
-		return fail("Couldn't extract scheduler");
-
-	std::vector<std::string> schedulerParts = splitScheduler(scheduler.extractedText);
-
-	ExtractionResult optionsString = extractOptions(descriptionLine);
-	if (!optionsString.extractedText.empty() && !validateOptionsString(optionsString.extractedText))
-		return fail("Invalid options text");
-
-	OptionsMap optionsStringMap = mapOptions(optionsString.extractedText, splitByCommas);
-
-	return mapJobOptions(optionsStringMap)
-			.mapSuccess<JobDescription>([&] (const JobOptions & options) {
-				return succeed(JobDescription { 
-					schedulerParts.at(0),
-					schedulerParts.at(1), 
-					options 
-				});
-			});
+	return parseDescription(descriptionLine, 1);
 }
 
+/* The description first and then the statements, each line counted as the next one */
 ResultOrError<Job> 
 jobparsers::parseJob(const std::vector<std::string> & jobLines)
 {
 	if (jobLines.size() == 0) return fail("Empty job");
 
-	auto descriptionOrError = parseDescription(jobLines.at(0));
+	auto descriptionOrError = parseDescription(jobLines.at(0), 1);
 
 	return descriptionOrError.mapSuccess<Job>([&](const auto & description) -> ResultOrError<Job> {
 		Job job;
 
 		job.description = description;
 
-		for (auto iter = jobLines.begin() + 1; iter != jobLines.end(); iter++) {
-			const std::string & line = *iter;
+		for (unsigned i = 1; i < jobLines.size(); i++) {
+			const std::string & line = jobLines.at(i);
 			if (line.empty())
 				continue;
 
-			if (line[0] == ' ' || line[0] == '\t')
-				break;
+			auto statement = parseStatement(line, i + 1, 1);
+			if (statement.failed())
+				return fail(statement.getError());
 
-			job.statements.push_back(parseStatement(boost::trim_copy(*iter)));
+			job.statements.push_back(statement.getResult());
 		}
 
 		return succeed(job);
 	});
 }
 
+/* Rotated output files kept at most, past that rotating would be mostly renaming */
+const unsigned OUTPUT_KEEP_MAX = 1000;
+
+/* A size in bytes, optionally with a K, M or G suffix (powers of 1024) */
+ResultOrError<uint64_t>
+parseSize(const std::string & text)
+{
+	size_t suffixStart = text.find_first_not_of("0123456789");
+	if (text.empty() || suffixStart == 0)
+		return fail(text + " isn't a valid size");
+
+	uint64_t size;
+	try {
+		size = std::stoull(text.substr(0, suffixStart));
+	}
+	catch (const std::out_of_range &) {
+		return fail(text + " is beyond the limits");
+	}
+
+	std::string suffix = suffixStart != std::string::npos ? text.substr(suffixStart) : "";
+	unsigned shift;
+
+	if (suffix.empty())
+		shift = 0;
+	else if (suffix.compare("K") == 0)
+		shift = 10;
+	else if (suffix.compare("M") == 0)
+		shift = 20;
+	else if (suffix.compare("G") == 0)
+		shift = 30;
+	else
+		return fail(text + " has no valid suffix; only 'K', 'M' and 'G' are accepted");
+
+	if (size > (UINT64_MAX >> shift))
+		return fail(text + " is beyond the limits");
+
+	return succeed(size << shift);
+}
+
+/* A share of a CPU, either as a percentage or a number of CPUs: 50% is 0.5, 200% is 2 */
+ResultOrError<uint64_t>
+parseCpuShare(const std::string & text)
+{
+	bool percent = !text.empty() && text.back() == '%';
+	std::string number = percent ? text.substr(0, text.size() - 1) : text;
+
+	double share;
+	size_t end = 0;
+	try {
+		share = std::stod(number, &end);
+	}
+	catch (const std::exception &) {
+		return fail(text + " isn't a valid CPU share");
+	}
+
+	if (end != number.size() || !(share > 0) || share > (percent ? 1e6 : 1e4))
+		return fail(text + " isn't a valid CPU share");
+
+	// in microseconds per 100 ms period, which can't go below a millisecond
+	uint64_t quota = (percent ? share / 100 : share) * 100000;
+	if (quota < 1000)
+		return fail(text + " is below 1% of a CPU");
+
+	return succeed(quota);
+}
+
+/* A whole number, no smaller than minimum and as big as the limit can go */
+ResultOrError<uint64_t>
+parseCount(const std::string & text, uint64_t maximum, uint64_t minimum = 1)
+{
+	if (text.empty() || text.find_first_not_of("0123456789") != std::string::npos)
+		return fail(text + " isn't a valid number");
+
+	uint64_t count;
+	try {
+		count = std::stoull(text);
+	}
+	catch (const std::out_of_range &) {
+		return fail(text + " is beyond the limits");
+	}
+
+	if (count < minimum || count > maximum)
+		return fail(text + " isn't between " + std::to_string(minimum) + " and " + std::to_string(maximum));
+
+	return succeed(count);
+}
+
 ResultOrError<JobOptions>
 jobparsers::mapJobOptions(const OptionsMap & optionsMap)
 {
 	auto nameIter = optionsMap.find("name");
 	auto outputIter = optionsMap.find("output");
 	auto exitIter = optionsMap.find("fail_exit");
+	auto modeIter = optionsMap.find("mode");
+	auto overrunIter = optionsMap.find("overrun");
+	auto recursiveIter = optionsMap.find("recursive");
+	auto debounceIter = optionsMap.find("debounce");
+	auto maxDelayIter = optionsMap.find("max_delay");
+	auto maxSizeIter = optionsMap.find("output_max_size");
+	auto keepIter = optionsMap.find("output_keep");
+	auto rotateIter = optionsMap.find("output_rotate");
+	auto timeoutIter = optionsMap.find("timeout");
+	auto graceIter = optionsMap.find("kill_grace");
+	auto cpuIter = optionsMap.find("cpu_max");
+	auto memoryIter = optionsMap.find("memory_max");
+	auto pidsIter = optionsMap.find("pids_max");
+	auto ioIter = optionsMap.find("io_weight");
+	auto overlapIter = optionsMap.find("overlap");
+	auto concurrencyIter = optionsMap.find("concurrency");
 
 	std::string name = nameIter != optionsMap.end() ? nameIter->second : "unnamed job";
 	std::string output = outputIter != optionsMap.end() ? outputIter->second : "";
@@ -282,9 +760,195 @@ jobparsers::mapJobOptions(const OptionsMap & optionsMap)
 		}
 	}
 
+	RepeatMode mode = FIXED_RATE;
+	if (modeIter != optionsMap.end()) {
+		if (modeIter->second.compare("fixed_rate") == 0) {
+			mode = FIXED_RATE;
+		}
+		else if (modeIter->second.compare("fixed_delay") == 0) {
+			mode = FIXED_DELAY;
+		}
+		else {
+			return fail("Invalid value for option 'mode'; only 'fixed_rate' and 'fixed_delay' are accepted");
+		}
+	}
+
+	OverrunPolicy overrun = SKIP;
+	if (overrunIter != optionsMap.end()) {
+		if (overrunIter->second.compare("catchup") == 0) {
+			overrun = CATCH_UP;
+		}
+		else if (overrunIter->second.compare("skip") == 0) {
+			overrun = SKIP;
+		}
+		else {
+			return fail("Invalid value for option 'overrun'; only 'catchup' and 'skip' are accepted");
+		}
+	}
+
+	bool recursive = false;
+	if (recursiveIter != optionsMap.end()) {
+		if (recursiveIter->second.compare("yes") == 0) {
+			recursive = true;
+		}
+		else if (recursiveIter->second.compare("no") == 0) {
+			recursive = false;
+		}
+		else {
+			return fail("Invalid value for option 'recursive'; only 'yes' and 'no' are accepted");
+		}
+	}
+
+	timeutil::DurationUnit debounce(0);
+	if (debounceIter != optionsMap.end()) {
+		auto durationOrError = timeutil::parseCompactDuration(debounceIter->second);
+		if (durationOrError.failed())
+			return fail("Invalid value for option 'debounce'; " + durationOrError.getError().message);
+
+		debounce = durationOrError.getResult();
+	}
+
+	timeutil::DurationUnit maxDelay(0);
+	if (maxDelayIter != optionsMap.end()) {
+		auto durationOrError = timeutil::parseCompactDuration(maxDelayIter->second);
+		if (durationOrError.failed())
+			return fail("Invalid value for option 'max_delay'; " + durationOrError.getError().message);
+
+		maxDelay = durationOrError.getResult();
+	}
+
+	uint64_t outputMaxSize = 0;
+	if (maxSizeIter != optionsMap.end()) {
+		auto sizeOrError = parseSize(maxSizeIter->second);
+		if (sizeOrError.failed())
+			return fail("Invalid value for option 'output_max_size'; " + sizeOrError.getError().message);
+
+		outputMaxSize = sizeOrError.getResult();
+	}
+
+	// none kept just truncates the output on rotation; each one kept is a rename every time it rotates
+	unsigned outputKeep = 5;
+	if (keepIter != optionsMap.end()) {
+		auto keepOrError = parseCount(keepIter->second, OUTPUT_KEEP_MAX, 0);
+		if (keepOrError.failed())
+			return fail("Invalid value for option 'output_keep'; " + keepOrError.getError().message);
+
+		outputKeep = keepOrError.getResult();
+	}
+
+	timeutil::DurationUnit outputRotate(0);
+	if (rotateIter != optionsMap.end()) {
+		auto durationOrError = timeutil::parseCompactDuration(rotateIter->second);
+		if (durationOrError.failed())
+			return fail("Invalid value for option 'output_rotate'; " + durationOrError.getError().message);
+
+		outputRotate = durationOrError.getResult();
+	}
+
+	timeutil::DurationUnit timeout(0);
+	if (timeoutIter != optionsMap.end()) {
+		auto durationOrError = timeutil::parseCompactDuration(timeoutIter->second);
+		if (durationOrError.failed())
+			return fail("Invalid value for option 'timeout'; " + durationOrError.getError().message);
+
+		timeout = durationOrError.getResult();
+	}
+
+	timeutil::DurationUnit killGrace = std::chrono::seconds(5);
+	if (graceIter != optionsMap.end()) {
+		auto durationOrError = timeutil::parseCompactDuration(graceIter->second);
+		if (durationOrError.failed())
+			return fail("Invalid value for option 'kill_grace'; " + durationOrError.getError().message);
+
+		killGrace = durationOrError.getResult();
+	}
+
+	uint64_t cpuMax = 0;
+	if (cpuIter != optionsMap.end()) {
+		auto quotaOrError = parseCpuShare(cpuIter->second);
+		if (quotaOrError.failed())
+			return fail("Invalid value for option 'cpu_max'; " + quotaOrError.getError().message);
+
+		cpuMax = quotaOrError.getResult();
+	}
+
+	uint64_t memoryMax = 0;
+	if (memoryIter != optionsMap.end()) {
+		auto sizeOrError = parseSize(memoryIter->second);
+		if (sizeOrError.failed())
+			return fail("Invalid value for option 'memory_max'; " + sizeOrError.getError().message);
+		if (sizeOrError.getResult() == 0)
+			return fail("Invalid value for option 'memory_max'; it can't be 0");
+
+		memoryMax = sizeOrError.getResult();
+	}
+
+	uint64_t pidsMax = 0;
+	if (pidsIter != optionsMap.end()) {
+		auto countOrError = parseCount(pidsIter->second, UINT32_MAX);
+		if (countOrError.failed())
+			return fail("Invalid value for option 'pids_max'; " + countOrError.getError().message);
+
+		pidsMax = countOrError.getResult();
+	}
+
+	unsigned ioWeight = 0;
+	if (ioIter != optionsMap.end()) {
+		auto weightOrError = parseCount(ioIter->second, 10000);
+		if (weightOrError.failed())
+			return fail("Invalid value for option 'io_weight'; " + weightOrError.getError().message);
+
+		ioWeight = weightOrError.getResult();
+	}
+
+	OverlapPolicy overlap = OVERLAP_SKIP;
+	if (overlapIter != optionsMap.end()) {
+		if (overlapIter->second.compare("skip") == 0) {
+			overlap = OVERLAP_SKIP;
+		}
+		else if (overlapIter->second.compare("queue") == 0) {
+			overlap = OVERLAP_QUEUE;
+		}
+		else if (overlapIter->second.compare("parallel") == 0) {
+			overlap = OVERLAP_PARALLEL;
+		}
+		else if (overlapIter->second.compare("replace") == 0) {
+			overlap = OVERLAP_REPLACE;
+		}
+		else {
+			return fail("Invalid value for option 'overlap'; only 'skip', 'queue', 'parallel' and 'replace' "
+						"are accepted");
+		}
+	}
+
+	unsigned concurrency = overlap == OVERLAP_PARALLEL ? 0 : 1;
+	if (concurrencyIter != optionsMap.end()) {
+		auto countOrError = parseCount(concurrencyIter->second, 10000);
+		if (countOrError.failed())
+			return fail("Invalid value for option 'concurrency'; " + countOrError.getError().message);
+
+		concurrency = countOrError.getResult();
+	}
+
 	return succeed((JobOptions) {
 		name,
 		output,
-		exit
+		exit,
+		mode,
+		overrun,
+		recursive,
+		debounce,
+		maxDelay,
+		outputMaxSize,
+		outputKeep,
+		outputRotate,
+		timeout,
+		killGrace,
+		cpuMax,
+		memoryMax,
+		pidsMax,
+		ioWeight,
+		overlap,
+		concurrency
 	});
 }
\ No newline at end of file
@@ -5,22 +5,71 @@
 #include <vector>
 #include <map>
 #include <cctype>
+#include <cstdint>
+
+#include <boost/utility/string_view.hpp>
 
 #include "failure.hpp"
+#include "timeutil.h"
 
 typedef std::map<std::string, std::string> OptionsMap;
+typedef boost::string_view StringView;
 
 struct Statement
 {
 	std::string runner;
 	std::vector<std::string> arguments;
+	timeutil::DurationUnit timeout = timeutil::DurationUnit(0); // zero for no limit
+};
+
+enum RepeatMode
+{
+	FIXED_RATE,  // runs start every period, no matter how long they take
+	FIXED_DELAY  // a period is waited after each run ends
+};
+
+/*
+ * What becomes of a fixed-rate run which couldn't start when it was
+ * due, because the timer went off late or the job's last run was
+ * still going and overlap would have dropped it
+ */
+enum OverrunPolicy
+{
+	CATCH_UP, // it's made up, back to back with the others missed, once it can start
+	SKIP      // it's dropped, the next run is at the next deadline to come
+};
+
+/* What a run does when it's due while the job's other runs are still going */
+enum OverlapPolicy
+{
+	OVERLAP_SKIP,     // it's dropped
+	OVERLAP_QUEUE,    // it waits for one of them to end
+	OVERLAP_PARALLEL, // it runs alongside them, only dropped past the concurrency limit
+	OVERLAP_REPLACE   // they're cut short and it runs once they're gone
 };
 
+/* Anything added here has to be cached too, see job-cache.cpp */
 struct JobOptions
 {
 	std::string name;
 	std::string outputFile;
 	bool exitOnFail;
+	RepeatMode mode;
+	OverrunPolicy overrun;
+	bool recursive;
+	timeutil::DurationUnit debounce; // zero runs on every event
+	timeutil::DurationUnit maxDelay; // zero lets a burst go on for good
+	uint64_t outputMaxSize;              // bytes, zero for no limit
+	unsigned outputKeep;
+	timeutil::DurationUnit outputRotate; // zero for no time-based rotation
+	timeutil::DurationUnit timeout;      // for a whole run, zero for no limit
+	timeutil::DurationUnit killGrace;    // between SIGTERM and SIGKILL once time is up
+	uint64_t cpuMax;     // microseconds of CPU time per 100 ms, for a run's processes together
+	uint64_t memoryMax;  // bytes
+	uint64_t pidsMax;
+	unsigned ioWeight;   // 1 to 10000; these four are zero for no limit
+	OverlapPolicy overlap;
+	unsigned concurrency; // runs going at once; 1 unless overlapping in parallel, zero for no limit
 };
 
 struct JobDescription
@@ -36,8 +85,36 @@ struct Job
 	std::vector<Statement> statements;
 };
 
+/* The jobs of a file which parsed, and an error for each one which didn't */
+struct ParsedJobs
+{
+	std::vector<Job> jobs;
+	std::vector<Error> errors; // "line:column: what's wrong"
+};
+
 namespace jobparsers
 {
+	/*
+	 * Each line is scanned once, checked and taken apart as it goes;
+	 * lines and columns start at 1, firstLine is the number text's
+	 * first line has in its file.
+	 */
+	ParsedJobs parseJobs(StringView text, unsigned firstLine = 1);
+	ResultOrError<JobDescription> parseDescription(StringView line, unsigned lineNumber);
+	ResultOrError<Statement> parseStatement(StringView text, unsigned lineNumber, unsigned firstColumn);
+
+	/*
+	 * Where the first job starting at or after from is, text.size() if
+	 * there's none; text can be split there and both parts parsed on
+	 * their own.
+	 */
+	size_t nextJobBoundary(StringView text, size_t from);
+
+	/* How many jobs text describes, whether or not they'd parse */
+	size_t countJobs(StringView text);
+
+	/* ---------- */
+
 	struct ExtractionResult
 	{
 		const std::string extractedText;
@@ -68,7 +145,8 @@ namespace jobparsers
 	bool validateStatementString(const std::string & statementString);
 	std::vector<std::string> extractJobStatements(const std::string & body);
 	ExtractionResult extractCommand(const std::string & statementText);
-	Statement parseStatement(const std::string & statementText);
+	std::vector<std::string> splitWords(const std::string & text);
+	ResultOrError<Statement> parseStatement(const std::string & statementText);
 
 	/* ---------- */
 	
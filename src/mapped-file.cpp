@@ -0,0 +1,244 @@
+#include <algorithm>
+#include <iterator>
+#include <cstring>
+#include <cerrno>
+#include <mutex>
+#include <condition_variable>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mapped-file.h"
+#include "executor.h"
+
+using namespace jobparsers;
+
+/* About how much of a file a block is, a job is never cut in two */
+const size_t PARSE_BLOCK = 256 * 1024;
+
+struct Block
+{
+	size_t start;
+	size_t end;
+	unsigned firstLine;
+};
+
+std::vector<Block>
+splitBlocks(StringView text)
+{
+	std::vector<Block> blocks;
+	unsigned firstLine = 1;
+	size_t start = 0;
+
+	while (start < text.size()) {
+		size_t end = nextJobBoundary(text, std::min(start + PARSE_BLOCK, text.size()));
+		blocks.push_back(Block { start, end, firstLine });
+
+		firstLine += std::count(text.begin() + start, text.begin() + end, '\n');
+		start = end;
+	}
+
+	return blocks;
+}
+
+Error
+fileError(const std::string & what, const std::string & path)
+{
+	int error = errno;
+	return Error(error, "Couldn't " + what + " '" + path + "': " + std::strerror(error));
+}
+
+/* What can't be mapped is read whole, growing the buffer as it goes */
+ResultOrError<std::pair<char *, size_t>>
+readWhole(int fd, const std::string & path)
+{
+	size_t capacity = 64 * 1024;
+	size_t size = 0;
+	char * buffer = new char[capacity];
+
+	while (1) {
+		if (size == capacity) {
+			char * larger = new char[capacity * 2];
+			std::memcpy(larger, buffer, size);
+			delete[] buffer;
+			buffer = larger;
+			capacity *= 2;
+		}
+
+		ssize_t got = read(fd, buffer + size, capacity - size);
+		if (got < 0 && errno == EINTR)
+			continue;
+
+		if (got < 0) {
+			delete[] buffer;
+			return fail(fileError("read", path));
+		}
+
+		if (got == 0)
+			break;
+
+		size += got;
+	}
+
+	return succeed(std::make_pair(buffer, size));
+}
+
+MappedFile::MappedFile(const char * data, size_t size, bool mapped):
+	m_data(data), m_size(size), m_mapped(mapped) {}
+
+MappedFile::~MappedFile()
+{
+	if (m_mapped)
+		munmap(const_cast<char *>(m_data), m_size);
+	else
+		delete[] m_data;
+}
+
+ResultOrError<std::shared_ptr<MappedFile>>
+MappedFile::open(const std::string & path)
+{
+	int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return fail(fileError("open", path));
+
+	struct stat info;
+	if (fstat(fd, &info) < 0) {
+		Error error = fileError("stat", path);
+		close(fd);
+		return fail(error);
+	}
+
+	// an empty file can't be mapped, there's nothing to map anyway
+	if (S_ISREG(info.st_mode) && info.st_size > 0) {
+		void * data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data != MAP_FAILED) {
+			close(fd);
+
+			// it's read once front to back, the kernel can read ahead and drop pages behind
+			madvise(data, info.st_size, MADV_SEQUENTIAL);
+
+			return succeed(std::shared_ptr<MappedFile>(
+				new MappedFile(static_cast<const char *>(data), info.st_size, true)));
+		}
+	}
+
+	auto contents = readWhole(fd, path);
+	close(fd);
+
+	if (contents.failed())
+		return fail(contents.getError());
+
+	return succeed(std::shared_ptr<MappedFile>(
+		new MappedFile(contents.getResult().first, contents.getResult().second, false)));
+}
+
+ResultOrError<std::shared_ptr<MappedFile>>
+MappedFile::read(const std::string & path)
+{
+	int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return fail(fileError("open", path));
+
+	auto contents = readWhole(fd, path);
+	close(fd);
+
+	if (contents.failed())
+		return fail(contents.getError());
+
+	return succeed(std::shared_ptr<MappedFile>(
+		new MappedFile(contents.getResult().first, contents.getResult().second, false)));
+}
+
+StringView
+MappedFile::text() const
+{
+	return StringView(m_data, m_size);
+}
+
+bool
+MappedFile::mapped() const
+{
+	return m_mapped;
+}
+
+void
+MappedFile::release(size_t from, size_t to)
+{
+	if (!m_mapped)
+		return;
+
+	// whole pages only, the ones at either end might still be needed
+	size_t pageSize = sysconf(_SC_PAGESIZE);
+	size_t first = (from + pageSize - 1) / pageSize * pageSize;
+	size_t last = std::min(to, m_size) / pageSize * pageSize;
+
+	if (last > first)
+		madvise(const_cast<char *>(m_data) + first, last - first, MADV_DONTNEED);
+}
+
+ParsedJobs
+jobparsers::parseJobFile(MappedFile & file, unsigned workers)
+{
+	StringView text = file.text();
+	std::vector<Block> blocks = splitBlocks(text);
+
+	ParsedJobs parsed;
+	parsed.jobs.reserve(countJobs(text));
+	file.release(0, text.size());
+
+	std::vector<ParsedJobs> blockJobs(blocks.size());
+
+	auto parseBlock = [&](size_t index) {
+		const Block & block = blocks.at(index);
+		blockJobs.at(index) = parseJobs(text.substr(block.start, block.end - block.start), block.firstLine);
+		file.release(block.start, block.end);
+	};
+
+	auto mergeBlock = [&](size_t index) {
+		ParsedJobs & parsedBlock = blockJobs.at(index);
+		std::move(parsedBlock.jobs.begin(), parsedBlock.jobs.end(), std::back_inserter(parsed.jobs));
+		std::move(parsedBlock.errors.begin(), parsedBlock.errors.end(), std::back_inserter(parsed.errors));
+		parsedBlock = ParsedJobs();
+	};
+
+	if (workers <= 1 || blocks.size() <= 1) {
+		for (size_t i = 0; i < blocks.size(); i++) {
+			parseBlock(i);
+			mergeBlock(i);
+		}
+
+		return parsed;
+	}
+
+	std::vector<bool> done(blocks.size(), false);
+	std::mutex mutex;
+	std::condition_variable blockDone;
+
+	scheduling::WorkerPool pool(std::min<size_t>(workers, blocks.size()), blocks.size(), scheduling::QUEUE);
+	pool.start();
+
+	for (size_t i = 0; i < blocks.size(); i++) {
+		pool.submit(nullptr, [&, i]() {
+			parseBlock(i);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			done[i] = true;
+			blockDone.notify_all();
+		});
+	}
+
+	// merged as soon as they're next in line, the blocks' own vectors don't pile up
+	for (size_t i = 0; i < blocks.size(); i++) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			blockDone.wait(lock, [&done, i]() { return done[i]; });
+		}
+
+		mergeBlock(i);
+	}
+
+	pool.stop();
+	return parsed;
+}
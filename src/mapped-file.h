@@ -0,0 +1,62 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <string>
+#include <memory>
+
+#include "failure.hpp"
+#include "jobs.h"
+
+namespace jobparsers
+{
+	/*
+	 * A job file mapped read-only into memory, so that parsing goes
+	 * over the page cache itself: lines are only views into it and the
+	 * jobs built from them are all that gets copied. Anything which
+	 * can't be mapped (a pipe, /dev/stdin) is read into a buffer of
+	 * its own instead. The text is gone once the file is.
+	 */
+	class MappedFile
+	{
+	public:
+		static ResultOrError<std::shared_ptr<MappedFile>> open(const std::string & path);
+
+		/*
+		 * Always reads the file into a buffer; a mapping of a file
+		 * someone truncates while it's looked at faults (SIGBUS) past
+		 * the new end, a copy stays as it was read.
+		 */
+		static ResultOrError<std::shared_ptr<MappedFile>> read(const std::string & path);
+
+		MappedFile(const MappedFile &) = delete;
+		MappedFile & operator=(const MappedFile &) = delete;
+		~MappedFile();
+
+		StringView text() const;
+		bool mapped() const;
+
+		/*
+		 * Lets go of the whole pages between from and to; they're still
+		 * in the page cache, just not counted against us, and read back
+		 * from there if they're looked at again.
+		 */
+		void release(size_t from, size_t to);
+
+	private:
+		MappedFile(const char * data, size_t size, bool mapped);
+
+		const char * m_data;
+		size_t m_size;
+		bool m_mapped; // otherwise m_data was allocated with new[]
+	};
+
+	/*
+	 * Parses file in blocks cut at job boundaries, each released once
+	 * its jobs are out. With more than one worker the blocks are parsed
+	 * on a pool of their own and merged back as they're done, in the
+	 * order they're in in the file, errors included.
+	 */
+	ParsedJobs parseJobFile(MappedFile & file, unsigned workers = 1);
+}
+
+#endif
@@ -0,0 +1,374 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+
+#include "output.h"
+#include "util.hpp"
+
+using namespace output;
+
+// past this much unwritten output a file's pipes stop being read
+const size_t MAX_PENDING = 4 * 1024 * 1024;
+
+const size_t READ_CHUNK = 64 * 1024;
+// one busy pipe shouldn't keep the loop from everything else
+const int MAX_READS_PER_WAKEUP = 16;
+const int PIPE_SIZE = 1024 * 1024;
+
+OutputFile::OutputFile(OutputWriter & writer, const std::string & path, const RotationPolicy & policy):
+	m_writer(writer), m_path(path), m_policy(policy), m_fd(-1), m_size(0)
+{
+	openFile();
+}
+
+void
+OutputFile::openFile()
+{
+	m_fd = ::open(m_path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	m_started = std::chrono::steady_clock::now();
+	m_size = 0;
+
+	if (m_fd < 0) {
+		printerr("Couldn't open output file " + m_path + ": " + std::strerror(errno));
+		return;
+	}
+
+	// appending to what an earlier run left
+	struct stat info;
+	if (fstat(m_fd, &info) == 0)
+		m_size = info.st_size;
+}
+
+bool
+OutputFile::rotationDue(size_t batchSize) const
+{
+	if (m_size == 0)
+		return false;
+
+	if (m_policy.maxSize > 0 && m_size + batchSize > m_policy.maxSize)
+		return true;
+
+	return m_policy.interval > std::chrono::milliseconds::zero() 
+		   && std::chrono::steady_clock::now() - m_started >= m_policy.interval;
+}
+
+/* path.<keep> drops off, everything else moves one up and path becomes path.1 */
+void
+OutputFile::rotate()
+{
+	if (m_fd >= 0)
+		close(m_fd);
+
+	if (m_policy.keep == 0) {
+		unlink(m_path.c_str());
+	}
+	else {
+		for (unsigned i = m_policy.keep - 1; i >= 1; i--) {
+			std::string from = m_path + "." + std::to_string(i);
+			std::string to = m_path + "." + std::to_string(i + 1);
+			rename(from.c_str(), to.c_str());
+		}
+
+		if (rename(m_path.c_str(), (m_path + ".1").c_str()) != 0)
+			printerr("Couldn't rotate output file " + m_path + ": " + std::strerror(errno));
+	}
+
+	openFile();
+}
+
+OutputFile::~OutputFile()
+{
+	if (m_fd >= 0)
+		close(m_fd);
+}
+
+bool
+OutputFile::append(const char * data, size_t length)
+{
+	std::lock_guard<std::mutex> lock(m_writer.m_mutex);
+
+	bool wasEmpty = m_pending.empty();
+	m_pending.insert(m_pending.end(), data, data + length);
+
+	if (wasEmpty) {
+		m_writer.m_dirty.push_back(shared_from_this());
+		m_writer.m_changed.notify_one();
+	}
+
+	return m_pending.size() < MAX_PENDING;
+}
+
+void
+OutputFile::whenRoom(std::function<void()> callback)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_writer.m_mutex);
+		if (m_pending.size() >= MAX_PENDING) {
+			m_waitingForRoom.push_back(std::move(callback));
+			return;
+		}
+	}
+
+	callback();
+}
+
+const std::string &
+OutputFile::path() const
+{
+	return m_path;
+}
+
+/* ---------- */
+
+OutputWriter::OutputWriter():
+	m_stopping(false) {}
+
+OutputWriter::~OutputWriter()
+{
+	stop();
+}
+
+std::shared_ptr<OutputFile>
+OutputWriter::open(const std::string & path, const RotationPolicy & policy)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	std::shared_ptr<OutputFile> file = m_files[path].lock();
+	if (file == nullptr) {
+		file = std::make_shared<OutputFile>(*this, path, policy);
+		m_files[path] = file;
+	}
+
+	return file;
+}
+
+void
+OutputWriter::start()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_thread.joinable())
+		return;
+
+	m_stopping = false;
+	m_thread = std::thread(&OutputWriter::write, this);
+}
+
+void
+OutputWriter::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+		m_changed.notify_one();
+	}
+
+	if (m_thread.joinable())
+		m_thread.join();
+}
+
+/*
+ * Whatever piled up in a file's buffer while the last batch was being
+ * written goes out in one write, so the busier the output the bigger 
+ * the batches.
+ */
+void
+OutputWriter::write()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	std::vector<std::shared_ptr<OutputFile>> dirty;
+	std::vector<std::vector<char>> batches;
+	std::vector<std::function<void()>> waitingForRoom;
+
+	while (1) {
+		m_changed.wait(lock, [this]() { return !m_dirty.empty() || m_stopping; });
+		if (m_dirty.empty())
+			break;
+
+		dirty.swap(m_dirty);
+		batches.resize(dirty.size());
+
+		for (size_t i = 0; i < dirty.size(); i++) {
+			batches[i].swap(dirty[i]->m_pending);
+
+			auto & waiting = dirty[i]->m_waitingForRoom;
+			waitingForRoom.insert(waitingForRoom.end(), waiting.begin(), waiting.end());
+			waiting.clear();
+		}
+
+		lock.unlock();
+
+		for (size_t i = 0; i < dirty.size(); i++) {
+			writeBatch(*dirty[i], batches[i]);
+			batches[i].clear();
+		}
+
+		for (auto & callback : waitingForRoom)
+			callback();
+
+		dirty.clear();
+		waitingForRoom.clear();
+
+		lock.lock();
+	}
+}
+
+void
+OutputWriter::writeBatch(OutputFile & file, const std::vector<char> & batch)
+{
+	if (file.rotationDue(batch.size()))
+		file.rotate();
+
+	// there's nowhere to write it, but the children weren't held up for that
+	if (file.m_fd < 0)
+		return;
+
+	size_t written = 0;
+
+	while (written < batch.size()) {
+		ssize_t result = ::write(file.m_fd, batch.data() + written, batch.size() - written);
+		if (result < 0 && errno == EINTR)
+			continue;
+
+		if (result < 0) {
+			printerr("Couldn't write to output file " + file.path() + ": " + std::strerror(errno));
+			return;
+		}
+
+		written += result;
+		file.m_size += result;
+	}
+}
+
+/* ---------- */
+
+std::shared_ptr<Capture>
+Capture::open(scheduling::EventLoop & loop, std::shared_ptr<OutputFile> file)
+{
+	// neither end may leak into children spawned meanwhile, or the end of the pipe never comes
+	int ends[2];
+	if (pipe2(ends, O_CLOEXEC) != 0)
+		return nullptr;
+
+	fcntl(ends[0], F_SETFL, O_NONBLOCK);
+
+	// a bigger pipe means fewer wakeups for chatty children; it's fine if the limit says no
+	fcntl(ends[0], F_SETPIPE_SZ, PIPE_SIZE);
+
+	std::shared_ptr<Capture> capture(new Capture(loop, file, ends[0], ends[1]));
+	if (!capture->listen())
+		return nullptr;
+
+	return capture;
+}
+
+Capture::Capture(scheduling::EventLoop & loop, std::shared_ptr<OutputFile> file, int readEnd, int writeEnd):
+	m_loop(loop), m_file(file), m_readEnd(readEnd), m_writeEnd(writeEnd), m_drained(false) {}
+
+Capture::~Capture()
+{
+	if (m_readEnd >= 0)
+		close(m_readEnd);
+	if (m_writeEnd >= 0)
+		close(m_writeEnd);
+}
+
+int
+Capture::childEnd() const
+{
+	return m_writeEnd;
+}
+
+void
+Capture::closeChildEnd()
+{
+	if (m_writeEnd >= 0)
+		close(m_writeEnd);
+	m_writeEnd = -1;
+}
+
+bool
+Capture::waitDrained(std::chrono::milliseconds timeout)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	return m_drainedChanged.wait_for(lock, timeout, [this]() { return m_drained; });
+}
+
+void
+Capture::whenDrained(std::function<void()> callback)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_drained) {
+			m_whenDrained.push_back(std::move(callback));
+			return;
+		}
+	}
+
+	callback();
+}
+
+/* The loop keeps the capture alive for as long as it listens */
+bool
+Capture::listen()
+{
+	std::shared_ptr<Capture> self = shared_from_this();
+	return m_loop.add(m_readEnd, EPOLLIN, [self](uint32_t) {
+		self->readable();
+	});
+}
+
+void
+Capture::readable()
+{
+	char buffer[READ_CHUNK];
+
+	for (int reads = 0; reads < MAX_READS_PER_WAKEUP; reads++) {
+		ssize_t length = read(m_readEnd, buffer, sizeof(buffer));
+
+		if (length > 0) {
+			if (m_file->append(buffer, length))
+				continue;
+
+			// the writer is behind, the child waits on a full pipe until it catches up
+			m_loop.remove(m_readEnd);
+
+			std::shared_ptr<Capture> self = shared_from_this();
+			m_file->whenRoom([self]() {
+				self->listen();
+			});
+			return;
+		}
+
+		if (length < 0 && errno == EINTR)
+			continue;
+		if (length < 0 && errno == EAGAIN)
+			return;
+
+		finish();
+		return;
+	}
+}
+
+void
+Capture::finish()
+{
+	m_loop.remove(m_readEnd);
+	close(m_readEnd);
+	m_readEnd = -1;
+
+	std::vector<std::function<void()>> callbacks;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_drained = true;
+		m_drainedChanged.notify_all();
+		callbacks.swap(m_whenDrained);
+	}
+
+	for (auto & callback : callbacks)
+		callback();
+}
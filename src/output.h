@@ -0,0 +1,141 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+
+#include "event-loop.h"
+
+namespace output
+{
+	class OutputWriter;
+
+	/* When an output file is moved aside for a fresh one */
+	struct RotationPolicy
+	{
+		uint64_t maxSize = 0;                                       // zero for no limit
+		unsigned keep = 5;                                          // rotated files kept, as path.1 to path.<keep>
+		std::chrono::milliseconds interval = std::chrono::milliseconds(0); // zero for no time-based rotation
+	};
+
+	/*
+	 * A job's output file. Whatever is read from the statements' pipes
+	 * is appended to a buffer here and written out in batches by the
+	 * writer's thread, so nothing reading a pipe ever waits on the disk.
+	 * Rotation happens on that thread too, right before a batch which
+	 * would take the file past its size or age.
+	 */
+	class OutputFile : public std::enable_shared_from_this<OutputFile>
+	{
+	public:
+		OutputFile(OutputWriter & writer, const std::string & path, const RotationPolicy & policy);
+		~OutputFile();
+
+		/* Returns false once too much is buffered, until then there's room */
+		bool append(const char * data, size_t length);
+
+		/* Called (right away if there's room already) once the buffer has been written out */
+		void whenRoom(std::function<void()> callback);
+
+		const std::string & path() const;
+
+	private:
+		friend class OutputWriter;
+
+		void openFile();
+		bool rotationDue(size_t batchSize) const;
+		void rotate();
+
+		OutputWriter & m_writer;
+		const std::string m_path;
+		const RotationPolicy m_policy;
+
+		// only touched by the writer's thread
+		int m_fd;
+		uint64_t m_size;
+		std::chrono::steady_clock::time_point m_started;
+
+		// guarded by the writer's mutex
+		std::vector<char> m_pending;
+		std::vector<std::function<void()>> m_waitingForRoom;
+	};
+
+	/* The thread all output files are written from */
+	class OutputWriter
+	{
+	public:
+		OutputWriter();
+		~OutputWriter();
+
+		/* Jobs sharing an output file share one buffer, and the first one's rotation policy */
+		std::shared_ptr<OutputFile> open(const std::string & path, const RotationPolicy & policy = RotationPolicy());
+
+		void start();
+		/* Writes out whatever is still buffered */
+		void stop();
+
+	private:
+		friend class OutputFile;
+
+		void write();
+		void writeBatch(OutputFile & file, const std::vector<char> & batch);
+
+		std::unordered_map<std::string, std::weak_ptr<OutputFile>> m_files;
+		std::vector<std::shared_ptr<OutputFile>> m_dirty;
+
+		bool m_stopping;
+		std::mutex m_mutex;
+		std::condition_variable m_changed;
+		std::thread m_thread;
+	};
+
+	/*
+	 * A pipe a statement writes its stdout and stderr to, read on the
+	 * event loop in large chunks into the job's output file. Reading
+	 * pauses while the file's buffer is full, which leaves the child 
+	 * waiting on a full pipe rather than memory growing.
+	 */
+	class Capture : public std::enable_shared_from_this<Capture>
+	{
+	public:
+		static std::shared_ptr<Capture> open(scheduling::EventLoop & loop, std::shared_ptr<OutputFile> file);
+		~Capture();
+
+		/* The end the child gets as stdout and stderr */
+		int childEnd() const;
+		/* Once the child has it, so its exit is seen as the end of the pipe */
+		void closeChildEnd();
+
+		/* Whether everything the child wrote was read within the timeout */
+		bool waitDrained(std::chrono::milliseconds timeout);
+		/* The same without waiting, callback runs once it's the case (right away if it is) */
+		void whenDrained(std::function<void()> callback);
+
+	private:
+		Capture(scheduling::EventLoop & loop, std::shared_ptr<OutputFile> file, int readEnd, int writeEnd);
+
+		bool listen();
+		void readable();
+		void finish();
+
+		scheduling::EventLoop & m_loop;
+		std::shared_ptr<OutputFile> m_file;
+		int m_readEnd;
+		int m_writeEnd;
+
+		bool m_drained;
+		std::vector<std::function<void()>> m_whenDrained;
+		std::mutex m_mutex;
+		std::condition_variable m_drainedChanged;
+	};
+}
+
+#endif
@@ -0,0 +1,371 @@
+#include <spawn.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <linux/sched.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include <memory>
+
+#include "process.h"
+#include "zygote.h"
+
+extern char ** environ;
+
+/* The inherited environment, with the extra variables replacing any of the same name */
+std::vector<std::string>
+mergeEnvironment(const processes::Environment & environment)
+{
+	std::vector<std::string> variables;
+
+	for (char ** entry = environ; *entry != nullptr; entry++) {
+		const char * equals = std::strchr(*entry, '=');
+		std::string name = equals != nullptr ? std::string(*entry, equals - *entry) : *entry;
+
+		if (environment.count(name) == 0)
+			variables.push_back(*entry);
+	}
+
+	for (const auto & variable : environment)
+		variables.push_back(variable.first + "=" + variable.second);
+
+	return variables;
+}
+
+std::vector<char *>
+toPointers(const std::vector<std::string> & strings)
+{
+	std::vector<char *> pointers;
+	pointers.reserve(strings.size() + 1);
+
+	for (const auto & string : strings)
+		pointers.push_back(const_cast<char *>(string.c_str()));
+	pointers.push_back(nullptr);
+
+	return pointers;
+}
+
+/* What a child started into a control group sends back before it execs, if anything went wrong */
+struct ChildReport
+{
+	int32_t joining; // whether it's about joining the group, which the child goes on without
+	int32_t error;
+};
+
+void
+report(int pipe, bool joining, int error)
+{
+	ChildReport childReport { joining, error };
+	while (write(pipe, &childReport, sizeof(childReport)) < 0 && errno == EINTR) {}
+}
+
+/* Whether a child can be cloned as a copy of this process, see forkStarts() */
+bool forkingStarts = false;
+
+/*
+ * The child's side, between the clone and the exec; it either runs on
+ * a copy of the parent or shares its memory until the exec, so only
+ * async-signal-safe calls go in here and nothing outside its stack
+ * is written.
+ */
+[[noreturn]] void
+execChild(const char * path, char * const * argv, char * const * envp, int output, bool ownGroup,
+		  int joinGroup, int pipe)
+{
+	// a handler of the parent's would run on memory which is still the parent's
+	for (int signal = 1; signal < NSIG; signal++) {
+		struct sigaction action;
+		if (sigaction(signal, nullptr, &action) == 0 && action.sa_handler != SIG_DFL && action.sa_handler != SIG_IGN) {
+			action.sa_handler = SIG_DFL;
+			action.sa_flags = 0;
+			sigaction(signal, &action, nullptr);
+		}
+	}
+
+	if (joinGroup >= 0) {
+		int procs = openat(joinGroup, "cgroup.procs", O_WRONLY | O_CLOEXEC);
+
+		// "0" is whoever writes it
+		if (procs < 0 || write(procs, "0", 1) < 0)
+			report(pipe, true, errno);
+	}
+
+	if (ownGroup)
+		setpgid(0, 0);
+
+	if (output >= 0) {
+		dup2(output, STDOUT_FILENO);
+		dup2(output, STDERR_FILENO);
+
+		// dup2() onto itself leaves close-on-exec as it was
+		if (output <= STDERR_FILENO)
+			fcntl(output, F_SETFD, 0);
+	}
+
+	sigset_t noSignals;
+	sigemptyset(&noSignals);
+	sigprocmask(SIG_SETMASK, &noSignals, nullptr);
+
+	execve(path, argv, envp);
+
+	report(pipe, false, errno);
+	_exit(127);
+}
+
+/* A fork-like clone which starts out in cgroup; -1 where the kernel or the group doesn't allow it */
+pid_t
+cloneIntoGroup(int cgroup)
+{
+#if defined(SYS_clone3) && defined(CLONE_INTO_CGROUP)
+	clone_args args;
+	std::memset(&args, 0, sizeof(args));
+	args.flags = CLONE_INTO_CGROUP;
+	args.exit_signal = SIGCHLD;
+	args.cgroup = cgroup;
+
+	return syscall(SYS_clone3, &args, sizeof(args));
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+/* What a child sharing our memory starts with, on the stack it was given */
+struct SharedStart
+{
+	const char * path;
+	char * const * argv;
+	char * const * envp;
+	int output;
+	bool ownGroup;
+	int joinGroup;
+	int pipe;
+};
+
+int
+sharedChild(void * argument)
+{
+	const SharedStart & start = *static_cast<const SharedStart *>(argument);
+	execChild(start.path, start.argv, start.envp, start.output, start.ownGroup, start.joinGroup, start.pipe);
+}
+
+/*
+ * Like posix_spawn: the child shares our memory, on a stack of its
+ * own, and we're held up until it execs, so nothing is copied
+ * however big and threaded this process is. It writes itself into
+ * the group before the exec.
+ */
+pid_t
+cloneSharing(const char * path, char * const * argv, char * const * envp, int output, bool ownGroup,
+			 int cgroup, int pipe)
+{
+	const size_t STACK_SIZE = 64 * 1024;
+	std::unique_ptr<char[]> stack(new char[STACK_SIZE]);
+	SharedStart start { path, argv, envp, output, ownGroup, cgroup, pipe };
+
+	// none of our handlers may run in the child before it's reset them
+	sigset_t allSignals, mask;
+	sigfillset(&allSignals);
+	pthread_sigmask(SIG_SETMASK, &allSignals, &mask);
+
+	pid_t pid = clone(sharedChild, stack.get() + STACK_SIZE, CLONE_VM | CLONE_VFORK | SIGCHLD, &start);
+	int error = errno;
+
+	pthread_sigmask(SIG_SETMASK, &mask, nullptr);
+	errno = error;
+	return pid;
+}
+
+/* posix_spawn can't place the child anywhere, this clones and execs by hand instead */
+ResultOrError<pid_t>
+startInGroup(const std::string & path, char * const * argv, char * const * envp, int output, bool ownGroup,
+			 int cgroup, bool & placed)
+{
+	int pipes[2];
+	if (pipe2(pipes, O_CLOEXEC) < 0) {
+		int error = errno;
+		return fail(Error(error, "Couldn't start '" + path + "': " + std::strerror(error)));
+	}
+
+	pid_t pid;
+	if (forkingStarts) {
+		// copying the zygote is cheap; the child writes itself in when it couldn't be cloned right into the group
+		int joinGroup = -1;
+		pid = cloneIntoGroup(cgroup);
+
+		if (pid < 0) {
+			joinGroup = cgroup;
+			pid = fork();
+		}
+
+		if (pid == 0) {
+			close(pipes[0]);
+			execChild(path.c_str(), argv, envp, output, ownGroup, joinGroup, pipes[1]);
+		}
+	}
+	else {
+		pid = cloneSharing(path.c_str(), argv, envp, output, ownGroup, cgroup, pipes[1]);
+	}
+
+	int error = errno;
+	close(pipes[1]);
+
+	if (pid < 0) {
+		close(pipes[0]);
+		return fail(Error(error, "Couldn't start '" + path + "': " + std::strerror(error)));
+	}
+
+	// the pipe closes with the exec, or with the child if it never got there
+	placed = true;
+	int execError = 0;
+	ChildReport childReport;
+	ssize_t size;
+
+	while ((size = read(pipes[0], &childReport, sizeof(childReport))) != 0) {
+		if (size < 0 && errno == EINTR)
+			continue;
+		if (size != sizeof(childReport))
+			break;
+
+		if (childReport.joining)
+			placed = false;
+		else
+			execError = childReport.error;
+	}
+	close(pipes[0]);
+
+	if (execError != 0) {
+		while (waitpid(pid, nullptr, 0) < 0 && errno == EINTR) {}
+		return fail(Error(execError, "Couldn't start '" + path + "': " + std::strerror(execError)));
+	}
+
+	return succeed(pid);
+}
+
+void
+processes::forkStarts()
+{
+	forkingStarts = true;
+}
+
+ResultOrError<pid_t>
+processes::start(const std::string & path, const std::vector<std::string> & arguments,
+				 const Environment & environment, int output, bool ownGroup, int cgroup, bool * placed)
+{
+	if (!zygote().running())
+		return startDirectly(path, arguments, environment, output, ownGroup, cgroup, placed);
+
+	ResultOrError<pid_t> started = zygote().start(path, arguments, environment, output, ownGroup, cgroup, placed);
+
+	// the zygote is gone, or the request is too big to hand over
+	if (started.failed() && (started.getError().code == ENOTCONN || started.getError().code == EMSGSIZE))
+		return startDirectly(path, arguments, environment, output, ownGroup, cgroup, placed);
+
+	return started;
+}
+
+ResultOrError<pid_t>
+processes::startDirectly(const std::string & path, const std::vector<std::string> & arguments,
+						 const Environment & environment, int output, bool ownGroup, int cgroup, bool * placed)
+{
+	if (placed != nullptr)
+		*placed = false;
+
+	if (arguments.empty())
+		return fail("Needs at least one argument");
+
+	std::vector<char *> argv = toPointers(arguments);
+
+	// most statements add nothing, their children can take environ as it is
+	std::vector<std::string> variables;
+	std::vector<char *> envp;
+	if (!environment.empty()) {
+		variables = mergeEnvironment(environment);
+		envp = toPointers(variables);
+	}
+
+	if (cgroup >= 0) {
+		bool joined = false;
+		ResultOrError<pid_t> started = startInGroup(path, argv.data(), environment.empty() ? environ : envp.data(),
+													output, ownGroup, cgroup, joined);
+		if (placed != nullptr)
+			*placed = joined;
+
+		return started;
+	}
+
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+
+	if (output >= 0) {
+		posix_spawn_file_actions_adddup2(&actions, output, STDOUT_FILENO);
+		posix_spawn_file_actions_adddup2(&actions, output, STDERR_FILENO);
+	}
+
+	// the zygote blocks SIGCHLD, its children shouldn't start out that way
+	posix_spawnattr_t attributes;
+	posix_spawnattr_init(&attributes);
+
+	sigset_t noSignals;
+	sigemptyset(&noSignals);
+	posix_spawnattr_setsigmask(&attributes, &noSignals);
+
+	short flags = POSIX_SPAWN_SETSIGMASK;
+	if (ownGroup) {
+		posix_spawnattr_setpgroup(&attributes, 0);
+		flags |= POSIX_SPAWN_SETPGROUP;
+	}
+	posix_spawnattr_setflags(&attributes, flags);
+
+	pid_t pid;
+	int error = posix_spawn(&pid, path.c_str(), &actions, &attributes, argv.data(), 
+							environment.empty() ? environ : envp.data());
+	posix_spawn_file_actions_destroy(&actions);
+	posix_spawnattr_destroy(&attributes);
+	if (error != 0) {
+		std::string message = "Couldn't start '" + path + "': " + std::strerror(error);
+		return fail(Error(error, message));
+	}
+
+	return succeed(pid);
+}
+
+ResultOrError<int>
+processes::wait(pid_t pid)
+{
+	if (zygote().owns(pid))
+		return zygote().wait(pid);
+
+	int status;
+
+	while (waitpid(pid, &status, 0) < 0) {
+		if (errno != EINTR)
+			return fail(std::string("Couldn't wait for the process: ") + std::strerror(errno));
+	}
+
+	return succeed(exitCode(status));
+}
+
+int
+processes::exitCode(int status)
+{
+	if (WIFSIGNALED(status))
+		return 128 + WTERMSIG(status);
+
+	return WEXITSTATUS(status);
+}
+
+ResultOrError<int>
+processes::run(const std::string & path, const std::vector<std::string> & arguments,
+			   const Environment & environment, int output, bool ownGroup)
+{
+	return start(path, arguments, environment, output, ownGroup)
+			.mapSuccess<int>([](const pid_t & pid) {
+				return wait(pid);
+			});
+}
@@ -0,0 +1,74 @@
+#ifndef PROCESS_H
+#define PROCESS_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+
+#include <sys/types.h>
+#include <sys/resource.h>
+
+#include "failure.hpp"
+
+namespace processes
+{
+	/* Variables added to the environment a process inherits */
+	typedef std::map<std::string, std::string> Environment;
+
+	/* How a process ended and what it used */
+	struct ProcessExit
+	{
+		pid_t pid;
+		int code; // the exit code, 128 plus the signal, or -1 if its end was never seen
+		rusage usage;
+	};
+
+	typedef std::function<void(const ProcessExit &)> ExitCallback;
+
+	/*
+	 * Starts the program at path with arguments as its argv, as they
+	 * are; no shell is involved and nothing gets split again. Goes 
+	 * through posix_spawn, which glibc implements with vfork-style 
+	 * clone, so the parent's memory is never copied. An output
+	 * descriptor, if given, becomes the child's stdout and stderr.
+	 * With ownGroup the child leads a process group of its own, so
+	 * it can be signalled along with whatever it started.
+	 * Once the zygote is launched the spawning is left to it.
+	 *
+	 * A cgroup directory descriptor, if given, is the control group
+	 * the child starts out in, before it execs: it shares our memory
+	 * until then, as with posix_spawn, and writes itself into the
+	 * group's cgroup.procs. In the zygote it's cloned right into the
+	 * group with clone3(CLONE_INTO_CGROUP) instead, where the kernel
+	 * can. placed tells whether either worked; if not, the child runs
+	 * anyway and it's up to the caller to move it in.
+	 */
+	ResultOrError<pid_t> start(const std::string & path, const std::vector<std::string> & arguments,
+							   const Environment & environment = Environment(), int output = -1,
+							   bool ownGroup = false, int cgroup = -1, bool * placed = nullptr);
+
+	/* Spawns from this process, whether or not there is a zygote */
+	ResultOrError<pid_t> startDirectly(const std::string & path, const std::vector<std::string> & arguments,
+									   const Environment & environment = Environment(), int output = -1,
+									   bool ownGroup = false, int cgroup = -1, bool * placed = nullptr);
+
+	/*
+	 * Lets starts into a cgroup copy this process with a fork-like
+	 * clone3(CLONE_INTO_CGROUP); only for one which is small and
+	 * single-threaded, as the zygote is.
+	 */
+	void forkStarts();
+
+	/* The exit code, or 128 plus the signal which ended the process */
+	ResultOrError<int> wait(pid_t pid);
+
+	/* The same, out of a status wait() and the like returned */
+	int exitCode(int status);
+
+	ResultOrError<int> run(const std::string & path, const std::vector<std::string> & arguments,
+						   const Environment & environment = Environment(), int output = -1,
+						   bool ownGroup = false);
+}
+
+#endif
@@ -0,0 +1,151 @@
+#include <thread>
+#include <cstring>
+#include <cerrno>
+
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "reaper.h"
+#include "zygote.h"
+
+using namespace processes;
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+double
+toSeconds(const timeval & time)
+{
+	return time.tv_sec + time.tv_usec / 1e6;
+}
+
+Reaper::Reaper(scheduling::EventLoop & loop):
+	m_loop(loop) {}
+
+void
+Reaper::track(pid_t pid, const std::string & owner, const std::string & command, ExitCallback callback)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_tracked[pid] = Tracked { TrackedProcess { pid, owner, command, std::chrono::steady_clock::now() },
+								   std::move(callback) };
+	}
+
+	// might call back right away, so nothing can be locked by then
+	if (zygote().onExit(pid, [this](const ProcessExit & exit) { exited(exit); }))
+		return;
+
+	if (watchChild(pid))
+		return;
+
+	// no pidfd (before Linux 5.3) or no event loop, a thread of its own it is
+	std::thread([this, pid]() {
+		ProcessExit exit { pid, -1, rusage() };
+		int status;
+
+		while (wait4(pid, &status, 0, &exit.usage) < 0) {
+			if (errno != EINTR) {
+				exited(exit);
+				return;
+			}
+		}
+
+		exit.code = exitCode(status);
+		exited(exit);
+	}).detach();
+}
+
+/* Our own child: its pidfd turns readable once it exits, by then wait4() doesn't block */
+bool
+Reaper::watchChild(pid_t pid)
+{
+	int pidfd = syscall(SYS_pidfd_open, pid, 0);
+	if (pidfd < 0)
+		return false;
+
+	bool added = m_loop.add(pidfd, EPOLLIN, [this, pid, pidfd](uint32_t) {
+		ProcessExit exit { pid, -1, rusage() };
+		int status;
+
+		pid_t reaped;
+		while ((reaped = wait4(pid, &status, WNOHANG, &exit.usage)) < 0 && errno == EINTR) {}
+		if (reaped == 0)
+			return;
+
+		if (reaped == pid)
+			exit.code = exitCode(status);
+
+		m_loop.remove(pidfd);
+		close(pidfd);
+		exited(exit);
+	});
+
+	if (!added)
+		close(pidfd);
+
+	return added;
+}
+
+void
+Reaper::exited(const ProcessExit & exit)
+{
+	ExitCallback callback;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		auto trackedIter = m_tracked.find(exit.pid);
+		if (trackedIter == m_tracked.end())
+			return;
+
+		OwnerUsage & usage = m_usage[trackedIter->second.process.owner];
+		usage.exited++;
+		if (exit.code != 0)
+			usage.failed++;
+		usage.lastCode = exit.code;
+		usage.cpuSeconds += toSeconds(exit.usage.ru_utime) + toSeconds(exit.usage.ru_stime);
+		usage.maxResidentKb = std::max(usage.maxResidentKb, exit.usage.ru_maxrss);
+
+		callback = std::move(trackedIter->second.callback);
+		m_tracked.erase(trackedIter);
+	}
+
+	if (callback)
+		callback(exit);
+}
+
+void
+Reaper::accountRun(const std::string & owner, const GroupUsage & groupUsage)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	OwnerUsage & usage = m_usage[owner];
+	usage.limitedRuns++;
+	usage.groupCpuSeconds += groupUsage.cpuSeconds;
+	usage.lastRunCpuSeconds = groupUsage.cpuSeconds;
+	usage.lastRunPeakKb = groupUsage.memoryPeak >> 10;
+	usage.groupPeakKb = std::max(usage.groupPeakKb, usage.lastRunPeakKb);
+}
+
+std::vector<TrackedProcess>
+Reaper::table()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	std::vector<TrackedProcess> processes;
+	processes.reserve(m_tracked.size());
+	for (const auto & tracked : m_tracked)
+		processes.push_back(tracked.second.process);
+
+	return processes;
+}
+
+std::map<std::string, OwnerUsage>
+Reaper::usage()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_usage;
+}
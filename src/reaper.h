@@ -0,0 +1,85 @@
+#ifndef REAPER_H
+#define REAPER_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+
+#include <sys/types.h>
+
+#include "process.h"
+#include "cgroups.h"
+#include "event-loop.h"
+
+namespace processes
+{
+	/* A process still running, as the process table lists it */
+	struct TrackedProcess
+	{
+		pid_t pid;
+		std::string owner;   // the job which started it
+		std::string command;
+		std::chrono::steady_clock::time_point started;
+	};
+
+	/* What the processes a job started added up to, once they exited */
+	struct OwnerUsage
+	{
+		uint64_t exited = 0;
+		uint64_t failed = 0;    // those which exited with anything but 0
+		int lastCode = 0;
+		double cpuSeconds = 0;  // user and system time together
+		long maxResidentKb = 0; // the largest any of them got
+
+		// runs with limits, as their control groups accounted for them, whatever their processes started included
+		uint64_t limitedRuns = 0;
+		double groupCpuSeconds = 0;
+		double lastRunCpuSeconds = 0;
+		uint64_t lastRunPeakKb = 0;
+		uint64_t groupPeakKb = 0;     // the most any of the runs used at once
+	};
+
+	/*
+	 * Every process a job starts is handed over here, and reaped as
+	 * soon as it exits without anything blocking on it: our own
+	 * children through a pidfd on the event loop, the zygote's through
+	 * the exits the zygote reports. The exit code and wait4() usage go
+	 * to the owner's totals and to the callback, if there is one.
+	 */
+	class Reaper
+	{
+	public:
+		Reaper(scheduling::EventLoop & loop);
+
+		void track(pid_t pid, const std::string & owner, const std::string & command,
+				   ExitCallback callback = ExitCallback());
+
+		/* Adds what a whole run used, read from its control group once it's over */
+		void accountRun(const std::string & owner, const GroupUsage & usage);
+
+		std::vector<TrackedProcess> table();
+		std::map<std::string, OwnerUsage> usage();
+
+	private:
+		struct Tracked
+		{
+			TrackedProcess process;
+			ExitCallback callback;
+		};
+
+		bool watchChild(pid_t pid);
+		void exited(const ProcessExit & exit);
+
+		scheduling::EventLoop & m_loop;
+
+		std::unordered_map<pid_t, Tracked> m_tracked;
+		std::map<std::string, OwnerUsage> m_usage;
+		std::mutex m_mutex;
+	};
+}
+
+#endif
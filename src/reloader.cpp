@@ -0,0 +1,158 @@
+#include <sys/stat.h>
+
+#include "reloader.h"
+#include "mapped-file.h"
+#include "util.hpp"
+
+using namespace std::chrono;
+using namespace schedulers;
+
+/* An editor's save can be more than one finished write or rename, the file is read once they're over */
+const timeutil::DurationUnit RELOAD_SETTLE = 250ms;
+const timeutil::DurationUnit RELOAD_MAX_DELAY = 2000ms;
+
+JobReloader::JobReloader(scheduling::Engine & engine, const std::string & path):
+	m_engine(engine), m_path(path), m_reloadable(false), m_watch(0) {}
+
+JobReloader::~JobReloader()
+{
+	if (m_watch != 0)
+		m_engine.watcher().unwatch(m_watch);
+}
+
+void
+JobReloader::schedule(const std::vector<Job> & jobs)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	jobparsers::IndexedJobs indexed;
+	bool identified = false;
+
+	struct stat info;
+	m_reloadable = stat(m_path.c_str(), &info) == 0 && S_ISREG(info.st_mode);
+
+	// the jobs might have come from the cache, the file is only read to tell which block each one is
+	if (m_reloadable) {
+		jobparsers::MappedFile::read(m_path)
+			.onSuccess([&](const std::shared_ptr<jobparsers::MappedFile> & file) {
+				identified = m_index.adopt(file->text(), jobs, indexed);
+
+				// it changed since they were loaded, and not into something they can be told apart in
+				if (!identified) {
+					indexed = m_index.update(file->text());
+					identified = indexed.errors.empty();
+				}
+			});
+	}
+
+	// the file as it is now is what a reload is compared to; until it parses, the jobs loaded are run as they are
+	if (!identified) {
+		if (m_reloadable)
+			printerr(m_path + " changed while it was loaded and doesn't parse now, its jobs are replaced once it does");
+
+		indexed = jobparsers::IndexedJobs();
+		for (size_t i = 0; i < jobs.size(); i++)
+			indexed.jobs.push_back(jobparsers::IdentifiedJob { "loaded#" + std::to_string(i + 1), jobs.at(i) });
+	}
+
+	for (const auto & job : indexed.jobs)
+		m_jobs[job.identity] = scheduleJob(m_engine, job.job);
+}
+
+void
+JobReloader::watch()
+{
+	if (!m_reloadable)
+		return;
+
+	scheduling::Engine & engine = m_engine;
+
+	m_trigger = std::make_shared<watchers::WatchTrigger>(engine.timers(), RELOAD_SETTLE, RELOAD_MAX_DELAY,
+		[this, &engine](const watchers::WatchEvent &, std::function<void()> done) {
+			// parsed off the timer thread; the engine is held until the jobs which changed are armed again
+			engine.hold();
+
+			bool queued = engine.dispatch(this, [this, &engine, done]() {
+				reload();
+				engine.release();
+				done();
+			});
+
+			if (!queued) {
+				printerr("[reload] skipped, too many runs are queued");
+				engine.release();
+				done();
+			}
+		});
+
+	std::shared_ptr<watchers::WatchTrigger> trigger = m_trigger;
+	// a modification is a write in progress, the file is only whole once it's closed or moved in
+	m_watch = engine.watcher().watch(m_path, [trigger](const watchers::WatchEvent & event) {
+		if (event.type == watchers::CLOSED_WRITE || event.type == watchers::MOVED ||
+			event.type == watchers::CREATED)
+			trigger->notify(event);
+	});
+}
+
+void
+JobReloader::reload()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	jobparsers::IndexedJobs indexed;
+	bool read = false;
+
+	// not mapped, whoever writes the file next might truncate it while it's parsed
+	jobparsers::MappedFile::read(m_path)
+		.onSuccess([&](const std::shared_ptr<jobparsers::MappedFile> & file) {
+			indexed = m_index.update(file->text());
+			read = true;
+		})
+		.onFailure([](const Error & err) {
+			printerr("[reload] " + err.message + "; the jobs are left as they were");
+		});
+
+	if (!read)
+		return;
+
+	if (!indexed.errors.empty()) {
+		for (const auto & err : indexed.errors)
+			printerr(m_path + ":" + err.message);
+
+		size_t errors = indexed.errors.size();
+		printerr(std::to_string(errors) + (errors == 1 ? " error" : " errors") + " in " + m_path +
+				 ", the jobs are left as they were");
+		return;
+	}
+
+	std::unordered_map<std::string, const Job *> running;
+	for (const auto & job : m_jobs)
+		running.emplace(job.first, &job.second->job);
+
+	jobparsers::JobChanges changes = jobparsers::diffJobs(running, indexed.jobs);
+	if (changes.added.empty() && changes.changed.empty() && changes.removed.empty())
+		return;
+
+	for (const auto & identity : changes.removed) {
+		auto job = m_jobs.find(identity);
+
+		println("[" + job->second->job.description.options.name + "] unscheduled, it's gone from " + m_path);
+		unscheduleJob(m_engine, job->second);
+		m_jobs.erase(job);
+	}
+
+	for (size_t index : changes.changed) {
+		const jobparsers::IdentifiedJob & job = indexed.jobs.at(index);
+
+		println("[" + job.job.description.options.name + "] statements changed, it keeps to its schedule");
+		m_jobs[job.identity] = replaceJob(m_engine, m_jobs.at(job.identity), job.job);
+	}
+
+	for (size_t index : changes.added) {
+		const jobparsers::IdentifiedJob & job = indexed.jobs.at(index);
+		m_jobs[job.identity] = scheduleJob(m_engine, job.job);
+	}
+
+	println("Reloaded " + m_path + ": " + std::to_string(changes.added.size()) + " added, " +
+			std::to_string(changes.changed.size()) + " changed, " + std::to_string(changes.removed.size()) +
+			" removed, " + std::to_string(changes.unchanged) + " unchanged (" +
+			std::to_string(indexed.parsedBlocks) + " blocks parsed)");
+}
@@ -0,0 +1,60 @@
+#ifndef RELOADER_H
+#define RELOADER_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+
+#include "jobs.h"
+#include "job-index.h"
+#include "schedulers.h"
+#include "engine.h"
+#include "watch-trigger.h"
+
+namespace schedulers
+{
+	/*
+	 * Keeps a job file's jobs scheduled as the file changes. Only the
+	 * blocks of it which changed are parsed again, and the jobs are
+	 * matched with the running ones by identity: new ones are armed,
+	 * gone ones are taken off and ones with other statements replace
+	 * the running version on its schedule as it is. Jobs which didn't
+	 * change aren't touched, nor are runs going on. A file with errors
+	 * is reported and left as it was until it's fixed.
+	 */
+	class JobReloader
+	{
+	public:
+		JobReloader(scheduling::Engine & engine, const std::string & path);
+		~JobReloader();
+
+		/* Schedules the jobs the file was first loaded into */
+		void schedule(const std::vector<Job> & jobs);
+
+		/*
+		 * Reloads the file once it settles after a finished write or a
+		 * rename; writes in progress are never read, so a file only
+		 * seen changing in place (on a polled mount) isn't reloaded.
+		 * The watch doesn't hold the engine.
+		 */
+		void watch();
+
+	private:
+		void reload();
+
+		scheduling::Engine & m_engine;
+		const std::string m_path;
+		bool m_reloadable; // a pipe can't be read a second time
+
+		jobparsers::JobIndex m_index;
+		std::unordered_map<std::string, std::shared_ptr<const ScheduledJob>> m_jobs;
+
+		std::shared_ptr<watchers::WatchTrigger> m_trigger;
+		watchers::WatchId m_watch;
+		std::mutex m_mutex;
+	};
+}
+
+#endif
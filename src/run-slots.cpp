@@ -0,0 +1,83 @@
+#include "run-slots.h"
+
+using namespace scheduling;
+
+RunSlots::RunSlots(unsigned limit):
+	m_limit(limit), m_running(0), m_queued(0) {}
+
+bool
+RunSlots::acquire()
+{
+	unsigned running = m_running.load();
+
+	do {
+		if (m_limit > 0 && running >= m_limit)
+			return false;
+	} while (!m_running.compare_exchange_weak(running, running + 1));
+
+	return true;
+}
+
+bool
+RunSlots::enqueue(unsigned maxQueued)
+{
+	unsigned queued = m_queued.load();
+
+	do {
+		if (maxQueued > 0 && queued >= maxQueued)
+			return false;
+	} while (!m_queued.compare_exchange_weak(queued, queued + 1));
+
+	return true;
+}
+
+bool
+RunSlots::takeQueued()
+{
+	unsigned queued = m_queued.load();
+
+	do {
+		if (queued == 0)
+			return false;
+	} while (!m_queued.compare_exchange_weak(queued, queued - 1));
+
+	return true;
+}
+
+bool
+RunSlots::startQueued()
+{
+	while (m_queued.load() > 0 && acquire()) {
+		if (takeQueued())
+			return true;
+
+		// somebody else took it in between
+		m_running--;
+	}
+
+	return false;
+}
+
+bool
+RunSlots::release()
+{
+	if (takeQueued())
+		return true;
+
+	m_running--;
+
+	// a run might have been queued after the check above, but seen this slot still taken
+	return startQueued();
+}
+
+unsigned
+RunSlots::running() const
+{
+	return m_running.load();
+}
+
+unsigned
+RunSlots::queued() const
+{
+	return m_queued.load();
+}
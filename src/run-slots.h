@@ -0,0 +1,48 @@
+#ifndef RUNSLOTS_H
+#define RUNSLOTS_H
+
+#include <atomic>
+
+namespace scheduling
+{
+	/*
+	 * How many runs of one job are going and how many wait for one of
+	 * them to end. Only a pair of counters, so firing a job checks them
+	 * without taking any lock, let alone one shared with other jobs.
+	 *
+	 * A run which ends hands its slot straight over to a waiting one;
+	 * as both counters change apart from each other, each side checks
+	 * again after its own change, so a run queued just as the last one
+	 * ends is never left waiting.
+	 */
+	class RunSlots
+	{
+	public:
+		/* 0 for no limit */
+		RunSlots(unsigned limit = 1);
+
+		/* Takes a slot for a new run, if there's one free */
+		bool acquire();
+
+		/* Adds a run to those waiting for a slot, unless maxQueued (0 for no limit) already are */
+		bool enqueue(unsigned maxQueued = 0);
+
+		/* Takes a waiting run if a slot is free; true if the caller is to start it */
+		bool startQueued();
+
+		/* A run is over; true if its slot went to a waiting run, which the caller is to start */
+		bool release();
+
+		unsigned running() const;
+		unsigned queued() const;
+
+	private:
+		bool takeQueued();
+
+		const unsigned m_limit;
+		std::atomic<unsigned> m_running;
+		std::atomic<unsigned> m_queued;
+	};
+}
+
+#endif
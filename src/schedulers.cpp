@@ -1,13 +1,13 @@
 #include <chrono>
 #include <vector>
 #include <string>
-#include <thread>
+#include <algorithm>
 
 #include <boost/algorithm/string.hpp>
-#include <boost/filesystem.hpp>
 
 #include "schedulers.h"
 #include "jobs-processing.h"
+#include "watch-trigger.h"
 #include "util.hpp"
 #include "timeutil.h"
 
@@ -28,16 +28,69 @@ schedulers::splitArgsByBlanks(const std::string & argsString)
 	return arguments;
 }
 
+/* Everything a job needs before it's armed */
+std::shared_ptr<ScheduledJob>
+prepareJob(scheduling::Engine & engine, const Job & job)
+{
+	std::shared_ptr<ScheduledJob> scheduledJob = std::make_shared<ScheduledJob>();
+	scheduledJob->job = job;
+	scheduledJob->arguments = splitArgsByBlanks(job.description.arguments);
+	scheduledJob->runs = std::make_shared<JobRuns>(job.description.options.concurrency);
+	scheduledJob->arming = std::make_unique<JobArming>();
+
+	const JobOptions & options = job.description.options;
+	if (!options.outputFile.empty()) {
+		output::RotationPolicy rotation;
+		rotation.maxSize = options.outputMaxSize;
+		rotation.keep = options.outputKeep;
+		rotation.interval = options.outputRotate;
+
+		scheduledJob->output = engine.output().open(options.outputFile, rotation);
+	}
+
+	processes::ResourceLimits limits;
+	limits.cpuQuota = options.cpuMax;
+	limits.memoryMax = options.memoryMax;
+	limits.pidsMax = options.pidsMax;
+	limits.ioWeight = options.ioWeight;
+
+	// without cgroup v2 delegated to us the job still runs, just without the limits it can't have
+	if (limits.any()) {
+		processes::controlGroups().enforceable(limits)
+			.onSuccess([&](const processes::ResourceLimits & enforceable) {
+				scheduledJob->limits = enforceable;
+
+				std::vector<std::string> enforced = processes::controllersFor(enforceable);
+				for (const auto & controller : processes::controllersFor(limits)) {
+					if (std::find(enforced.begin(), enforced.end(), controller) == enforced.end())
+						printerr("[" + options.name + "] running without its " + controller + 
+								 " limit; the controller isn't delegated to us");
+				}
+			})
+			.onFailure([&options](const Error & error) {
+				printerr("[" + options.name + "] running without resource limits; " + error.message);
+			});
+	}
+
+	// a command missing now might still show up before the job runs
+	for (const auto & error : jobs::resolveCommands(job.statements))
+		printerr("[" + job.description.options.name + "] " + error);
+
+	return scheduledJob;
+}
+
+/* Arms a prepared job the way its scheduler says */
 void
-schedulers::scheduleJobThread(const Job & job)
+startJob(scheduling::Engine & engine, std::shared_ptr<ScheduledJob> scheduledJob)
 {
-	const std::string & scheduler = job.description.scheduler;
-	const std::vector<std::string> arguments = splitArgsByBlanks(job.description.arguments);
+	const std::string & scheduler = scheduledJob->job.description.scheduler;
 
 	const SchedulerJobInfo params = SchedulerJobInfo {
-		arguments,
-		job.description.options,
-		job.statements
+		scheduledJob->arguments,
+		scheduledJob->job.description.options,
+		scheduledJob->job.statements,
+		engine,
+		scheduledJob
 	};
 
 	if (scheduler.compare("every") == 0) {
@@ -63,18 +116,377 @@ schedulers::scheduleJobThread(const Job & job)
 	}
 }
 
+std::shared_ptr<const ScheduledJob>
+schedulers::scheduleJob(scheduling::Engine & engine, const Job & job)
+{
+	std::shared_ptr<ScheduledJob> scheduledJob = prepareJob(engine, job);
+	startJob(engine, scheduledJob);
+
+	return scheduledJob;
+}
+
 void
-schedulers::runJobThread(timeutil::DurationUnit waitDuration, bool repeat, 
-						 JobOptions options, std::vector<Statement> statements)
+schedulers::unscheduleJob(scheduling::Engine & engine, std::shared_ptr<const ScheduledJob> job,
+						  std::shared_ptr<const ScheduledJob> successor)
 {
-	while (1) {
-		std::this_thread::sleep_for(waitDuration);
+	JobArming & arming = *job->arming;
+	std::function<void(std::shared_ptr<const ScheduledJob>)> rearm;
+	bool cancelled = false;
+	bool unwatched = false;
+
+	{
+		std::lock_guard<std::mutex> lock(arming.mutex);
+		if (arming.retired)
+			return;
+
+		arming.retired = true;
+		arming.successor = successor;
+
+		// a timer which can't be cancelled is already going off, it fires the successor instead
+		if (arming.timer != 0 && engine.timers().cancel(arming.timer)) {
+			cancelled = true;
+			rearm = std::move(arming.rearm);
+			arming.timer = 0;
+		}
+
+		if (arming.watch != 0) {
+			engine.watcher().unwatch(arming.watch);
+			unwatched = true;
+			arming.watch = 0;
+		}
+	}
+
+	// the successor takes its hold before the cancelled timer's goes, the engine can't run out of them in between
+	if (cancelled && successor != nullptr && rearm)
+		rearm(successor);
 
-		jobs::runJobStatements(statements, options.exitOnFail);
+	if (cancelled)
+		engine.release();
 
-		if (!repeat)
-			break;
+	if (unwatched)
+		engine.release();
+}
+
+std::shared_ptr<const ScheduledJob>
+schedulers::replaceJob(scheduling::Engine & engine, std::shared_ptr<const ScheduledJob> job, 
+					   const Job & replacement)
+{
+	std::shared_ptr<ScheduledJob> scheduledJob = prepareJob(engine, replacement);
+	if (replacement.description.options.concurrency == job->job.description.options.concurrency)
+		scheduledJob->runs = job->runs;
+
+	// a watch has no schedule to carry over, only its path
+	if (replacement.description.scheduler.compare("watch") == 0) {
+		unscheduleJob(engine, job);
+		startJob(engine, scheduledJob);
+	}
+	else {
+		unscheduleJob(engine, job, scheduledJob);
+	}
+
+	return scheduledJob;
+}
+
+schedulers::JobRuns::JobRuns(unsigned concurrency):
+	slots(concurrency), nextRun(1) {}
+
+schedulers::JobArming::JobArming():
+	retired(false), timer(0), watch(0) {}
+
+/* The version of job which is scheduled now, null if it was unscheduled for good */
+std::shared_ptr<const ScheduledJob>
+latestVersion(std::shared_ptr<const ScheduledJob> job)
+{
+	while (job != nullptr) {
+		std::shared_ptr<const ScheduledJob> successor;
+		{
+			std::lock_guard<std::mutex> lock(job->arming->mutex);
+			if (!job->arming->retired)
+				return job;
+
+			successor = job->arming->successor;
+		}
+
+		job = successor;
 	}
+
+	return nullptr;
+}
+
+/*
+ * Calls arm with the latest version of job, under its lock so it
+ * can't be unscheduled halfway through; nothing is armed if the 
+ * job is gone for good.
+ */
+void
+armLatest(std::shared_ptr<const ScheduledJob> job, 
+		  std::function<void(std::shared_ptr<const ScheduledJob>, JobArming &)> arm)
+{
+	while (job != nullptr) {
+		std::shared_ptr<const ScheduledJob> successor;
+		{
+			JobArming & arming = *job->arming;
+			std::lock_guard<std::mutex> lock(arming.mutex);
+
+			if (!arming.retired) {
+				arm(job, arming);
+				return;
+			}
+
+			successor = arming.successor;
+		}
+
+		job = successor;
+	}
+}
+
+/* A job's pending timer went off: the version of the job which runs for it, if there's still one */
+std::shared_ptr<const ScheduledJob>
+timerFired(std::shared_ptr<const ScheduledJob> job)
+{
+	std::shared_ptr<const ScheduledJob> successor;
+	{
+		std::lock_guard<std::mutex> lock(job->arming->mutex);
+		job->arming->timer = 0;
+		job->arming->rearm = nullptr;
+
+		if (!job->arming->retired)
+			return job;
+
+		successor = job->arming->successor;
+	}
+
+	return latestVersion(successor);
+}
+
+void startRun(scheduling::Engine & engine, std::shared_ptr<const ScheduledJob> job, std::function<void()> afterRun,
+			  const commands::Environment & environment = commands::Environment());
+
+/* The run's slot goes straight to one which waited for it, if there is one */
+void
+endRun(scheduling::Engine & engine, std::shared_ptr<const ScheduledJob> job, uint64_t id)
+{
+	JobRuns & runs = *job->runs;
+
+	if (id != 0) {
+		std::lock_guard<std::mutex> lock(runs.mutex);
+		runs.handles.erase(id);
+	}
+
+	// it took a hold on the engine when it was queued; it runs as the job is now, if it's still the same runs
+	if (runs.slots.release()) {
+		std::shared_ptr<const ScheduledJob> latest = latestVersion(job);
+		if (latest == nullptr || latest->runs != job->runs)
+			latest = job;
+
+		startRun(engine, latest, [&engine]() { engine.release(); });
+	}
+}
+
+void
+cancelRuns(std::shared_ptr<const ScheduledJob> job, const std::string & reason)
+{
+	std::vector<std::shared_ptr<jobs::RunHandle>> handles;
+	{
+		std::lock_guard<std::mutex> lock(job->runs->mutex);
+		for (const auto & handle : job->runs->handles)
+			handles.push_back(handle.second);
+	}
+
+	for (const auto & handle : handles)
+		handle->cancel(reason);
+}
+
+/* A run which got one of its job's slots */
+void
+startRun(scheduling::Engine & engine, std::shared_ptr<const ScheduledJob> job, std::function<void()> afterRun,
+		 const commands::Environment & environment)
+{
+	const JobOptions & options = job->job.description.options;
+
+	jobs::RunContext context;
+	context.environment = environment;
+	context.reaper = &engine.reaper();
+	context.owner = options.name;
+	context.loop = &engine.loop();
+	context.output = job->output;
+	context.timers = &engine.timers();
+	context.timeout = options.timeout;
+	context.killGrace = options.killGrace;
+	context.resume = [&engine](std::function<void()> rest) {
+		// the run already got in, its rest is never dropped or held up by a full queue
+		std::shared_ptr<std::function<void()>> task = std::make_shared<std::function<void()>>(rest);
+		return engine.dispatch(task.get(), [task]() { (*task)(); }, scheduling::CONTINUATION);
+	};
+
+	uint64_t id = 0;
+	if (options.overlap == OVERLAP_REPLACE) {
+		context.handle = std::make_shared<jobs::RunHandle>();
+
+		std::lock_guard<std::mutex> lock(job->runs->mutex);
+		id = job->runs->nextRun++;
+		job->runs->handles[id] = context.handle;
+	}
+
+	auto ended = [&engine, job, afterRun, id]() {
+		endRun(engine, job, id);
+		afterRun();
+	};
+
+	bool queued = engine.dispatch(job.get(), [job, context, ended]() {
+		const JobOptions & options = job->job.description.options;
+		jobs::RunContext runContext = context;
+
+		// a leaf of its own for each run, so what it used can be read back once it's over
+		if (job->limits.any()) {
+			processes::controlGroups().create(options.name, job->limits)
+				.onSuccess([&runContext](const std::shared_ptr<processes::ControlGroup> & group) {
+					runContext.group = group;
+				})
+				.onFailure([&options](const Error & error) {
+					printerr("[" + options.name + "] running without resource limits; " + error.message);
+				});
+		}
+
+		std::shared_ptr<processes::ControlGroup> group = runContext.group;
+		processes::Reaper * reaper = runContext.reaper;
+
+		// the job keeps the statements around for as long as the run sleeps
+		jobs::runJobStatements(job->job.statements, options.exitOnFail, runContext, 
+							   [job, ended, group, reaper]() {
+			if (group != nullptr)
+				reaper->accountRun(job->job.description.options.name, group->usage());
+
+			ended();
+		});
+	});
+
+	// a turned down run still has to keep a repeating job going
+	if (!queued) {
+		printerr("[" + options.name + "] run skipped, too many runs are queued");
+		ended();
+	}
+}
+
+void
+schedulers::fireJob(scheduling::Engine & engine, std::shared_ptr<const ScheduledJob> job, 
+					std::function<void()> afterRun, const commands::Environment & environment)
+{
+	const JobOptions & options = job->job.description.options;
+	JobRuns & runs = *job->runs;
+
+	// no lock on the way, only the job's own counters
+	if (runs.slots.acquire()) {
+		startRun(engine, job, afterRun, environment);
+		return;
+	}
+
+	OverlapPolicy overlap = options.overlap;
+
+	// a fixed-rate run which would be dropped is made up once the one in its way is over
+	if (overlap == OVERLAP_SKIP && options.overrun == CATCH_UP && options.mode == FIXED_RATE && 
+		job->job.description.scheduler.compare("every") == 0)
+		overlap = OVERLAP_QUEUE;
+
+	if (overlap == OVERLAP_QUEUE || overlap == OVERLAP_REPLACE) {
+		if (overlap == OVERLAP_REPLACE)
+			cancelRuns(job, "replaced by a newer run");
+
+		// a waiting run holds the engine on its own; it starts without the event variables, if there were any
+		engine.hold();
+		if (!runs.slots.enqueue(overlap == OVERLAP_REPLACE ? 1 : 0))
+			engine.release();
+		else if (runs.slots.startQueued())
+			startRun(engine, job, [&engine]() { engine.release(); });
+
+		afterRun();
+		return;
+	}
+
+	printerr("[" + options.name + "] run skipped, " + std::to_string(runs.slots.running()) + 
+			 " of its runs are still going");
+	afterRun();
+}
+
+void
+schedulers::triggerJob(scheduling::Engine & engine, std::shared_ptr<const ScheduledJob> job,
+					   const commands::Environment & environment)
+{
+	engine.hold();
+	fireJob(engine, job, [&engine]() {
+		engine.release();
+	}, environment);
+}
+
+/* Like armJob, for a deadline which was worked out already */
+void
+armJobUntil(scheduling::Engine & engine, std::shared_ptr<const ScheduledJob> job, 
+			scheduling::Clock::time_point deadline, timeutil::DurationUnit waitDuration, bool repeat)
+{
+	armLatest(job, [&engine, deadline, waitDuration, repeat](std::shared_ptr<const ScheduledJob> latest, 
+															 JobArming & arming) {
+		// released once the run is over, by then a repeating job has re-armed itself
+		engine.hold();
+
+		arming.timer = engine.timers().scheduleAt(deadline, [&engine, latest, waitDuration, repeat]() {
+			std::shared_ptr<const ScheduledJob> firing = timerFired(latest);
+			if (firing == nullptr) {
+				engine.release();
+				return;
+			}
+
+			fireJob(engine, firing, [&engine, firing, waitDuration, repeat]() {
+				if (repeat)
+					armJob(engine, firing, waitDuration, repeat);
+
+				engine.release();
+			});
+		});
+
+		arming.rearm = [&engine, deadline, waitDuration, repeat](std::shared_ptr<const ScheduledJob> successor) {
+			armJobUntil(engine, successor, deadline, waitDuration, repeat);
+		};
+	});
+}
+
+void
+schedulers::armJob(scheduling::Engine & engine, std::shared_ptr<const ScheduledJob> job, 
+				   timeutil::DurationUnit waitDuration, bool repeat)
+{
+	armJobUntil(engine, job, scheduling::Clock::now() + waitDuration, waitDuration, repeat);
+}
+
+void
+schedulers::armJobAt(scheduling::Engine & engine, std::shared_ptr<const ScheduledJob> job, 
+					 scheduling::Cadence cadence)
+{
+	armLatest(job, [&engine, cadence](std::shared_ptr<const ScheduledJob> latest, JobArming & arming) {
+		engine.hold();
+
+		arming.timer = engine.timers().scheduleAt(cadence.deadline(), [&engine, latest, cadence]() {
+			std::shared_ptr<const ScheduledJob> firing = timerFired(latest);
+			if (firing == nullptr) {
+				engine.release();
+				return;
+			}
+
+			const JobOptions & options = firing->job.description.options;
+
+			// the cadence goes on while the run does, a run still going when the next is due is up to overlap
+			scheduling::Cadence next = cadence;
+			next.advance(scheduling::Clock::now(), options.overrun == SKIP);
+			armJobAt(engine, firing, next);
+
+			fireJob(engine, firing, [&engine]() {
+				engine.release();
+			});
+		});
+
+		// a newer version of the job keeps to the same cadence
+		arming.rearm = [&engine, cadence](std::shared_ptr<const ScheduledJob> successor) {
+			armJobAt(engine, successor, cadence);
+		};
+	});
 }
 
 void
@@ -90,7 +502,14 @@ schedulers::every(const SchedulerJobInfo & jobInfo)
 		.onSuccess([&](timeutil::DurationUnit duration) {
 			const std::string & name = jobInfo.options.name;
 			println("[" + name + "] scheduled successfully");
-			runJobThread(duration, true, jobInfo.options, jobInfo.statements);
+
+			if (jobInfo.options.mode == FIXED_DELAY) {
+				armJob(jobInfo.engine, jobInfo.job, duration, true);
+			}
+			else {
+				armJobAt(jobInfo.engine, jobInfo.job, 
+						 scheduling::Cadence { scheduling::Clock::now(), duration, 1 });
+			}
 		});
 }
 
@@ -107,7 +526,7 @@ schedulers::after(const SchedulerJobInfo & jobInfo)
 		.onSuccess([&](timeutil::DurationUnit duration) {
 			const std::string & name = jobInfo.options.name;
 			println("[" + name + "] scheduled successfully");
-			runJobThread(duration, false, jobInfo.options, jobInfo.statements);
+			armJob(jobInfo.engine, jobInfo.job, duration, false);
 		});
 }
 
@@ -116,7 +535,7 @@ schedulers::now(const SchedulerJobInfo & jobInfo)
 {
 	const std::string & name = jobInfo.options.name;
 	println("[" + name + "] will run now");
-	runJobThread(1ms, false, jobInfo.options, jobInfo.statements);
+	armJob(jobInfo.engine, jobInfo.job, 0ms, false);
 }
 
 void
@@ -127,34 +546,51 @@ schedulers::watch(const SchedulerJobInfo & jobInfo)
 		return;
 	}
 
-	const filesystem::path path = jobInfo.arguments[0];
-	const std::string & name = jobInfo.options.name;
+	scheduling::Engine & engine = jobInfo.engine;
+	std::shared_ptr<const ScheduledJob> job = jobInfo.job;
+	const std::string & path = jobInfo.arguments[0];
 
-	bool fileExisted = filesystem::exists(path);
-	std::time_t previousLastModified = fileExisted ? last_write_time(path) : 0;
+	// a watch never runs out, so it holds the engine for good
+	engine.hold();
 
-	while (1) {
-		std::this_thread::sleep_for(5s);
-		bool fileExists = filesystem::exists(path);
+	std::shared_ptr<watchers::WatchTrigger> trigger = std::make_shared<watchers::WatchTrigger>(
+		engine.timers(), jobInfo.options.debounce, jobInfo.options.maxDelay, 
+		[&engine, job](const watchers::WatchEvent & event, std::function<void()> done) {
+			// one which settled just as the job was unscheduled
+			if (latestVersion(job) == nullptr) {
+				done();
+				return;
+			}
 
-		// checking exitence
-		if (fileExists) {
-			std::time_t currentLastModified = last_write_time(path);
+			const std::string & name = job->job.description.options.name;
+			println("[" + name + "] " + event.path + " was " + watchers::describe(event.type));
 
-			// the file was created during the sleep interval
-			if (!fileExisted) {
-				println("[" + name + "] file was created");
-				runJobThread(1ms, false, jobInfo.options, jobInfo.statements);
-			}
-			// the file was modified during the sleep interval
-			else if (currentLastModified - previousLastModified != 0) {
-				println("[" + name + "] file was modified");
-				runJobThread(1ms, false, jobInfo.options, jobInfo.statements);
-			}
+			// the statements can tell what they were run for
+			fireJob(engine, job, done, commands::Environment {
+				{ "AUTOMANIAC_EVENT_PATH", event.path },
+				{ "AUTOMANIAC_EVENT_TYPE", watchers::eventName(event.type) }
+			});
+		});
 
-			previousLastModified = currentLastModified;
-		}
+	watchers::WatchCallback callback = [trigger](const watchers::WatchEvent & event) {
+		trigger->notify(event);
+	};
+
+	watchers::WatchId id;
+
+	if (jobInfo.options.recursive) {
+		id = engine.watcher().watchTree(path, "", callback);
 	}
+	else if (watchers::isGlob(path)) {
+		std::pair<std::string, std::string> glob = watchers::splitGlob(path);
+		id = engine.watcher().watchTree(glob.first, glob.second, callback);
+	}
+	else {
+		id = engine.watcher().watch(path, callback);
+	}
+
+	std::lock_guard<std::mutex> lock(job->arming->mutex);
+	job->arming->watch = id;
 }
 
 void
@@ -173,7 +609,7 @@ schedulers::on(const SchedulerJobInfo & jobInfo)
 				timeutil::DurationUnit duration = milliseconds(difference * SECONDS);
 				println("[" + name + "] will be scheduled to run on " + jobInfo.arguments.at(0) + 
 						+ " at 00:00:00 (" + std::to_string(duration.count()) + " ms)");
-				runJobThread(duration, false, jobInfo.options, jobInfo.statements);
+				armJob(jobInfo.engine, jobInfo.job, duration, false);
 			})
 			.onFailure([] (const Error & err) {
 				printerr(err.message);
@@ -214,7 +650,7 @@ schedulers::onAt(const SchedulerJobInfo & jobInfo)
 
 			println("[" + name + "] will be scheduled to run on " + jobInfo.arguments.at(0) + 
 						+ " at " + jobInfo.arguments.at(2) + " (" + std::to_string(duration.count()) + " ms)");
-			runJobThread(duration, false, jobInfo.options, jobInfo.statements);
+			armJob(jobInfo.engine, jobInfo.job, duration, false);
 		})
 		.onFailure([] (const Error & err) {
 			printerr(err.message);
@@ -234,7 +670,7 @@ schedulers::tomorrow(const SchedulerJobInfo & jobInfo)
 
 		println("[" + name + "] will be scheduled to run tomorrow at 00:00:00 (" + 
 			std::to_string(duration.count()) + " ms)");
-		runJobThread(duration, false, jobInfo.options, jobInfo.statements);
+		armJob(jobInfo.engine, jobInfo.job, duration, false);
 	} 
 	else if (argsSize == 2) {
 		tomorrowAt(jobInfo);
@@ -271,7 +707,7 @@ schedulers::tomorrowAt(const SchedulerJobInfo & jobInfo)
 
 			println("[" + name + "] will be scheduled to run tomorrow at " + jobInfo.arguments.at(1) +
 			 " (" + std::to_string(duration.count()) + " ms)");
-			runJobThread(duration, false, jobInfo.options, jobInfo.statements);
+			armJob(jobInfo.engine, jobInfo.job, duration, false);
 		})
 		.onFailure([] (const Error & err) {
 			printerr(err.message);
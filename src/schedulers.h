@@ -4,25 +4,111 @@
 #include <vector>
 #include <string>
 #include <chrono>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <mutex>
+#include <cstdint>
 
 #include "failure.hpp"
 #include "timeutil.h"
+#include "engine.h"
 #include "jobs.h"
+#include "commands.h"
+#include "jobs-processing.h"
+#include "run-slots.h"
 
 namespace schedulers
 {
+	/* The runs of one job which are going on, whatever fired them; a job's versions share them */
+	struct JobRuns
+	{
+		JobRuns(unsigned concurrency);
+
+		scheduling::RunSlots slots;
+
+		// with overlap=replace, to cut the running ones short
+		std::unordered_map<uint64_t, std::shared_ptr<jobs::RunHandle>> handles;
+		uint64_t nextRun;
+		std::mutex mutex;
+	};
+
+	struct ScheduledJob;
+
+	/*
+	 * What a job has armed, so it can be taken off the engine again.
+	 * A retired job arms nothing more; whatever it would have armed
+	 * next goes to its successor, if it was replaced by one.
+	 */
+	struct JobArming
+	{
+		JobArming();
+
+		bool retired;
+		std::shared_ptr<const ScheduledJob> successor;
+		scheduling::TimerId timer; // zero while nothing is pending
+
+		// arms another job for the pending timer's deadline, the way this one was armed
+		std::function<void(std::shared_ptr<const ScheduledJob>)> rearm;
+		watchers::WatchId watch;   // zero unless it's a watch job
+		std::mutex mutex;
+	};
+
+	/*
+	 * A job as owned by the engine; timer callbacks keep it
+	 * alive for as long as the job might still fire.
+	 */
+	struct ScheduledJob
+	{
+		Job job;
+		std::vector<std::string> arguments;
+		std::shared_ptr<output::OutputFile> output; // null without an output option
+		processes::ResourceLimits limits;           // those of the job's which can be enforced
+		std::shared_ptr<JobRuns> runs;
+		std::unique_ptr<JobArming> arming;
+	};
+
 	struct SchedulerJobInfo
 	{
 		const std::vector<std::string> & arguments;
 		const JobOptions & options;
 		const std::vector<Statement> & statements;
+		scheduling::Engine & engine;
+		std::shared_ptr<const ScheduledJob> job;
 	};
 
 	std::vector<std::string> splitArgsByBlanks(const std::string & argsString);
 
-	void scheduleJobThread(const Job & job);
-	void runJobThread(timeutil::DurationUnit waitDuration, bool repeat, 
-		   			  JobOptions options, std::vector<Statement> statements);
+	std::shared_ptr<const ScheduledJob> scheduleJob(scheduling::Engine & engine, const Job & job);
+	/*
+	 * Takes a job off the engine; its runs which are going on finish
+	 * as they would have. With a successor, the successor takes over
+	 * the job's schedule where it is instead of starting it over.
+	 */
+	void unscheduleJob(scheduling::Engine & engine, std::shared_ptr<const ScheduledJob> job,
+					   std::shared_ptr<const ScheduledJob> successor = nullptr);
+	/*
+	 * A new version of a running job, with the same schedule and other
+	 * statements. Runs of the old version which are going on finish as
+	 * they are, and still count against the new one's overlap.
+	 */
+	std::shared_ptr<const ScheduledJob> replaceJob(scheduling::Engine & engine, std::shared_ptr<const ScheduledJob> job,
+												   const Job & replacement);
+	/*
+	 * Every run of a job goes through here, whatever fired it; one
+	 * due while the job's other runs take up all its slots goes the 
+	 * way its overlap option says. afterRun is called once this run
+	 * is over, or right away if it's dropped or left to wait.
+	 */
+	void fireJob(scheduling::Engine & engine, std::shared_ptr<const ScheduledJob> job, 
+				 std::function<void()> afterRun, 
+				 const commands::Environment & environment = commands::Environment());
+	void triggerJob(scheduling::Engine & engine, std::shared_ptr<const ScheduledJob> job,
+					const commands::Environment & environment = commands::Environment());
+	void armJob(scheduling::Engine & engine, std::shared_ptr<const ScheduledJob> job, 
+				timeutil::DurationUnit waitDuration, bool repeat);
+	void armJobAt(scheduling::Engine & engine, std::shared_ptr<const ScheduledJob> job, 
+				  scheduling::Cadence cadence);
 
 	void every(const SchedulerJobInfo & params);
 	void after(const SchedulerJobInfo & params);
@@ -34,4 +120,4 @@ namespace schedulers
 	void tomorrowAt(const SchedulerJobInfo & params);
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -1,8 +1,21 @@
 #include <string>
+#include <fstream>
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+#include <future>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <signal.h>
 
 #include "catch.hpp"
 
 #include "../commands.h"
+#include "../command-paths.h"
+#include "../zygote.h"
+#include "../cgroups.h"
+#include "../builtins.h"
+#include "../jobs-processing.h"
 
 using namespace commands;
 
@@ -19,4 +32,468 @@ TEST_CASE( "Commands test", "" ) {
 		REQUIRE( run({ "noextension", "--meaningless" }).failed() );
 		REQUIRE( run({ "file.ExtentionToFail", "--meaningless" }).failed() );
 	}
-}
\ No newline at end of file
+
+	SECTION( "exec passes arguments as they are" ) {
+		auto status = exec({ "sh", "-c", "exit 3" });
+		REQUIRE( status.succeeded() );
+		REQUIRE( status.getResult() == 3 );
+
+		// no shell splits "a b" again
+		REQUIRE( exec({ "test", "a b", "=", "a b" }).getResult() == 0 );
+	}
+
+	SECTION( "exec adds to the environment" ) {
+		ExecContext context;
+		context.environment = { { "AUTOMANIAC_TEST", "yes" } };
+
+		REQUIRE( exec({ "sh", "-c", "test \"$AUTOMANIAC_TEST\" = yes" }, context).getResult() == 0 );
+		REQUIRE( exec({ "sh", "-c", "test -n \"$PATH\"" }, context).getResult() == 0 );
+	}
+
+	SECTION( "command paths are remembered" ) {
+		CommandPaths paths(std::chrono::milliseconds(0));
+
+		auto first = paths.resolve("sh");
+		REQUIRE( first.succeeded() );
+		REQUIRE( paths.resolve("sh").getResult() == first.getResult() );
+		REQUIRE( paths.resolve("ThisCommandWillMakeItFail").failed() );
+
+		REQUIRE( commandFor("run", { "script.py" }).getResult() == "python" );
+		REQUIRE( commandFor("exec", { "ls", "-l" }).getResult() == "ls" );
+	}
+
+	SECTION( "a command showing up after it was missed" ) {
+		char pattern[] = "/tmp/automaniac-paths-XXXXXX";
+		std::string directory = mkdtemp(pattern);
+		std::string previousPath = std::getenv("PATH");
+		setenv("PATH", (directory + ":" + previousPath).c_str(), 1);
+
+		CommandPaths paths(std::chrono::milliseconds(0));
+		REQUIRE( paths.resolve("automaniac-test-command").failed() );
+
+		std::ofstream(directory + "/automaniac-test-command") << "#!/bin/sh\n";
+		chmod((directory + "/automaniac-test-command").c_str(), 0755);
+
+		// still missing until someone says the directory changed
+		REQUIRE( paths.resolve("automaniac-test-command").failed() );
+		paths.invalidate();
+		REQUIRE( paths.resolve("automaniac-test-command").succeeded() );
+
+		setenv("PATH", previousPath.c_str(), 1);
+		std::system(("rm -rf " + directory).c_str());
+	}
+}
+
+TEST_CASE( "Zygote test", "" ) {
+	processes::Zygote zygote;
+	REQUIRE( zygote.launch().succeeded() );
+	REQUIRE( zygote.running() );
+
+	SECTION( "processes are started and waited for" ) {
+		auto pid = zygote.start("/bin/sh", { "sh", "-c", "exit 3" });
+		REQUIRE( pid.succeeded() );
+		REQUIRE( zygote.owns(pid.getResult()) );
+		REQUIRE( zygote.wait(pid.getResult()).getResult() == 3 );
+		REQUIRE_FALSE( zygote.owns(pid.getResult()) );
+
+		auto variable = zygote.start("/bin/sh", { "sh", "-c", "test \"$AUTOMANIAC_TEST\" = yes" },
+									 { { "AUTOMANIAC_TEST", "yes" } });
+		REQUIRE( zygote.wait(variable.getResult()).getResult() == 0 );
+	}
+
+	SECTION( "exits are passed on with their usage" ) {
+		auto pid = zygote.start("/bin/sh", { "sh", "-c", "exit 5" });
+
+		std::promise<processes::ProcessExit> exited;
+		REQUIRE( zygote.onExit(pid.getResult(), [&exited](const processes::ProcessExit & exit) {
+			exited.set_value(exit);
+		}) );
+
+		std::future<processes::ProcessExit> exit = exited.get_future();
+		REQUIRE( exit.wait_for(std::chrono::seconds(2)) == std::future_status::ready );
+
+		processes::ProcessExit result = exit.get();
+		REQUIRE( result.code == 5 );
+		REQUIRE( result.usage.ru_maxrss > 0 );
+		REQUIRE_FALSE( zygote.owns(pid.getResult()) );
+	}
+
+	SECTION( "the output descriptor is handed over" ) {
+		int ends[2];
+		REQUIRE( pipe(ends) == 0 );
+
+		auto pid = zygote.start("/bin/echo", { "echo", "hello" }, {}, ends[1]);
+		close(ends[1]);
+		REQUIRE( zygote.wait(pid.getResult()).getResult() == 0 );
+
+		char buffer[16] = { 0 };
+		REQUIRE( read(ends[0], buffer, sizeof(buffer) - 1) == 6 );
+		REQUIRE( std::string(buffer) == "hello\n" );
+		close(ends[0]);
+	}
+
+	SECTION( "failing to start keeps the reason" ) {
+		auto pid = zygote.start("/ThisCommandWillMakeItFail", { "fail" });
+		REQUIRE( pid.failed() );
+		REQUIRE( pid.getError().code == ENOENT );
+	}
+
+	SECTION( "nothing is started once it's stopped" ) {
+		zygote.stop();
+		REQUIRE_FALSE( zygote.running() );
+		REQUIRE( zygote.start("/bin/true", { "true" }).getError().code == ENOTCONN );
+	}
+}
+
+TEST_CASE( "Reaper test", "" ) {
+	scheduling::EventLoop loop;
+	processes::Reaper reaper(loop);
+	loop.start();
+
+	ExecContext context;
+	context.reaper = &reaper;
+	context.owner = "reaped";
+
+	SECTION( "spawned processes are listed until they exit" ) {
+		REQUIRE( spawn({ "sleep", "0.2" }, context).succeeded() );
+
+		std::vector<processes::TrackedProcess> table = reaper.table();
+		REQUIRE( table.size() == 1 );
+		REQUIRE( table[0].owner == "reaped" );
+
+		for (int i = 0; i < 100 && !reaper.table().empty(); i++)
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+		REQUIRE( reaper.table().empty() );
+		REQUIRE( reaper.usage()["reaped"].exited == 1 );
+		REQUIRE( reaper.usage()["reaped"].lastCode == 0 );
+		REQUIRE( reaper.usage()["reaped"].maxResidentKb > 0 );
+	}
+
+	SECTION( "exec gets its exit code through the reaper" ) {
+		REQUIRE( exec({ "sh", "-c", "exit 4" }, context).getResult() == 4 );
+		REQUIRE( exec({ "true" }, context).getResult() == 0 );
+
+		REQUIRE( reaper.table().empty() );
+		REQUIRE( reaper.usage()["reaped"].exited == 2 );
+		REQUIRE( reaper.usage()["reaped"].failed == 1 );
+	}
+
+	loop.stop();
+}
+
+TEST_CASE( "Control groups test", "" ) {
+	processes::ResourceLimits limits;
+	limits.memoryMax = 64 << 20;
+	limits.pidsMax = 16;
+
+	SECTION( "limits name the controllers they need" ) {
+		REQUIRE( !processes::ResourceLimits().any() );
+		REQUIRE( limits.any() );
+		REQUIRE( processes::controllersFor(limits) == std::vector<std::string> { "memory", "pids" } );
+	}
+
+	SECTION( "without a usable hierarchy nothing is limited" ) {
+		processes::ControlGroups groups("/nonexistent/automaniac");
+
+		REQUIRE( groups.enforceable(limits).failed() );
+		REQUIRE( groups.create("limited", limits).failed() );
+		REQUIRE( groups.create("limited", limits).failed() );
+		groups.close();
+	}
+
+	// only where cgroup v2 is delegated to us
+	SECTION( "processes are moved into the run's leaf" ) {
+		processes::ControlGroups & groups = processes::controlGroups();
+		if (groups.enforceable(limits).failed())
+			return;
+
+		auto group = groups.create("limited", limits);
+		REQUIRE( group.succeeded() );
+
+		std::string leaf = group.getResult()->path().substr(group.getResult()->path().rfind('/') + 1);
+
+		ExecContext context;
+		context.group = group.getResult();
+		REQUIRE( exec({ "sh", "-c", "sleep 0.1; grep -q " + leaf + " /proc/self/cgroup" }, context).getResult() == 0 );
+		REQUIRE( group.getResult()->usage().cpuSeconds > 0 );
+	}
+}
+
+TEST_CASE( "Builtins test", "" ) {
+	char pattern[] = "/tmp/automaniac-builtins-XXXXXX";
+	std::string directory = mkdtemp(pattern);
+
+	SECTION( "builtins run without a process" ) {
+		REQUIRE( builtins::run({ "true" }).getResult() == 0 );
+		REQUIRE( builtins::run({ "false" }).getResult() == 1 );
+		REQUIRE( builtins::run({ "ThisBuiltinWillMakeItFail" }).failed() );
+
+		REQUIRE( builtins::run({ "write", directory + "/file", "some", "text" }).getResult() == 0 );
+		std::ifstream file(directory + "/file");
+		std::string line;
+		std::getline(file, line);
+		REQUIRE( line == "some text" );
+
+		REQUIRE( builtins::run({ "touch", directory + "/touched" }).getResult() == 0 );
+		REQUIRE( access((directory + "/touched").c_str(), F_OK) == 0 );
+		REQUIRE( builtins::run({ "touch", directory + "/missing/touched" }).getError().code == ENOENT );
+	}
+
+	SECTION( "sleep durations" ) {
+		REQUIRE( builtins::sleepDuration({ "sleep", "5" }).getResult() == std::chrono::seconds(5) );
+		REQUIRE( builtins::sleepDuration({ "sleep", "250ms" }).getResult() == std::chrono::milliseconds(250) );
+		REQUIRE( builtins::sleepDuration({ "sleep" }).failed() );
+		REQUIRE( builtins::sleepDuration({ "sleep", "soon" }).failed() );
+	}
+
+	SECTION( "a sleeping run gives its thread back" ) {
+		scheduling::TimerQueue timers;
+		timers.start();
+
+		std::vector<Statement> statements = {
+			Statement { "builtin", { "sleep", "100ms" } },
+			Statement { "builtin", { "touch", directory + "/after-sleep" } }
+		};
+
+		jobs::RunContext context;
+		context.timers = &timers;
+		context.resume = [](std::function<void()> rest) {
+			std::thread(rest).detach();
+			return true;
+		};
+
+		std::promise<void> finished;
+		auto start = std::chrono::steady_clock::now();
+		jobs::runJobStatements(statements, true, context, [&finished]() { finished.set_value(); });
+
+		// returns right away, the statement after the sleep hasn't run yet
+		REQUIRE( std::chrono::steady_clock::now() - start < std::chrono::milliseconds(50) );
+		REQUIRE( access((directory + "/after-sleep").c_str(), F_OK) != 0 );
+
+		REQUIRE( finished.get_future().wait_for(std::chrono::seconds(2)) == std::future_status::ready );
+		REQUIRE( std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(100) );
+		REQUIRE( access((directory + "/after-sleep").c_str(), F_OK) == 0 );
+
+		timers.stop();
+	}
+
+	SECTION( "a run waiting for a process gives its thread back" ) {
+		scheduling::TimerQueue timers;
+		scheduling::EventLoop loop;
+		processes::Reaper reaper(loop);
+		timers.start();
+		loop.start();
+
+		std::vector<Statement> statements = {
+			Statement { "exec", { "sleep", "0.1" } },
+			Statement { "exec", { "sh", "-c", "exit 3" } },
+			Statement { "builtin", { "touch", directory + "/after-failure" } }
+		};
+
+		jobs::RunContext context;
+		context.timers = &timers;
+		context.reaper = &reaper;
+		context.resume = [](std::function<void()> rest) {
+			std::thread(rest).detach();
+			return true;
+		};
+
+		std::promise<void> finished;
+		auto start = std::chrono::steady_clock::now();
+		jobs::runJobStatements(statements, true, context, [&finished]() { finished.set_value(); });
+
+		REQUIRE( std::chrono::steady_clock::now() - start < std::chrono::milliseconds(50) );
+		REQUIRE( reaper.table().size() == 1 );
+
+		REQUIRE( finished.get_future().wait_for(std::chrono::seconds(2)) == std::future_status::ready );
+		REQUIRE( reaper.usage()[""].exited == 2 );
+		REQUIRE( reaper.usage()[""].lastCode == 3 );
+
+		// stopped at the failure
+		REQUIRE( access((directory + "/after-failure").c_str(), F_OK) != 0 );
+
+		loop.stop();
+		timers.stop();
+	}
+
+	SECTION( "statements running over their time are terminated" ) {
+		scheduling::TimerQueue timers;
+		scheduling::EventLoop loop;
+		processes::Reaper reaper(loop);
+		timers.start();
+		loop.start();
+
+		Statement hanging { "exec", { "sh", "-c", "trap '' TERM; sleep 10 & wait" } };
+		hanging.timeout = std::chrono::milliseconds(100);
+
+		std::vector<Statement> statements = {
+			hanging,
+			Statement { "builtin", { "touch", directory + "/after-timeout" } }
+		};
+
+		jobs::RunContext context;
+		context.timers = &timers;
+		context.reaper = &reaper;
+		context.killGrace = std::chrono::milliseconds(100);
+		context.resume = [](std::function<void()> rest) {
+			std::thread(rest).detach();
+			return true;
+		};
+
+		std::promise<void> finished;
+		auto start = std::chrono::steady_clock::now();
+		jobs::runJobStatements(statements, true, context, [&finished]() { finished.set_value(); });
+
+		// SIGTERM is ignored, so it takes the SIGKILL after the grace period
+		REQUIRE( finished.get_future().wait_for(std::chrono::seconds(3)) == std::future_status::ready );
+		REQUIRE( std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(200) );
+		REQUIRE( std::chrono::steady_clock::now() - start < std::chrono::seconds(3) );
+		REQUIRE( reaper.usage()[""].lastCode == 128 + SIGKILL );
+		REQUIRE( access((directory + "/after-timeout").c_str(), F_OK) != 0 );
+
+		loop.stop();
+		timers.stop();
+	}
+
+	SECTION( "what a terminated statement started is killed even once it's gone" ) {
+		scheduling::TimerQueue timers;
+		scheduling::EventLoop loop;
+		processes::Reaper reaper(loop);
+		timers.start();
+		loop.start();
+
+		// the shell goes with the SIGTERM, the sleep it left behind ignores it
+		std::string pidFile = directory + "/grandchild";
+		Statement hanging { "exec", { "sh", "-c", "(trap '' TERM; exec sleep 10) & echo $! > " + pidFile + "; wait" } };
+		hanging.timeout = std::chrono::milliseconds(100);
+
+		jobs::RunContext context;
+		context.timers = &timers;
+		context.reaper = &reaper;
+		context.killGrace = std::chrono::milliseconds(100);
+		context.resume = [](std::function<void()> rest) {
+			std::thread(rest).detach();
+			return true;
+		};
+
+		std::promise<void> finished;
+		jobs::runJobStatements({ hanging }, true, context, [&finished]() { finished.set_value(); });
+
+		REQUIRE( finished.get_future().wait_for(std::chrono::seconds(3)) == std::future_status::ready );
+		REQUIRE( reaper.usage()[""].lastCode == 128 + SIGTERM );
+
+		pid_t grandchild = 0;
+		std::ifstream(pidFile) >> grandchild;
+		REQUIRE( grandchild > 0 );
+
+		// orphaned, so whoever adopted it might not reap it; a zombie is gone as far as this goes
+		auto alive = [grandchild]() {
+			std::ifstream stat("/proc/" + std::to_string(grandchild) + "/stat");
+			std::string pid, command, state;
+			return stat >> pid >> command >> state && state.compare("Z") != 0;
+		};
+
+		auto start = std::chrono::steady_clock::now();
+		while (alive() && std::chrono::steady_clock::now() - start < std::chrono::seconds(2))
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		REQUIRE_FALSE( alive() );
+
+		loop.stop();
+		timers.stop();
+	}
+
+	SECTION( "a run over its time stops where it is" ) {
+		scheduling::TimerQueue timers;
+		scheduling::EventLoop loop;
+		processes::Reaper reaper(loop);
+		timers.start();
+		loop.start();
+
+		std::vector<Statement> statements = {
+			Statement { "builtin", { "sleep", "10" } },
+			Statement { "builtin", { "touch", directory + "/after-sleep" } }
+		};
+
+		jobs::RunContext context;
+		context.timers = &timers;
+		context.reaper = &reaper;
+		context.timeout = std::chrono::milliseconds(100);
+		context.resume = [](std::function<void()> rest) {
+			std::thread(rest).detach();
+			return true;
+		};
+
+		std::promise<void> finished;
+		jobs::runJobStatements(statements, false, context, [&finished]() { finished.set_value(); });
+
+		REQUIRE( finished.get_future().wait_for(std::chrono::seconds(2)) == std::future_status::ready );
+		REQUIRE( access((directory + "/after-sleep").c_str(), F_OK) != 0 );
+
+		loop.stop();
+		timers.stop();
+	}
+
+	SECTION( "a cancelled run stops where it is" ) {
+		scheduling::TimerQueue timers;
+		scheduling::EventLoop loop;
+		processes::Reaper reaper(loop);
+		timers.start();
+		loop.start();
+
+		std::vector<Statement> statements = {
+			Statement { "exec", { "sleep", "10" } },
+			Statement { "builtin", { "touch", directory + "/after-cancel" } }
+		};
+
+		jobs::RunContext context;
+		context.timers = &timers;
+		context.reaper = &reaper;
+		context.killGrace = std::chrono::milliseconds(100);
+		context.handle = std::make_shared<jobs::RunHandle>();
+		context.resume = [](std::function<void()> rest) {
+			std::thread(rest).detach();
+			return true;
+		};
+
+		std::promise<void> finished;
+		jobs::runJobStatements(statements, false, context, [&finished]() { finished.set_value(); });
+
+		context.handle->cancel("replaced");
+
+		REQUIRE( finished.get_future().wait_for(std::chrono::seconds(2)) == std::future_status::ready );
+		REQUIRE( reaper.usage()[""].lastCode == 128 + SIGTERM );
+		REQUIRE( access((directory + "/after-cancel").c_str(), F_OK) != 0 );
+
+		// nothing left to cancel
+		context.handle->cancel("again");
+
+		loop.stop();
+		timers.stop();
+	}
+
+	SECTION( "a run cancelled before it starts does nothing" ) {
+		scheduling::TimerQueue timers;
+		timers.start();
+
+		jobs::RunContext context;
+		context.timers = &timers;
+		context.handle = std::make_shared<jobs::RunHandle>();
+		context.resume = [](std::function<void()> rest) {
+			rest();
+			return true;
+		};
+		context.handle->cancel("replaced");
+
+		bool finished = false;
+		jobs::runJobStatements({ Statement { "builtin", { "touch", directory + "/cancelled" } } }, false, 
+							   context, [&finished]() { finished = true; });
+
+		REQUIRE( finished );
+		REQUIRE( access((directory + "/cancelled").c_str(), F_OK) != 0 );
+
+		timers.stop();
+	}
+
+	std::system(("rm -rf " + directory).c_str());
+}
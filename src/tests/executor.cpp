@@ -0,0 +1,270 @@
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "catch.hpp"
+
+#include "../executor.h"
+#include "../work-stealing-deque.hpp"
+#include "../run-slots.h"
+
+using namespace scheduling;
+
+void waitFor(std::atomic<size_t> & counter, size_t expected)
+{
+	while (counter.load() < expected)
+		std::this_thread::yield();
+}
+
+TEST_CASE( "Work-stealing deque", "[Executor]" ) {
+	int values[3] = { 1, 2, 3 };
+
+	SECTION( "the owner takes the newest" ) {
+		WorkStealingDeque<int *> deque(2);
+		for (int & value : values)
+			deque.push(&value);
+
+		REQUIRE( *deque.take() == 3 );
+		REQUIRE( *deque.take() == 2 );
+		REQUIRE( *deque.take() == 1 );
+		REQUIRE( deque.take() == nullptr );
+	}
+
+	SECTION( "thieves steal the oldest" ) {
+		WorkStealingDeque<int *> deque(2);
+		for (int & value : values)
+			deque.push(&value);
+
+		REQUIRE( *deque.steal() == 1 );
+		REQUIRE( *deque.take() == 3 );
+		REQUIRE( *deque.steal() == 2 );
+		REQUIRE( deque.steal() == nullptr );
+		REQUIRE( deque.empty() );
+	}
+
+	SECTION( "every item is taken exactly once under contention" ) {
+		const size_t count = 100000;
+		std::vector<size_t> items(count);
+		std::vector<std::atomic<int>> seen(count);
+		for (size_t i = 0; i < count; i++) {
+			items[i] = i;
+			seen[i] = 0;
+		}
+
+		WorkStealingDeque<size_t *> deque;
+		std::atomic<size_t> taken(0);
+		std::atomic<bool> done(false);
+
+		std::vector<std::thread> thieves;
+		for (int t = 0; t < 3; t++) {
+			thieves.emplace_back([&]() {
+				while (!done) {
+					size_t * item = deque.steal();
+					if (item != nullptr) {
+						seen[*item]++;
+						taken++;
+					}
+				}
+			});
+		}
+
+		for (size_t i = 0; i < count; i++) {
+			deque.push(&items[i]);
+			if (i % 3 == 0) {
+				size_t * item = deque.take();
+				if (item != nullptr) {
+					seen[*item]++;
+					taken++;
+				}
+			}
+		}
+
+		waitFor(taken, count);
+		done = true;
+		for (auto & thief : thieves)
+			thief.join();
+
+		for (size_t i = 0; i < count; i++)
+			REQUIRE( seen[i] == 1 );
+	}
+}
+
+TEST_CASE( "Executors", "[Executor]" ) {
+	for (ExecutorKind kind : { POOL, STEALING }) {
+		SECTION( std::string("runs every task once, ") + (kind == POOL ? "pool" : "stealing") ) {
+			const size_t count = 20000;
+			auto executor = makeExecutor(kind, 4, 64, QUEUE);
+			std::atomic<size_t> ran(0);
+
+			executor->start();
+			for (size_t i = 0; i < count; i++)
+				REQUIRE( executor->submit(&ran, [&ran]() { ran++; }) );
+
+			waitFor(ran, count);
+			executor->stop();
+
+			ExecutorMetrics metrics = executor->metrics();
+			REQUIRE( ran == count );
+			REQUIRE( metrics.submitted == count );
+			REQUIRE( metrics.maxDepth <= 64 );
+			REQUIRE( metrics.dropped == 0 );
+		}
+
+		SECTION( std::string("drops and coalesces when full, ") + (kind == POOL ? "pool" : "stealing") ) {
+			int jobs[3];
+			std::mutex mutex;
+			std::condition_variable released;
+			bool release = false;
+			std::atomic<size_t> ran(0);
+
+			auto blocked = [&]() {
+				std::unique_lock<std::mutex> lock(mutex);
+				released.wait(lock, [&]() { return release; });
+				ran++;
+			};
+
+			// nothing runs until released, so everything stays queued
+			auto dropping = makeExecutor(kind, 1, 2, DROP);
+			REQUIRE( dropping->submit(&jobs[0], blocked) );
+			REQUIRE( dropping->submit(&jobs[1], blocked) );
+			REQUIRE( !dropping->submit(&jobs[2], blocked) );
+			REQUIRE( dropping->metrics().dropped == 1 );
+
+			auto coalescing = makeExecutor(kind, 1, 2, COALESCE);
+			REQUIRE( coalescing->submit(&jobs[0], blocked) );
+			REQUIRE( !coalescing->submit(&jobs[0], blocked) );
+			REQUIRE( coalescing->submit(&jobs[1], blocked) );
+			REQUIRE( coalescing->metrics().coalesced == 1 );
+			REQUIRE( coalescing->metrics().depth == 2 );
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				release = true;
+			}
+			released.notify_all();
+
+			dropping->start();
+			coalescing->start();
+			waitFor(ran, 4);
+			dropping->stop();
+			coalescing->stop();
+
+			REQUIRE( coalescing->metrics().executed == 2 );
+		}
+
+		SECTION( std::string("never waits on a full queue from inside, ") + (kind == POOL ? "pool" : "stealing") ) {
+			// a single worker filling the queue from its own task would wait on itself under QUEUE
+			auto executor = makeExecutor(kind, 1, 2, QUEUE);
+			std::atomic<size_t> ran(0);
+			std::atomic<size_t> dropped(0);
+			std::atomic<bool> done(false);
+
+			executor->start();
+			REQUIRE( executor->submit(&ran, [&]() {
+				for (int i = 0; i < 4; i++) {
+					if (!executor->submit(&ran, [&ran]() { ran++; }, INTERNAL))
+						dropped++;
+				}
+
+				for (int i = 0; i < 4; i++)
+					executor->submit(&ran, [&ran]() { ran++; }, CONTINUATION);
+
+				done = true;
+			}) );
+
+			while (!done)
+				std::this_thread::yield();
+			waitFor(ran, 6);
+			executor->stop();
+
+			REQUIRE( dropped == 2 );
+			REQUIRE( ran == 6 );
+			REQUIRE( executor->metrics().maxDepth == 6 );
+		}
+	}
+}
+
+TEST_CASE( "Run slots", "[Executor]" ) {
+	SECTION( "runs past the limit are turned down" ) {
+		RunSlots slots(2);
+
+		REQUIRE( slots.acquire() );
+		REQUIRE( slots.acquire() );
+		REQUIRE( !slots.acquire() );
+		REQUIRE( slots.running() == 2 );
+
+		REQUIRE( !slots.release() );
+		REQUIRE( slots.acquire() );
+	}
+
+	SECTION( "a slot goes straight to a waiting run" ) {
+		RunSlots slots(1);
+
+		REQUIRE( slots.acquire() );
+		REQUIRE( slots.enqueue() );
+		REQUIRE( !slots.startQueued() );
+
+		REQUIRE( slots.release() );
+		REQUIRE( slots.running() == 1 );
+		REQUIRE( slots.queued() == 0 );
+
+		REQUIRE( !slots.release() );
+		REQUIRE( slots.running() == 0 );
+	}
+
+	SECTION( "how many can wait is bounded on request" ) {
+		RunSlots slots(1);
+
+		REQUIRE( slots.acquire() );
+		REQUIRE( slots.enqueue(1) );
+		REQUIRE( !slots.enqueue(1) );
+		REQUIRE( slots.queued() == 1 );
+	}
+
+	SECTION( "no limit" ) {
+		RunSlots slots(0);
+
+		for (int i = 0; i < 100; i++)
+			REQUIRE( slots.acquire() );
+	}
+
+	SECTION( "every queued run gets started exactly once" ) {
+		RunSlots slots(2);
+		std::atomic<size_t> started(0);
+		std::atomic<size_t> queued(0);
+		const size_t fired = 4000;
+
+		// a run is over as soon as it starts, and hands its slot on like the scheduler does
+		std::function<void()> run = [&]() {
+			started++;
+			while (slots.release())
+				started++;
+		};
+
+		std::vector<std::thread> firing;
+		for (int t = 0; t < 4; t++) {
+			firing.emplace_back([&]() {
+				for (size_t i = 0; i < fired / 4; i++) {
+					if (slots.acquire()) {
+						run();
+						continue;
+					}
+
+					queued++;
+					slots.enqueue();
+					if (slots.startQueued())
+						run();
+				}
+			});
+		}
+
+		for (auto & thread : firing)
+			thread.join();
+
+		REQUIRE( started.load() == fired );
+		REQUIRE( slots.running() == 0 );
+		REQUIRE( slots.queued() == 0 );
+	}
+}
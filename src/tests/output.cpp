@@ -0,0 +1,112 @@
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <unistd.h>
+
+#include "catch.hpp"
+
+#include "../output.h"
+#include "../process.h"
+
+using namespace output;
+using namespace std::chrono;
+
+std::string readWhole(const std::string & path)
+{
+	std::ifstream file(path);
+	std::stringstream contents;
+	contents << file.rdbuf();
+	return contents.str();
+}
+
+TEST_CASE( "Output capture", "[Output]" ) {
+	scheduling::EventLoop loop;
+	OutputWriter writer;
+	loop.start();
+	writer.start();
+
+	char pattern[] = "/tmp/automaniac-output-XXXXXX";
+	std::string directory = mkdtemp(pattern);
+	std::string path = directory + "/job.out";
+
+	SECTION( "stdout and stderr end up in the file, in order" ) {
+		std::shared_ptr<OutputFile> file = writer.open(path);
+
+		for (const char * script : { "echo one; echo two >&2", "echo three" }) {
+			std::shared_ptr<Capture> capture = Capture::open(loop, file);
+			REQUIRE( capture != nullptr );
+
+			auto status = processes::run("/bin/sh", { "sh", "-c", script }, {}, capture->childEnd());
+			capture->closeChildEnd();
+
+			REQUIRE( status.getResult() == 0 );
+			REQUIRE( capture->waitDrained(milliseconds(2000)) );
+		}
+
+		writer.stop();
+		REQUIRE( readWhole(path) == "one\ntwo\nthree\n" );
+	}
+
+	SECTION( "jobs sharing a file share its buffer" ) {
+		REQUIRE( writer.open(path) == writer.open(path) );
+	}
+
+	SECTION( "output larger than the buffer gets through whole" ) {
+		std::shared_ptr<OutputFile> file = writer.open(path);
+		std::shared_ptr<Capture> capture = Capture::open(loop, file);
+
+		// 16 MiB of zeros, four times what's buffered before the pipe stops being read
+		auto status = processes::run("/bin/sh", { "sh", "-c", "head -c 16777216 /dev/zero" }, {}, 
+									 capture->childEnd());
+		capture->closeChildEnd();
+
+		REQUIRE( status.getResult() == 0 );
+		REQUIRE( capture->waitDrained(milliseconds(5000)) );
+
+		writer.stop();
+		REQUIRE( readWhole(path).size() == 16777216 );
+	}
+
+	SECTION( "files are rotated once they reach their size" ) {
+		RotationPolicy rotation;
+		rotation.maxSize = 10;
+		rotation.keep = 2;
+		std::shared_ptr<OutputFile> file = writer.open(path, rotation);
+
+		// restarting the writer writes out each batch on its own
+		for (const char * line : { "first\n", "second\n", "third\n", "fourth\n" }) {
+			file->append(line, std::strlen(line));
+			writer.stop();
+			writer.start();
+		}
+
+		REQUIRE( readWhole(path) == "fourth\n" );
+		REQUIRE( readWhole(path + ".1") == "third\n" );
+		REQUIRE( readWhole(path + ".2") == "second\n" );
+		REQUIRE( access((path + ".3").c_str(), F_OK) != 0 );
+	}
+
+	SECTION( "files are rotated once they are old enough" ) {
+		RotationPolicy rotation;
+		rotation.interval = milliseconds(50);
+		std::shared_ptr<OutputFile> file = writer.open(path, rotation);
+
+		file->append("old\n", 4);
+		writer.stop();
+		writer.start();
+
+		std::this_thread::sleep_for(milliseconds(100));
+		file->append("new\n", 4);
+		writer.stop();
+
+		REQUIRE( readWhole(path) == "new\n" );
+		REQUIRE( readWhole(path + ".1") == "old\n" );
+	}
+
+	writer.stop();
+	loop.stop();
+	std::system(("rm -rf " + directory).c_str());
+}
@@ -1,8 +1,17 @@
 #include <string>
+#include <fstream>
+#include <cstdio>
+
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
 
 #include "catch.hpp"
 
 #include "../jobs.h"
+#include "../mapped-file.h"
+#include "../job-cache.h"
+#include "../job-index.h"
 
 using namespace jobparsers;
 
@@ -170,24 +179,30 @@ TEST_CASE( "Statements extraction", "[Statements]" ) {
 	}
 
 	SECTION( "command with arguments" ) {
-		Statement result = parseStatement("command arg");
+		Statement result = parseStatement("command arg").getResult();
 		REQUIRE( result.runner.compare("command") == 0 );
 		REQUIRE( result.arguments.size() == 1 );
 		REQUIRE( result.arguments.at(0).compare("arg") == 0 );
 	}
 
 	SECTION( "command with no arguments" ) {
-		Statement result = parseStatement("command");
+		Statement result = parseStatement("command").getResult();
 		REQUIRE( result.runner.compare("command") == 0 );
 		REQUIRE( result.arguments.size() == 0 );
 	}
 
 	SECTION( "command with arguments-multiple spaces" ) {
-		Statement result = parseStatement("command  \t arg");
+		Statement result = parseStatement("command  \t arg").getResult();
 		REQUIRE( result.runner.compare("command") == 0 );
 		REQUIRE( result.arguments.size() == 1 );
 		REQUIRE( result.arguments.at(0).compare("arg") == 0 );
 	}
+
+	SECTION( "command with quoted arguments" ) {
+		Statement result = parseStatement("exec echo \"hello  world\" 'it''s' \"\"").getResult();
+		REQUIRE( result.runner.compare("exec") == 0 );
+		REQUIRE( result.arguments == std::vector<std::string>({ "echo", "hello  world", "its", "" }) );
+	}
 }
 
 TEST_CASE( "Parsing" ) {
@@ -218,4 +233,426 @@ TEST_CASE( "Parsing" ) {
 		// REQUIRE( result.getResult().options.at("arg1").compare("val1") == 0 );
 		// REQUIRE( result.getResult().options.at("arg2").compare("val2") == 0 );
 	}
-}
\ No newline at end of file
+
+	SECTION( "parsing debounce options" ) {
+		ResultOrError<JobDescription> result = parseDescription("watch x (debounce = 500ms, max_delay = 5s):");
+
+		REQUIRE( result.succeeded() );
+		REQUIRE( result.getResult().options.debounce == std::chrono::milliseconds(500) );
+		REQUIRE( result.getResult().options.maxDelay == std::chrono::milliseconds(5000) );
+	}
+
+	SECTION( "parsing output rotation options" ) {
+		ResultOrError<JobDescription> result = 
+			parseDescription("every 1 seconds (output = x.log, output_max_size = 10M, output_keep = 3, output_rotate = 24h):");
+
+		REQUIRE( result.succeeded() );
+		REQUIRE( result.getResult().options.outputMaxSize == 10 * 1024 * 1024 );
+		REQUIRE( result.getResult().options.outputKeep == 3 );
+		REQUIRE( result.getResult().options.outputRotate == std::chrono::hours(24) );
+		REQUIRE( parseDescription("every 1 seconds (output_max_size = 10X):").failed() );
+		REQUIRE( parseDescription("every 1 seconds (output_max_size = 20000000000G):").failed() );
+		REQUIRE( parseDescription("every 1 seconds (output_max_size = 17179869183G):").getResult().options.outputMaxSize == 17179869183ULL << 30 );
+		REQUIRE( parseDescription("every 1 seconds (output_keep = 0):").getResult().options.outputKeep == 0 );
+		REQUIRE( parseDescription("every 1 seconds (output_keep = 1000):").getResult().options.outputKeep == 1000 );
+		REQUIRE( parseDescription("every 1 seconds (output_keep = -1):").failed() );
+		REQUIRE( parseDescription("every 1 seconds (output_keep = 3x):").failed() );
+		REQUIRE( parseDescription("every 1 seconds (output_keep = 1001):").failed() );
+	}
+
+	SECTION( "parsing timeouts" ) {
+		ResultOrError<Job> job = parseJob({ 
+			"every 1 seconds (timeout = 1m, kill_grace = 2s):",
+			"exec (timeout = 30s) make all",
+			"exec make clean"
+		});
+
+		REQUIRE( job.succeeded() );
+		REQUIRE( job.getResult().description.options.timeout == std::chrono::minutes(1) );
+		REQUIRE( job.getResult().description.options.killGrace == std::chrono::seconds(2) );
+		REQUIRE( job.getResult().statements.at(0).timeout == std::chrono::seconds(30) );
+		REQUIRE( job.getResult().statements.at(0).arguments == std::vector<std::string> { "make", "all" } );
+		REQUIRE( job.getResult().statements.at(1).timeout.count() == 0 );
+
+		REQUIRE( parseStatement("exec (timeout = soon) make").failed() );
+		REQUIRE( parseStatement("exec (timeout = 1s make").failed() );
+	}
+
+	SECTION( "parsing resource limits" ) {
+		ResultOrError<JobDescription> result = parseDescription(
+			"every 1 seconds (cpu_max = 50%, memory_max = 256M, pids_max = 64, io_weight = 200):");
+
+		REQUIRE( result.succeeded() );
+		REQUIRE( result.getResult().options.cpuMax == 50000 );
+		REQUIRE( result.getResult().options.memoryMax == 256 * 1024 * 1024 );
+		REQUIRE( result.getResult().options.pidsMax == 64 );
+		REQUIRE( result.getResult().options.ioWeight == 200 );
+
+		REQUIRE( parseDescription("every 1 seconds (cpu_max = 1.5):").getResult().options.cpuMax == 150000 );
+		REQUIRE( parseDescription("every 1 seconds:").getResult().options.cpuMax == 0 );
+
+		REQUIRE( parseDescription("every 1 seconds (cpu_max = 0.5%):").failed() );
+		REQUIRE( parseDescription("every 1 seconds (cpu_max = half):").failed() );
+		REQUIRE( parseDescription("every 1 seconds (memory_max = 0):").failed() );
+		REQUIRE( parseDescription("every 1 seconds (pids_max = -1):").failed() );
+		REQUIRE( parseDescription("every 1 seconds (io_weight = 10001):").failed() );
+	}
+
+	SECTION( "parsing overlap policies" ) {
+		REQUIRE( parseDescription("every 1 seconds:").getResult().options.overlap == OVERLAP_SKIP );
+		REQUIRE( parseDescription("every 1 seconds:").getResult().options.concurrency == 1 );
+		REQUIRE( parseDescription("every 1 seconds (overrun = catchup):").getResult().options.overlap == OVERLAP_SKIP );
+		REQUIRE( parseDescription("every 1 seconds (overlap = replace):").getResult().options.overlap == OVERLAP_REPLACE );
+
+		ResultOrError<JobDescription> parallel = parseDescription("every 1 seconds (overlap = parallel):");
+		REQUIRE( parallel.getResult().options.overlap == OVERLAP_PARALLEL );
+		REQUIRE( parallel.getResult().options.concurrency == 0 );
+
+		ResultOrError<JobDescription> limited = parseDescription(
+			"every 1 seconds (overlap = queue, concurrency = 3):");
+		REQUIRE( limited.getResult().options.overlap == OVERLAP_QUEUE );
+		REQUIRE( limited.getResult().options.concurrency == 3 );
+
+		REQUIRE( parseDescription("every 1 seconds (overlap = sometimes):").failed() );
+		REQUIRE( parseDescription("every 1 seconds (concurrency = 0):").failed() );
+	}
+
+	SECTION( "parsing a malformed debounce option" ) {
+		REQUIRE( parseDescription("watch x (debounce = 5):").failed() );
+		REQUIRE( parseDescription("watch x (debounce = fast):").failed() );
+	}
+
+	SECTION( "parsing arguments with colons" ) {
+		ResultOrError<JobDescription> daily = parseDescription("daily 12:30:00 (name = backup):");
+		REQUIRE( daily.succeeded() );
+		REQUIRE( daily.getResult().scheduler.compare("daily") == 0 );
+		REQUIRE( daily.getResult().arguments.compare("12:30:00") == 0 );
+
+		ResultOrError<JobDescription> attached = parseDescription("every 5 seconds:");
+		REQUIRE( attached.getResult().arguments.compare("5 seconds") == 0 );
+	}
+}
+
+TEST_CASE( "Parsing whole files" ) {
+	SECTION( "jobs and their statements" ) {
+		ParsedJobs parsed = parseJobs(
+			"# a comment\n"
+			"every 1 seconds (name = first):\n"
+			"\texec echo 'a b'\n"
+			"\n"
+			"  # an indented comment\n"
+			"  run (timeout = 5s) make all\n"
+			"once:\n"
+			"\texec true");
+
+		REQUIRE( parsed.errors.empty() );
+		REQUIRE( parsed.jobs.size() == 2 );
+		REQUIRE( parsed.jobs.at(0).description.options.name.compare("first") == 0 );
+		REQUIRE( parsed.jobs.at(0).statements.size() == 2 );
+		REQUIRE( parsed.jobs.at(0).statements.at(0).arguments.at(1).compare("a b") == 0 );
+		REQUIRE( parsed.jobs.at(0).statements.at(1).runner.compare("run") == 0 );
+		REQUIRE( parsed.jobs.at(0).statements.at(1).timeout == std::chrono::seconds(5) );
+		REQUIRE( parsed.jobs.at(1).statements.size() == 1 );
+	}
+
+	SECTION( "errors with lines and columns" ) {
+		ParsedJobs parsed = parseJobs(
+			"every 1 seconds (name first):\n"
+			"\texec echo\n"
+			"once:\n"
+			"\texec echo 'open\n"
+			"every 2 seconds:\n"
+			"\texec true\n"
+			"every 3 seconds (timeout = never):\n");
+
+		REQUIRE( parsed.jobs.size() == 1 );
+		REQUIRE( parsed.jobs.at(0).description.arguments.compare("2 seconds") == 0 );
+		REQUIRE( parsed.errors.size() == 3 );
+		REQUIRE( parsed.errors.at(0).message.compare("1:23: Expected '=' after option 'name'") == 0 );
+		REQUIRE( parsed.errors.at(1).message.compare("4:12: Unclosed quote") == 0 );
+		REQUIRE( parsed.errors.at(2).message.find("7:17: Invalid value for option 'timeout'") == 0 );
+	}
+
+	SECTION( "statements before any job" ) {
+		ParsedJobs parsed = parseJobs("\texec true\nonce:\n", 10);
+		REQUIRE( parsed.jobs.size() == 1 );
+		REQUIRE( parsed.errors.size() == 1 );
+		REQUIRE( parsed.errors.at(0).message.compare("10:2: Statement outside of any job") == 0 );
+	}
+
+	SECTION( "jobs one after another" ) {
+		std::vector<std::string> lines = { "once:", "\texec a", "once:", "\texec b", "once:" };
+		auto jobsLines = separateJobsLines(lines);
+		REQUIRE( jobsLines.size() == 3 );
+		REQUIRE( jobsLines.at(1).at(1).compare("exec b") == 0 );
+		REQUIRE( jobsLines.at(2).size() == 1 );
+	}
+
+	SECTION( "job boundaries" ) {
+		StringView text = "once:\n\texec a\n# note\n\nevery 1 seconds:\n  exec b\n";
+		REQUIRE( nextJobBoundary(text, 0) == 0 );
+		REQUIRE( nextJobBoundary(text, 1) == 22 );
+		REQUIRE( nextJobBoundary(text, 22) == 22 );
+		REQUIRE( nextJobBoundary(text, 23) == text.size() );
+		REQUIRE( countJobs(text) == 2 );
+	}
+
+	SECTION( "mapped files" ) {
+		char path[] = "/tmp/parsing-test-XXXXXX";
+		int fd = mkstemp(path);
+		REQUIRE( fd >= 0 );
+		close(fd);
+
+		std::ofstream(path) << "once:\n\texec a\nevery 1 seconds (name = x y):\n\texec b\nonce:\n";
+
+		auto file = MappedFile::open(path);
+		REQUIRE( file.succeeded() );
+		REQUIRE( file.getResult()->mapped() );
+
+		ParsedJobs parsed = parseJobFile(*file.getResult());
+		REQUIRE( parsed.jobs.size() == 2 );
+		REQUIRE( parsed.errors.size() == 1 );
+		REQUIRE( parsed.errors.at(0).message.find("3:") == 0 );
+
+		std::remove(path);
+		REQUIRE( MappedFile::open(path).failed() );
+	}
+
+	SECTION( "mapped files parsed in parallel" ) {
+		char path[] = "/tmp/parsing-test-XXXXXX";
+		int fd = mkstemp(path);
+		REQUIRE( fd >= 0 );
+		close(fd);
+
+		// well over one block, with a bad job every hundred
+		{
+			std::ofstream out(path);
+			for (unsigned i = 0; i < 20000; i++) {
+				if (i % 100 == 99)
+					out << "every 1 seconds (name = " << i << "\n\texec true\n";
+				else
+					out << "every 1 seconds (name = job" << i << "):\n\texec echo " << i << "\n";
+			}
+		}
+
+		auto file = MappedFile::open(path);
+		REQUIRE( file.succeeded() );
+
+		ParsedJobs sequential = parseJobFile(*file.getResult(), 1);
+		ParsedJobs parallel = parseJobFile(*file.getResult(), 4);
+
+		REQUIRE( parallel.jobs.size() == 19800 );
+		REQUIRE( parallel.errors.size() == 200 );
+		REQUIRE( parallel.jobs.at(99).description.options.name.compare("job100") == 0 );
+		REQUIRE( parallel.jobs.back().statements.at(0).arguments.at(1).compare("19998") == 0 );
+		REQUIRE( parallel.errors.at(0).message.find("199:") == 0 );
+		REQUIRE( parallel.errors.back().message.find("39999:") == 0 );
+
+		bool same = sequential.jobs.size() == parallel.jobs.size() && sequential.errors.size() == parallel.errors.size();
+		for (size_t i = 0; same && i < parallel.jobs.size(); i++)
+			same = sequential.jobs.at(i).description.options.name.compare(parallel.jobs.at(i).description.options.name) == 0;
+		for (size_t i = 0; same && i < parallel.errors.size(); i++)
+			same = sequential.errors.at(i).message.compare(parallel.errors.at(i).message) == 0;
+		REQUIRE( same );
+
+		std::remove(path);
+	}
+}
+
+TEST_CASE( "Job cache" ) {
+	char source[] = "/tmp/cache-source-XXXXXX";
+	int fd = mkstemp(source);
+	REQUIRE( fd >= 0 );
+	close(fd);
+
+	std::string cachePath = std::string(source) + ".jobs";
+
+	std::ofstream(source) << 
+		"every 5 seconds (name = first, output = /tmp/out, timeout = 1m, memory_max = 64M, overlap = replace):\n"
+		"\texec (timeout = 5s) echo 'a b' c\n"
+		"\texec true\n"
+		"once:\n";
+
+	SECTION( "written and read back" ) {
+		auto loaded = loadJobFile(source, cachePath);
+		REQUIRE( loaded.succeeded() );
+		REQUIRE( !loaded.getResult()->fromCache );
+		REQUIRE( loaded.getResult()->cacheProblem.empty() );
+
+		auto cache = JobCache::open(cachePath);
+		REQUIRE( cache.succeeded() );
+
+		std::vector<Job> jobs = cache.getResult()->jobs();
+		const std::vector<Job> & parsed = loaded.getResult()->parsed.jobs;
+		REQUIRE( jobs.size() == 2 );
+		REQUIRE( jobs.at(0).description.scheduler.compare("every") == 0 );
+		REQUIRE( jobs.at(0).description.arguments.compare("5 seconds") == 0 );
+		REQUIRE( jobs.at(0).description.options.name.compare("first") == 0 );
+		REQUIRE( jobs.at(0).description.options.outputFile.compare("/tmp/out") == 0 );
+		REQUIRE( jobs.at(0).description.options.timeout == parsed.at(0).description.options.timeout );
+		REQUIRE( jobs.at(0).description.options.memoryMax == 64 << 20 );
+		REQUIRE( jobs.at(0).description.options.overlap == OVERLAP_REPLACE );
+		REQUIRE( jobs.at(0).description.options.killGrace == parsed.at(0).description.options.killGrace );
+		REQUIRE( jobs.at(0).statements.size() == 2 );
+		REQUIRE( jobs.at(0).statements.at(0).timeout == std::chrono::seconds(5) );
+		REQUIRE( jobs.at(0).statements.at(0).arguments.size() == 3 );
+		REQUIRE( jobs.at(0).statements.at(0).arguments.at(1).compare("a b") == 0 );
+		REQUIRE( jobs.at(1).statements.empty() );
+	}
+
+	SECTION( "used until the source changes" ) {
+		REQUIRE( !loadJobFile(source, cachePath).getResult()->fromCache );
+		REQUIRE( loadJobFile(source, cachePath).getResult()->fromCache );
+
+		// only touched, it's still the same jobs
+		struct timeval times[2] = { { 1, 0 }, { 1, 0 } };
+		REQUIRE( utimes(source, times) == 0 );
+		REQUIRE( loadJobFile(source, cachePath).getResult()->fromCache );
+		REQUIRE( JobCache::open(cachePath).getResult()->key().mtime == 1000000000 );
+
+		std::ofstream(source, std::ios::app) << "once:\n";
+		auto changed = loadJobFile(source, cachePath);
+		REQUIRE( !changed.getResult()->fromCache );
+		REQUIRE( changed.getResult()->parsed.jobs.size() == 3 );
+		REQUIRE( loadJobFile(source, cachePath).getResult()->parsed.jobs.size() == 3 );
+	}
+
+	SECTION( "not written with errors" ) {
+		std::ofstream(source, std::ios::app) << "once (name x):\n";
+		REQUIRE( loadJobFile(source, cachePath).getResult()->parsed.errors.size() == 1 );
+		REQUIRE( JobCache::open(cachePath).failed() );
+	}
+
+	SECTION( "cut short" ) {
+		REQUIRE( loadJobFile(source, cachePath).succeeded() );
+
+		struct stat info;
+		REQUIRE( stat(cachePath.c_str(), &info) == 0 );
+		REQUIRE( truncate(cachePath.c_str(), info.st_size - 3) == 0 );
+		REQUIRE( JobCache::open(cachePath).failed() );
+
+		auto reloaded = loadJobFile(source, cachePath);
+		REQUIRE( !reloaded.getResult()->fromCache );
+		REQUIRE( reloaded.getResult()->parsed.jobs.size() == 2 );
+		REQUIRE( JobCache::open(cachePath).succeeded() );
+	}
+
+	std::remove(source);
+	std::remove(cachePath.c_str());
+}
+
+TEST_CASE( "Reloading" ) {
+	std::string text =
+		"# jobs\n"
+		"every 1 seconds (name = a):\n"
+		"\texec echo a\n"
+		"every 2 seconds (name = b):\n"
+		"\texec echo b\n"
+		"once (name = c):\n"
+		"\texec echo c\n";
+
+	JobIndex index;
+	IndexedJobs first = index.update(text);
+
+	auto runningJobs = [](const IndexedJobs & indexed) {
+		std::unordered_map<std::string, const Job *> running;
+		for (const auto & job : indexed.jobs)
+			running[job.identity] = &job.job;
+		return running;
+	};
+
+	SECTION( "identities" ) {
+		REQUIRE( first.errors.empty() );
+		REQUIRE( first.parsedBlocks == 4 );
+		REQUIRE( first.jobs.size() == 3 );
+		REQUIRE( first.jobs.at(0).identity.find("a@") == 0 );
+		REQUIRE( first.jobs.at(0).identity.compare(jobIdentity("a", "every 1 seconds (name = a):")) == 0 );
+
+		// the same job twice is told apart by its order
+		IndexedJobs twice = index.update("once (name = c):\n\texec x\nonce (name = c):\n\texec y\n");
+		REQUIRE( twice.jobs.size() == 2 );
+		REQUIRE( twice.jobs.at(1).identity.compare(twice.jobs.at(0).identity + "#2") == 0 );
+	}
+
+	SECTION( "only changed blocks are parsed" ) {
+		std::string changed = text;
+		changed.replace(changed.find("echo b"), 6, "echo B");
+
+		IndexedJobs second = index.update(changed);
+		REQUIRE( second.errors.empty() );
+		REQUIRE( second.parsedBlocks == 1 );
+		REQUIRE( second.jobs.at(1).job.statements.at(0).arguments.at(1).compare("B") == 0 );
+		REQUIRE( second.jobs.at(1).identity.compare(first.jobs.at(1).identity) == 0 );
+
+		// moved, not changed
+		size_t start = changed.find("every 1");
+		IndexedJobs third = index.update("once (name = c):\n\texec echo c\n" + 
+										 changed.substr(start, changed.find("once") - start));
+		REQUIRE( third.parsedBlocks == 0 );
+		REQUIRE( third.jobs.size() == 3 );
+	}
+
+	SECTION( "blocks with errors" ) {
+		IndexedJobs broken = index.update(text + "every 3 seconds (name = d:\n\texec true\n");
+		REQUIRE( broken.jobs.size() == 3 );
+		REQUIRE( broken.errors.size() == 1 );
+		REQUIRE( broken.errors.at(0).message.find("8:") == 0 );
+		REQUIRE( index.size() == 4 );
+	}
+
+	SECTION( "adopted jobs" ) {
+		JobIndex adopting;
+		IndexedJobs adopted;
+		ParsedJobs parsed = parseJobs(text);
+
+		REQUIRE( adopting.adopt(text, parsed.jobs, adopted) );
+		REQUIRE( adopted.jobs.size() == 3 );
+		REQUIRE( adopted.jobs.at(2).identity.compare(first.jobs.at(2).identity) == 0 );
+		REQUIRE( adopting.update(text).parsedBlocks == 0 );
+
+		// the file has a job more than was loaded, only its block is parsed
+		parsed.jobs.pop_back();
+		REQUIRE( JobIndex().adopt(text, parsed.jobs, adopted) );
+		REQUIRE( adopted.parsedBlocks == 1 );
+		REQUIRE( adopted.jobs.size() == 3 );
+		REQUIRE( adopted.jobs.at(2).identity.compare(first.jobs.at(2).identity) == 0 );
+
+		// the same scheduler with other arguments isn't the job loaded
+		parsed = parseJobs(text);
+		parsed.jobs.at(1).description.arguments = "7 minutes";
+		REQUIRE( JobIndex().adopt(text, parsed.jobs, adopted) );
+		REQUIRE( adopted.parsedBlocks == 1 );
+		REQUIRE( adopted.jobs.at(1).job.description.arguments.compare(first.jobs.at(1).job.description.arguments) == 0 );
+		REQUIRE( adopted.jobs.at(2).identity.compare(first.jobs.at(2).identity) == 0 );
+
+		REQUIRE_FALSE( JobIndex().adopt(text + "every 3 seconds (name = d:\n\texec true\n", parsed.jobs, adopted) );
+		REQUIRE( adopted.jobs.empty() );
+	}
+
+	SECTION( "differences" ) {
+		std::string changed =
+			"every 1 seconds (name = a):\n"
+			"\texec echo a\n"
+			"every 5 seconds (name = b):\n"
+			"\texec echo b\n"
+			"once (name = c):\n"
+			"\texec echo C\n"
+			"once (name = d):\n"
+			"\texec echo d\n";
+
+		IndexedJobs second = index.update(changed);
+		JobChanges changes = diffJobs(runningJobs(first), second.jobs);
+
+		// b's description changed, so it's another job
+		REQUIRE( changes.unchanged == 1 );
+		REQUIRE( changes.changed.size() == 1 );
+		REQUIRE( second.jobs.at(changes.changed.at(0)).job.description.options.name.compare("c") == 0 );
+		REQUIRE( changes.added.size() == 2 );
+		REQUIRE( second.jobs.at(changes.added.at(0)).job.description.options.name.compare("b") == 0 );
+		REQUIRE( second.jobs.at(changes.added.at(1)).job.description.options.name.compare("d") == 0 );
+		REQUIRE( changes.removed.size() == 1 );
+		REQUIRE( changes.removed.at(0).compare(first.jobs.at(1).identity) == 0 );
+
+		REQUIRE( diffJobs(runningJobs(second), second.jobs).unchanged == 4 );
+	}
+}
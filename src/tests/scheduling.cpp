@@ -0,0 +1,273 @@
+#include <string>
+#include <vector>
+#include <fstream>
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "catch.hpp"
+
+#include "../jobs.h"
+#include "../schedulers.h"
+#include "../engine.h"
+
+using namespace schedulers;
+using namespace std::chrono;
+
+/* Where the runs of a test's jobs write down when they started */
+class RunLog
+{
+public:
+	RunLog()
+	{
+		char path[] = "/tmp/scheduling-test-XXXXXX";
+		int fd = mkstemp(path);
+		close(fd);
+		m_path = path;
+	}
+
+	~RunLog()
+	{
+		std::remove(m_path.c_str());
+		std::remove((m_path + ".first").c_str());
+	}
+
+	/* A statement writing "tag <ms since the epoch>" */
+	std::string stamp(const std::string & tag) const
+	{
+		return "exec sh -c 'echo " + tag + " $(($(date +%s%N) / 1000000)) >> " + m_path + "'";
+	}
+
+	/* Sleeps through the first run only */
+	std::string longFirstRun(unsigned milliseconds) const
+	{
+		std::string flag = m_path + ".first";
+		return "exec sh -c '[ -e " + flag + " ] || { touch " + flag + "; sleep " +
+			std::to_string(milliseconds / 1000.0) + "; }'";
+	}
+
+	/* When each run with tag started, in milliseconds since origin */
+	std::vector<long> starts(const std::string & tag, system_clock::time_point origin) const
+	{
+		std::vector<long> times;
+		long base = duration_cast<milliseconds>(origin.time_since_epoch()).count();
+
+		std::ifstream in(m_path);
+		std::string seen;
+		long at;
+		while (in >> seen >> at) {
+			if (seen.compare(tag) == 0)
+				times.push_back(at - base);
+		}
+
+		return times;
+	}
+
+private:
+	std::string m_path;
+};
+
+Job jobFrom(const std::string & text)
+{
+	ParsedJobs parsed = jobparsers::parseJobs(text);
+	REQUIRE( parsed.errors.empty() );
+	REQUIRE( parsed.jobs.size() == 1 );
+
+	return parsed.jobs.at(0);
+}
+
+/* The engine runs until the test's jobs are all unscheduled */
+class RunningEngine
+{
+public:
+	RunningEngine():
+		engine(scheduling::makeExecutor(scheduling::POOL, 2, 64, scheduling::QUEUE))
+	{
+		// so run() doesn't return before the first job is scheduled
+		engine.hold();
+		m_thread = std::thread([this]() { engine.run(); });
+	}
+
+	~RunningEngine()
+	{
+		finish();
+	}
+
+	void finish()
+	{
+		if (!m_thread.joinable())
+			return;
+
+		engine.release();
+		m_thread.join();
+	}
+
+	scheduling::Engine engine;
+
+private:
+	std::thread m_thread;
+};
+
+bool near(long actual, long expected, long slack = 120)
+{
+	return actual >= expected - slack && actual <= expected + slack;
+}
+
+TEST_CASE( "Fixed-rate overruns", "[Scheduling]" ) {
+	RunLog log;
+
+	// deadlines every 200 ms, the first run takes 700 and holds up those at 400, 600 and 800
+	auto overrunning = [&log](const std::string & overrun) {
+		return jobFrom("every 200 milliseconds (overrun = " + overrun + "):\n"
+					   "\t" + log.stamp("run") + "\n"
+					   "\t" + log.longFirstRun(700) + "\n");
+	};
+
+	SECTION( "missed runs are skipped and the cadence goes on" ) {
+		RunningEngine running;
+		system_clock::time_point origin = system_clock::now();
+		auto job = scheduleJob(running.engine, overrunning("skip"));
+
+		std::this_thread::sleep_for(1500ms);
+		unscheduleJob(running.engine, job);
+		running.finish();
+
+		std::vector<long> starts = log.starts("run", origin);
+		REQUIRE( starts.size() == 4 );
+		REQUIRE( near(starts.at(0), 200) );
+		REQUIRE( near(starts.at(1), 1000) );
+		REQUIRE( near(starts.at(2), 1200) );
+		REQUIRE( near(starts.at(3), 1400) );
+	}
+
+	SECTION( "missed runs are caught up back to back" ) {
+		RunningEngine running;
+		system_clock::time_point origin = system_clock::now();
+		auto job = scheduleJob(running.engine, overrunning("catchup"));
+
+		std::this_thread::sleep_for(1500ms);
+		unscheduleJob(running.engine, job);
+		running.finish();
+
+		std::vector<long> starts = log.starts("run", origin);
+		REQUIRE( starts.size() == 7 );
+		REQUIRE( near(starts.at(0), 200) );
+
+		// the three held up run as soon as the long one ends, then it's on cadence again
+		for (size_t i = 1; i <= 3; i++)
+			REQUIRE( near(starts.at(i), 900) );
+		REQUIRE( near(starts.at(4), 1000) );
+		REQUIRE( near(starts.at(6), 1400) );
+	}
+}
+
+TEST_CASE( "Reloaded jobs", "[Scheduling]" ) {
+	RunLog log;
+
+	SECTION( "a changed job keeps its pending deadline" ) {
+		RunningEngine running;
+		system_clock::time_point origin = system_clock::now();
+		auto job = scheduleJob(running.engine, jobFrom("after 600 milliseconds:\n\t" + log.stamp("old") + "\n"));
+
+		std::this_thread::sleep_for(300ms);
+		replaceJob(running.engine, job, jobFrom("after 600 milliseconds:\n\t" + log.stamp("new") + "\n"));
+
+		// it ran once and nothing is left armed, the engine is done
+		running.finish();
+
+		std::vector<long> starts = log.starts("new", origin);
+		REQUIRE( log.starts("old", origin).empty() );
+		REQUIRE( starts.size() == 1 );
+		REQUIRE( near(starts.at(0), 600) );
+	}
+
+	SECTION( "a changed fixed-rate job keeps its cadence" ) {
+		RunningEngine running;
+		system_clock::time_point origin = system_clock::now();
+		auto job = scheduleJob(running.engine, jobFrom("every 300 milliseconds:\n\t" + log.stamp("old") + "\n"));
+
+		std::this_thread::sleep_for(450ms);
+		auto replaced = replaceJob(running.engine, job, jobFrom("every 300 milliseconds:\n\t" + log.stamp("new") + "\n"));
+
+		std::this_thread::sleep_for(900ms);
+		unscheduleJob(running.engine, replaced);
+		running.finish();
+
+		std::vector<long> old = log.starts("old", origin);
+		REQUIRE( old.size() == 1 );
+		REQUIRE( near(old.at(0), 300) );
+
+		std::vector<long> starts = log.starts("new", origin);
+		REQUIRE( starts.size() == 3 );
+		REQUIRE( near(starts.at(0), 600) );
+		REQUIRE( near(starts.at(1), 900) );
+		REQUIRE( near(starts.at(2), 1200) );
+	}
+
+	SECTION( "a run going on finishes, and the new version waits for it" ) {
+		RunningEngine running;
+		system_clock::time_point origin = system_clock::now();
+		auto job = scheduleJob(running.engine, jobFrom("every 200 milliseconds:\n"
+													   "\t" + log.stamp("old") + "\n"
+													   "\texec sleep 0.5\n"
+													   "\t" + log.stamp("done") + "\n"));
+
+		// the run which started at 200 is still asleep
+		std::this_thread::sleep_for(300ms);
+		auto replaced = replaceJob(running.engine, job, jobFrom("every 200 milliseconds:\n\t" + log.stamp("new") + "\n"));
+
+		std::this_thread::sleep_for(800ms);
+		unscheduleJob(running.engine, replaced);
+		running.finish();
+
+		std::vector<long> done = log.starts("done", origin);
+		REQUIRE( log.starts("old", origin).size() == 1 );
+		REQUIRE( done.size() == 1 );
+		REQUIRE( near(done.at(0), 700) );
+
+		// those due at 400 and 600 found the old run in their way and were skipped
+		std::vector<long> starts = log.starts("new", origin);
+		REQUIRE( starts.size() == 2 );
+		REQUIRE( near(starts.at(0), 800) );
+		REQUIRE( near(starts.at(1), 1000) );
+	}
+
+	SECTION( "a removed job doesn't run again and lets the engine go" ) {
+		RunningEngine running;
+		system_clock::time_point origin = system_clock::now();
+		auto job = scheduleJob(running.engine, jobFrom("every 200 milliseconds:\n\t" + log.stamp("run") + "\n"));
+
+		std::this_thread::sleep_for(500ms);
+		unscheduleJob(running.engine, job);
+		std::this_thread::sleep_for(500ms);
+
+		steady_clock::time_point finishing = steady_clock::now();
+		running.finish();
+		REQUIRE( steady_clock::now() - finishing < 200ms );
+
+		std::vector<long> starts = log.starts("run", origin);
+		REQUIRE( starts.size() == 2 );
+		REQUIRE( near(starts.at(0), 200) );
+		REQUIRE( near(starts.at(1), 400) );
+	}
+
+	SECTION( "an added job keeps to its own schedule" ) {
+		RunningEngine running;
+		system_clock::time_point origin = system_clock::now();
+		auto job = scheduleJob(running.engine, jobFrom("every 200 milliseconds:\n\t" + log.stamp("first") + "\n"));
+
+		std::this_thread::sleep_for(300ms);
+		scheduleJob(running.engine, jobFrom("after 400 milliseconds:\n\t" + log.stamp("added") + "\n"));
+
+		std::this_thread::sleep_for(600ms);
+		unscheduleJob(running.engine, job);
+		running.finish();
+
+		std::vector<long> added = log.starts("added", origin);
+		REQUIRE( added.size() == 1 );
+		REQUIRE( near(added.at(0), 700) );
+		REQUIRE( log.starts("first", origin).size() == 4 );
+	}
+}
@@ -0,0 +1,183 @@
+#include <vector>
+#include <map>
+#include <random>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "catch.hpp"
+
+#include "../timer-store.h"
+#include "../timing-wheel.h"
+#include "../timer-queue.h"
+
+using namespace scheduling;
+using namespace std::chrono;
+
+void checkExpiresOnTime(TimerStore & store, Clock::time_point origin, 
+						const std::vector<milliseconds> & delays, milliseconds step)
+{
+	std::map<TimerId, Clock::time_point> deadlines;
+	for (TimerId id = 0; id < delays.size(); id++) {
+		deadlines[id] = origin + delays.at(id);
+		store.add(id, deadlines[id]);
+	}
+
+	Clock::time_point now = origin;
+	std::vector<TimerId> expired;
+
+	while (!deadlines.empty()) {
+		now += step;
+		expired.clear();
+		store.expire(now, expired);
+
+		for (TimerId id : expired) {
+			REQUIRE( deadlines.count(id) == 1 );
+			REQUIRE( deadlines.at(id) <= now );
+			REQUIRE( deadlines.at(id) >= now - step );
+			deadlines.erase(id);
+		}
+
+		// anything still pending isn't due yet
+		for (const auto & entry : deadlines)
+			REQUIRE( entry.second > now );
+	}
+
+	REQUIRE( store.size() == 0 );
+	REQUIRE( store.nextDeadline() == Clock::time_point::max() );
+}
+
+std::vector<milliseconds> randomDelays(size_t count, long maxMillis)
+{
+	std::mt19937 generator(42);
+	std::uniform_int_distribution<long> distribution(0, maxMillis);
+	std::vector<milliseconds> delays;
+
+	for (size_t i = 0; i < count; i++)
+		delays.push_back(milliseconds(distribution(generator)));
+
+	return delays;
+}
+
+TEST_CASE( "Timer stores", "[Timers]" ) {
+	Clock::time_point origin = Clock::now();
+
+	SECTION( "heap expires on time" ) {
+		TimerHeap heap;
+		checkExpiresOnTime(heap, origin, randomDelays(500, 5000), milliseconds(1));
+	}
+
+	SECTION( "wheel expires on time within a second" ) {
+		TimingWheel wheel(origin);
+		checkExpiresOnTime(wheel, origin, randomDelays(500, 999), milliseconds(1));
+	}
+
+	SECTION( "wheel expires on time across levels" ) {
+		TimingWheel wheel(origin);
+		checkExpiresOnTime(wheel, origin, randomDelays(500, 3 * 3600 * 1000), milliseconds(250));
+	}
+
+	SECTION( "wheel expires deadlines beyond a day" ) {
+		TimingWheel wheel(origin);
+		checkExpiresOnTime(wheel, origin, { hours(30), hours(49), hours(24) }, minutes(1));
+	}
+
+	SECTION( "wheel expires past deadlines right away" ) {
+		TimingWheel wheel(origin);
+		std::vector<TimerId> expired;
+
+		wheel.expire(origin + seconds(5), expired);
+		wheel.add(1, origin + seconds(1));
+
+		REQUIRE( wheel.nextDeadline() <= origin + seconds(5) );
+		wheel.expire(origin + seconds(5), expired);
+		REQUIRE( expired.size() == 1 );
+	}
+
+	SECTION( "wheel reports the next deadline" ) {
+		TimingWheel wheel(origin);
+		wheel.add(1, origin + milliseconds(1500));
+
+		Clock::time_point next = wheel.nextDeadline();
+		REQUIRE( next > origin );
+		REQUIRE( next <= origin + milliseconds(1500) );
+	}
+}
+
+TEST_CASE( "Fixed-rate cadence", "[Timers]" ) {
+	Clock::time_point start = Clock::now();
+
+	SECTION( "deadlines are computed from the start" ) {
+		Cadence cadence { start, seconds(60), 1 };
+		REQUIRE( cadence.deadline() == start + seconds(60) );
+
+		// a run which took 5 seconds doesn't move the next deadline
+		cadence.advance(start + seconds(65), true);
+		REQUIRE( cadence.deadline() == start + seconds(120) );
+	}
+
+	SECTION( "overrunning runs catch up" ) {
+		Cadence cadence { start, seconds(60), 1 };
+		cadence.advance(start + seconds(150), false);
+		REQUIRE( cadence.deadline() == start + seconds(120) );
+	}
+
+	SECTION( "overrunning runs skip missed deadlines" ) {
+		Cadence cadence { start, seconds(60), 1 };
+		cadence.advance(start + seconds(150), true);
+		REQUIRE( cadence.deadline() == start + seconds(180) );
+
+		cadence.advance(start + seconds(240), true);
+		REQUIRE( cadence.deadline() == start + seconds(240) );
+	}
+
+	SECTION( "jitter doesn't accumulate" ) {
+		const milliseconds period(20);
+		const milliseconds work(7);
+		const unsigned long runs = 40;
+
+		TimerQueue timers;
+		std::vector<Clock::duration> lateness;
+		std::mutex mutex;
+		std::condition_variable done;
+
+		std::function<void(Cadence)> arm = [&](Cadence cadence) {
+			timers.scheduleAt(cadence.deadline(), [&, cadence]() {
+				Clock::time_point fired = Clock::now();
+				std::this_thread::sleep_for(work);
+
+				std::lock_guard<std::mutex> lock(mutex);
+				lateness.push_back(fired - cadence.deadline());
+
+				if (lateness.size() == runs) {
+					done.notify_one();
+					return;
+				}
+
+				Cadence next = cadence;
+				next.advance(Clock::now(), true);
+				arm(next);
+			});
+		};
+
+		arm(Cadence { Clock::now(), period, 1 });
+		timers.start();
+
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			done.wait(lock, [&]() { return lateness.size() == runs; });
+		}
+		timers.stop();
+
+		Clock::duration total = Clock::duration::zero();
+		for (const auto & late : lateness) {
+			REQUIRE( late >= Clock::duration::zero() );
+			total += late;
+		}
+
+		// with fixed delays the last run would be runs * work = 280 ms late
+		REQUIRE( lateness.back() < milliseconds(10) );
+		REQUIRE( total / runs < milliseconds(5) );
+	}
+}
@@ -0,0 +1,249 @@
+#include <string>
+#include <vector>
+#include <fstream>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "catch.hpp"
+
+#include "../file-watch.h"
+#include "../watch-trigger.h"
+
+using namespace watchers;
+using namespace std::chrono;
+
+struct EventLog
+{
+	std::vector<WatchEvent> events;
+	std::mutex mutex;
+	std::condition_variable changed;
+
+	WatchCallback callback() {
+		return [this](const WatchEvent & event) {
+			std::lock_guard<std::mutex> lock(mutex);
+			events.push_back(event);
+			changed.notify_all();
+		};
+	}
+
+	bool waitFor(size_t count, milliseconds timeout = milliseconds(2000)) {
+		std::unique_lock<std::mutex> lock(mutex);
+		return changed.wait_for(lock, timeout, [&]() { return events.size() >= count; });
+	}
+};
+
+std::string makeTempDirectory()
+{
+	char pattern[] = "/tmp/automaniac-watch-XXXXXX";
+	return mkdtemp(pattern);
+}
+
+TEST_CASE( "Glob matching", "[Watch]" ) {
+	REQUIRE( globMatch("*.csv", "report.csv") );
+	REQUIRE( !globMatch("*.csv", "2018/report.csv") );
+	REQUIRE( globMatch("**/*.csv", "report.csv") );
+	REQUIRE( globMatch("**/*.csv", "2018/05/report.csv") );
+	REQUIRE( !globMatch("**/*.csv", "2018/05/report.txt") );
+	REQUIRE( globMatch("*/report-??.csv", "2018/report-05.csv") );
+	REQUIRE( globMatch("report-[0-9][!a-z].csv", "report-05.csv") );
+	REQUIRE( !globMatch("report-[0-9][!a-z].csv", "report-0x.csv") );
+	REQUIRE( globMatch("logs/**", "logs/a/b/c") );
+
+	REQUIRE( splitGlob("/data/incoming/**/*.csv") == std::make_pair(std::string("/data/incoming"), 
+																	std::string("**/*.csv")) );
+	REQUIRE( splitGlob("*.csv") == std::make_pair(std::string("."), std::string("*.csv")) );
+	REQUIRE( !isGlob("/data/incoming/report.csv") );
+}
+
+TEST_CASE( "File watcher", "[Watch]" ) {
+	scheduling::EventLoop loop;
+	scheduling::TimerQueue timers;
+	FileWatcher watcher(loop, timers);
+	loop.start();
+
+	std::string directory = makeTempDirectory();
+	std::string file = directory + "/watched.txt";
+
+	SECTION( "creating and writing a file" ) {
+		EventLog log;
+		watcher.watch(file, log.callback());
+
+		std::ofstream(file) << "hello";
+		REQUIRE( log.waitFor(1) );
+
+		std::lock_guard<std::mutex> lock(log.mutex);
+		REQUIRE( log.events.front().path == file );
+		REQUIRE( log.events.front().type == CREATED );
+	}
+
+	SECTION( "other files in the directory are ignored" ) {
+		EventLog log;
+		watcher.watch(file, log.callback());
+
+		std::ofstream(directory + "/other.txt") << "hello";
+		REQUIRE( !log.waitFor(1, milliseconds(200)) );
+	}
+
+	SECTION( "renaming over a file" ) {
+		EventLog log;
+		watcher.watch(file, log.callback());
+
+		std::ofstream(directory + "/staged.txt") << "hello";
+		REQUIRE( rename((directory + "/staged.txt").c_str(), file.c_str()) == 0 );
+		REQUIRE( log.waitFor(1) );
+
+		std::lock_guard<std::mutex> lock(log.mutex);
+		REQUIRE( log.events.back().type == MOVED );
+	}
+
+	SECTION( "unwatched paths stay quiet" ) {
+		EventLog log;
+		WatchId id = watcher.watch(file, log.callback());
+		watcher.unwatch(id);
+
+		std::ofstream(file) << "hello";
+		REQUIRE( !log.waitFor(1, milliseconds(200)) );
+	}
+
+	SECTION( "spellings of the same path share one watch" ) {
+		EventLog first, second;
+		watcher.watch(file, first.callback());
+		WatchId id = watcher.watch(directory + "/./watched.txt", second.callback());
+		REQUIRE( watcher.size() == 1 );
+
+		// created, modified and closed after writing
+		std::ofstream(file) << "hello";
+		REQUIRE( first.waitFor(3) );
+		REQUIRE( second.waitFor(3) );
+
+		// the other subscriber keeps the shared watch alive
+		watcher.unwatch(id);
+		REQUIRE( watcher.size() == 1 );
+
+		std::ofstream(file, std::ios::app) << " again";
+		REQUIRE( first.waitFor(4) );
+	}
+
+	SECTION( "files matching a glob in new subdirectories" ) {
+		EventLog log;
+		watcher.watchTree(directory, "**/*.csv", log.callback());
+
+		REQUIRE( mkdir((directory + "/2018").c_str(), 0755) == 0 );
+		REQUIRE( mkdir((directory + "/2018/05").c_str(), 0755) == 0 );
+		std::ofstream(directory + "/2018/05/ignored.txt") << "hello";
+		std::ofstream(directory + "/2018/05/report.csv") << "hello";
+		REQUIRE( log.waitFor(1) );
+
+		std::lock_guard<std::mutex> lock(log.mutex);
+		for (const auto & event : log.events)
+			REQUIRE( event.path == directory + "/2018/05/report.csv" );
+	}
+
+	SECTION( "a glob only reaches as deep as its pattern" ) {
+		EventLog log;
+		watcher.watchTree(directory, "*/*.csv", log.callback());
+
+		REQUIRE( mkdir((directory + "/a").c_str(), 0755) == 0 );
+		REQUIRE( mkdir((directory + "/a/b").c_str(), 0755) == 0 );
+		std::ofstream(directory + "/a/b/deep.csv") << "hello";
+		std::ofstream(directory + "/a/shallow.csv") << "hello";
+		REQUIRE( log.waitFor(1) );
+
+		std::lock_guard<std::mutex> lock(log.mutex);
+		for (const auto & event : log.events)
+			REQUIRE( event.path == directory + "/a/shallow.csv" );
+	}
+
+	loop.stop();
+	std::system(("rm -rf " + directory).c_str());
+}
+
+TEST_CASE( "Watch triggers", "[Watch]" ) {
+	scheduling::TimerQueue timers;
+	timers.start();
+
+	std::vector<std::string> runs;
+	std::vector<std::function<void()>> unfinished;
+	std::mutex mutex;
+
+	auto recordRun = [&](const WatchEvent & event, std::function<void()> done) {
+		std::lock_guard<std::mutex> lock(mutex);
+		runs.push_back(event.path);
+		unfinished.push_back(done);
+	};
+
+	auto finishRun = [&]() {
+		std::function<void()> done;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			done = unfinished.front();
+			unfinished.erase(unfinished.begin());
+		}
+		done();
+	};
+
+	auto runCount = [&]() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return runs.size();
+	};
+
+	SECTION( "a burst of events makes one run" ) {
+		auto trigger = std::make_shared<WatchTrigger>(timers, milliseconds(50), milliseconds(0), recordRun);
+
+		for (int i = 0; i < 1000; i++)
+			trigger->notify(WatchEvent { "/data/report.csv", MODIFIED });
+
+		std::this_thread::sleep_for(milliseconds(200));
+		REQUIRE( runCount() == 1 );
+	}
+
+	SECTION( "max_delay cuts an endless burst short" ) {
+		auto trigger = std::make_shared<WatchTrigger>(timers, milliseconds(100), milliseconds(100), recordRun);
+
+		for (int i = 0; i < 30; i++) {
+			trigger->notify(WatchEvent { "/data/report.csv", MODIFIED });
+			std::this_thread::sleep_for(milliseconds(10));
+		}
+
+		REQUIRE( runCount() >= 1 );
+	}
+
+	SECTION( "only one run is in flight" ) {
+		auto trigger = std::make_shared<WatchTrigger>(timers, milliseconds(0), milliseconds(0), recordRun);
+
+		trigger->notify(WatchEvent { "/data/a.csv", MODIFIED });
+		trigger->notify(WatchEvent { "/data/a.csv", MODIFIED });
+		trigger->notify(WatchEvent { "/data/a.csv", MODIFIED });
+		trigger->notify(WatchEvent { "/data/b.csv", MODIFIED });
+		REQUIRE( runCount() == 1 );
+
+		// one more run for whatever came in meanwhile, with the latest event
+		finishRun();
+		REQUIRE( runCount() == 2 );
+		finishRun();
+		REQUIRE( runCount() == 2 );
+
+		REQUIRE( runs == std::vector<std::string>({ "/data/a.csv", "/data/b.csv" }) );
+	}
+
+	SECTION( "a tree changing during a run makes one more run" ) {
+		auto trigger = std::make_shared<WatchTrigger>(timers, milliseconds(0), milliseconds(0), recordRun);
+
+		trigger->notify(WatchEvent { "/data/0.csv", MODIFIED });
+		for (int i = 1; i <= 1000; i++)
+			trigger->notify(WatchEvent { "/data/" + std::to_string(i) + ".csv", MODIFIED });
+		REQUIRE( runCount() == 1 );
+
+		finishRun();
+		finishRun();
+		REQUIRE( runCount() == 2 );
+		REQUIRE( runs.back().compare("/data/1000.csv") == 0 );
+	}
+
+	timers.stop();
+}
@@ -0,0 +1,128 @@
+#include "timer-queue.h"
+
+using namespace scheduling;
+
+Clock::time_point
+Cadence::deadline() const
+{
+	return start + period * runs;
+}
+
+void
+Cadence::advance(Clock::time_point now, bool skipMissed)
+{
+	runs++;
+
+	if (!skipMissed || deadline() >= now)
+		return;
+
+	// the first deadline which isn't in the past
+	Clock::duration elapsed = now - start;
+	runs = elapsed / period + (elapsed % period != Clock::duration::zero() ? 1 : 0);
+}
+
+TimerQueue::TimerQueue(std::unique_ptr<TimerStore> store):
+	m_deadlines(std::move(store)), m_nextId(1), m_stopping(false) {}
+
+TimerQueue::~TimerQueue()
+{
+	stop();
+}
+
+TimerId
+TimerQueue::scheduleAt(Clock::time_point deadline, TimerCallback callback)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	TimerId id = m_nextId++;
+	m_callbacks[id] = std::move(callback);
+	m_deadlines->add(id, deadline);
+
+	// the new deadline might be earlier than the one being waited for
+	m_changed.notify_one();
+
+	return id;
+}
+
+TimerId
+TimerQueue::scheduleAfter(timeutil::DurationUnit delay, TimerCallback callback)
+{
+	return scheduleAt(Clock::now() + delay, std::move(callback));
+}
+
+bool
+TimerQueue::cancel(TimerId id)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	// the store keeps the deadline until it expires and finds no callback
+	return m_callbacks.erase(id) > 0;
+}
+
+size_t
+TimerQueue::size()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_callbacks.size();
+}
+
+void
+TimerQueue::start()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_dispatcher.joinable())
+		return;
+
+	m_stopping = false;
+	m_dispatcher = std::thread(&TimerQueue::dispatch, this);
+}
+
+void
+TimerQueue::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+		m_changed.notify_one();
+	}
+
+	if (m_dispatcher.joinable() && m_dispatcher.get_id() != std::this_thread::get_id())
+		m_dispatcher.join();
+}
+
+void
+TimerQueue::dispatch()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	std::vector<TimerId> expired;
+	std::vector<TimerCallback> callbacks;
+
+	while (!m_stopping) {
+		m_deadlines->expire(Clock::now(), expired);
+
+		for (TimerId id : expired) {
+			auto callbackIter = m_callbacks.find(id);
+			if (callbackIter == m_callbacks.end())
+				continue;
+
+			callbacks.push_back(std::move(callbackIter->second));
+			m_callbacks.erase(callbackIter);
+		}
+		expired.clear();
+
+		if (!callbacks.empty()) {
+			lock.unlock();
+			for (auto & callback : callbacks)
+				callback();
+			callbacks.clear();
+			lock.lock();
+			continue;
+		}
+
+		Clock::time_point next = m_deadlines->nextDeadline();
+		if (next == Clock::time_point::max())
+			m_changed.wait(lock);
+		else
+			m_changed.wait_until(lock, next);
+	}
+}
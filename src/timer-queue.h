@@ -0,0 +1,74 @@
+#ifndef TIMERQUEUE_H
+#define TIMERQUEUE_H
+
+#include <chrono>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#include "timeutil.h"
+#include "timer-store.h"
+#include "timing-wheel.h"
+
+namespace scheduling
+{
+	typedef std::function<void()> TimerCallback;
+
+	/*
+	 * Fixed-rate deadlines are start + k * period, computed from the
+	 * start rather than from the previous run so they never drift.
+	 */
+	struct Cadence
+	{
+		Clock::time_point start;
+		Clock::duration period;
+		unsigned long runs;
+
+		Clock::time_point deadline() const;
+
+		/*
+		 * Moves on to the run after the one that just finished; when 
+		 * skipping, deadlines which already passed by `now` are dropped.
+		 */
+		void advance(Clock::time_point now, bool skipMissed);
+	};
+
+	/*
+	 * A queue of deadlines served by a single dispatcher thread
+	 * which sleeps until the earliest one. Callbacks are invoked
+	 * on the dispatcher thread, so they should only hand work off
+	 * and return.
+	 */
+	class TimerQueue
+	{
+	public:
+		TimerQueue(std::unique_ptr<TimerStore> store = std::make_unique<TimingWheel>());
+		~TimerQueue();
+
+		TimerId scheduleAt(Clock::time_point deadline, TimerCallback callback);
+		TimerId scheduleAfter(timeutil::DurationUnit delay, TimerCallback callback);
+		bool cancel(TimerId id);
+		size_t size();
+
+		void start();
+		void stop();
+
+	private:
+		void dispatch();
+
+		std::unique_ptr<TimerStore> m_deadlines;
+		std::unordered_map<TimerId, TimerCallback> m_callbacks;
+		TimerId m_nextId;
+		bool m_stopping;
+
+		std::mutex m_mutex;
+		std::condition_variable m_changed;
+		std::thread m_dispatcher;
+	};
+}
+
+#endif
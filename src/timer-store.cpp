@@ -0,0 +1,33 @@
+#include "timer-store.h"
+
+using namespace scheduling;
+
+void
+TimerHeap::add(TimerId id, Clock::time_point deadline)
+{
+	m_deadlines.push(Entry { deadline, id });
+}
+
+void
+TimerHeap::expire(Clock::time_point now, std::vector<TimerId> & expired)
+{
+	while (!m_deadlines.empty() && m_deadlines.top().deadline <= now) {
+		expired.push_back(m_deadlines.top().id);
+		m_deadlines.pop();
+	}
+}
+
+Clock::time_point
+TimerHeap::nextDeadline() const
+{
+	if (m_deadlines.empty())
+		return Clock::time_point::max();
+
+	return m_deadlines.top().deadline;
+}
+
+size_t
+TimerHeap::size() const
+{
+	return m_deadlines.size();
+}
@@ -0,0 +1,59 @@
+#ifndef TIMERSTORE_H
+#define TIMERSTORE_H
+
+#include <chrono>
+#include <queue>
+#include <vector>
+#include <cstdint>
+
+namespace scheduling
+{
+	typedef std::chrono::steady_clock Clock;
+	typedef uint64_t TimerId;
+
+	/*
+	 * Keeps track of deadlines only; callbacks and cancellation are
+	 * left to the timer queue, so a cancelled timer may still come
+	 * out of expire() and has to be ignored by the caller.
+	 */
+	class TimerStore
+	{
+	public:
+		virtual ~TimerStore() {}
+
+		virtual void add(TimerId id, Clock::time_point deadline) = 0;
+		virtual void expire(Clock::time_point now, std::vector<TimerId> & expired) = 0;
+
+		/*
+		 * The earliest point at which expire() might have something to 
+		 * return, or time_point::max() if the store is empty.
+		 */
+		virtual Clock::time_point nextDeadline() const = 0;
+		virtual size_t size() const = 0;
+	};
+
+	/* A binary min-heap, O(log n) per insert and per expiry. */
+	class TimerHeap : public TimerStore
+	{
+	public:
+		void add(TimerId id, Clock::time_point deadline) override;
+		void expire(Clock::time_point now, std::vector<TimerId> & expired) override;
+		Clock::time_point nextDeadline() const override;
+		size_t size() const override;
+
+	private:
+		struct Entry
+		{
+			Clock::time_point deadline;
+			TimerId id;
+
+			bool operator>(const Entry & other) const {
+				return deadline > other.deadline;
+			}
+		};
+
+		std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> m_deadlines;
+	};
+}
+
+#endif
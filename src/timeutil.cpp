@@ -132,6 +132,35 @@ timeutil::parseDuration(unsigned long count, const std::string & unit)
 	return fail("Unrecognized unit " + unit);
 }
 
+ResultOrError<timeutil::DurationUnit> 
+timeutil::parseCompactDuration(const std::string & text)
+{
+	size_t unitStart = text.find_first_not_of("0123456789");
+	if (text.empty() || unitStart == 0)
+		return fail(text + " isn't a valid duration");
+
+	unsigned long count;
+	try {
+		count = std::stoul(text.substr(0, unitStart));
+	}
+	catch (const std::out_of_range &) {
+		return fail(text + " is beyond the limits");
+	}
+
+	std::string unit = unitStart != std::string::npos ? text.substr(unitStart) : "";
+
+	if (unit.compare("ms") == 0)
+		return parseDuration(count, "milliseconds");
+	else if (unit.compare("s") == 0)
+		return parseDuration(count, "seconds");
+	else if (unit.compare("m") == 0)
+		return parseDuration(count, "minutes");
+	else if (unit.compare("h") == 0)
+		return parseDuration(count, "hours");
+
+	return fail(text + " has no valid unit; only 'ms', 's', 'm' and 'h' are accepted");
+}
+
 ResultOrError<timeutil::DurationArgs> 
 timeutil::parseDurationArgs(const std::vector<std::string> & args)
 {
@@ -55,6 +55,9 @@ namespace timeutil
 	ResultOrError<DurationArgs> parseDurationArgs(const std::vector<std::string> & args);
 	ResultOrError<DurationUnit> parseDuration(const DurationArgs & args);
 	ResultOrError<DurationUnit> parseDuration(unsigned long count, const std::string & unit);
+
+	/* A duration written as one word, like 500ms, 30s, 5m or 2h */
+	ResultOrError<DurationUnit> parseCompactDuration(const std::string & text);
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,180 @@
+#include <algorithm>
+
+#include "timing-wheel.h"
+
+using namespace scheduling;
+using namespace std::chrono;
+
+#define SECOND_TICKS 1000
+#define MINUTE_TICKS SECOND_TICKS * 60
+#define HOUR_TICKS MINUTE_TICKS * 60
+#define DAY_TICKS HOUR_TICKS * 24
+
+uint64_t
+roundUpTo(uint64_t value, uint64_t multiple)
+{
+	return ((value + multiple - 1) / multiple) * multiple;
+}
+
+TimingWheel::TimingWheel(Clock::time_point origin):
+	m_origin(origin), m_current(0), m_size(0)
+{
+	m_levels[0] = Level { 1, std::vector<Slot>(1000), 0 };
+	m_levels[1] = Level { SECOND_TICKS, std::vector<Slot>(60), 0 };
+	m_levels[2] = Level { MINUTE_TICKS, std::vector<Slot>(60), 0 };
+	m_levels[3] = Level { HOUR_TICKS, std::vector<Slot>(24), 0 };
+}
+
+uint64_t
+TimingWheel::toTick(Clock::time_point time, bool roundUp) const
+{
+	if (time <= m_origin)
+		return 0;
+
+	Clock::duration elapsed = time - m_origin;
+	uint64_t ticks = duration_cast<milliseconds>(elapsed).count();
+
+	// a deadline shouldn't fire before its time, so partial ticks round up
+	if (roundUp && duration_cast<Clock::duration>(milliseconds(ticks)) < elapsed)
+		ticks++;
+
+	return ticks;
+}
+
+Clock::time_point
+TimingWheel::toTime(uint64_t tick) const
+{
+	return m_origin + milliseconds(tick);
+}
+
+void
+TimingWheel::add(TimerId id, Clock::time_point deadline)
+{
+	m_size++;
+	place(Entry { id, toTick(deadline, true) });
+}
+
+void
+TimingWheel::place(const Entry & entry)
+{
+	if (entry.tick <= m_current) {
+		m_due.push_back(entry);
+		return;
+	}
+
+	uint64_t delta = entry.tick - m_current;
+
+	/*
+	 * A level covers one full turn of the level below it, an entry 
+	 * goes to the first level whose range covers it and is hashed 
+	 * by its absolute tick so its slot comes around exactly when 
+	 * it's due to cascade.
+	 */
+	for (unsigned i = 0; i < LEVELS; i++) {
+		Level & level = m_levels[i];
+		if (delta < level.resolution * level.slots.size()) {
+			level.slots[(entry.tick / level.resolution) % level.slots.size()].push_back(entry);
+			level.count++;
+			return;
+		}
+	}
+
+	m_overflow.push_back(entry);
+}
+
+void
+TimingWheel::cascade(Slot & slot)
+{
+	Slot entries;
+	entries.swap(slot);
+
+	for (const Entry & entry : entries)
+		place(entry);
+}
+
+void
+TimingWheel::expire(Clock::time_point now, std::vector<TimerId> & expired)
+{
+	uint64_t target = toTick(now, false);
+
+	while (m_current < target) {
+		uint64_t next = nextInterestingTick();
+		if (next > target) {
+			m_current = target;
+			break;
+		}
+
+		m_current = next;
+
+		// higher levels go first so their entries can land in this very tick
+		if (m_current % (DAY_TICKS) == 0)
+			cascade(m_overflow);
+
+		for (unsigned i = LEVELS - 1; i > 0; i--) {
+			Level & level = m_levels[i];
+			if (m_current % level.resolution != 0)
+				continue;
+
+			Slot & slot = level.slots[(m_current / level.resolution) % level.slots.size()];
+			level.count -= slot.size();
+			cascade(slot);
+		}
+
+		Level & millis = m_levels[0];
+		Slot & slot = millis.slots[m_current % millis.slots.size()];
+		millis.count -= slot.size();
+		m_due.insert(m_due.end(), slot.begin(), slot.end());
+		slot.clear();
+	}
+
+	for (const Entry & entry : m_due)
+		expired.push_back(entry.id);
+
+	m_size -= m_due.size();
+	m_due.clear();
+}
+
+uint64_t
+TimingWheel::nextInterestingTick() const
+{
+	// nothing can happen before the next boundary of the lowest non-empty level
+	if (m_levels[0].count > 0)
+		return m_current + 1;
+
+	for (unsigned i = 1; i < LEVELS; i++) {
+		if (m_levels[i].count > 0)
+			return roundUpTo(m_current + 1, m_levels[i - 1].resolution * m_levels[i - 1].slots.size());
+	}
+
+	if (!m_overflow.empty())
+		return roundUpTo(m_current + 1, DAY_TICKS);
+
+	return UINT64_MAX;
+}
+
+Clock::time_point
+TimingWheel::nextDeadline() const
+{
+	if (!m_due.empty())
+		return toTime(m_current);
+
+	const Level & millis = m_levels[0];
+	if (millis.count > 0) {
+		for (uint64_t tick = m_current + 1; tick <= m_current + millis.slots.size(); tick++) {
+			if (!millis.slots[tick % millis.slots.size()].empty())
+				return toTime(tick);
+		}
+	}
+
+	uint64_t next = nextInterestingTick();
+	if (next == UINT64_MAX)
+		return Clock::time_point::max();
+
+	return toTime(next);
+}
+
+size_t
+TimingWheel::size() const
+{
+	return m_size;
+}
@@ -0,0 +1,64 @@
+#ifndef TIMINGWHEEL_H
+#define TIMINGWHEEL_H
+
+#include <array>
+#include <vector>
+
+#include "timer-store.h"
+
+namespace scheduling
+{
+	/*
+	 * A hashed hierarchical timing wheel with millisecond, second, 
+	 * minute and hour levels. Inserting is O(1) and every timer 
+	 * cascades down at most four times before it expires, so the 
+	 * per-timer cost doesn't grow with the number of timers. 
+	 * Deadlines more than a day away wait in an overflow list 
+	 * which is only looked at once a day.
+	 */
+	class TimingWheel : public TimerStore
+	{
+	public:
+		TimingWheel(Clock::time_point origin = Clock::now());
+
+		void add(TimerId id, Clock::time_point deadline) override;
+		void expire(Clock::time_point now, std::vector<TimerId> & expired) override;
+		Clock::time_point nextDeadline() const override;
+		size_t size() const override;
+
+	private:
+		static const unsigned LEVELS = 4;
+
+		struct Entry
+		{
+			TimerId id;
+			uint64_t tick;
+		};
+
+		typedef std::vector<Entry> Slot;
+
+		struct Level
+		{
+			uint64_t resolution;
+			std::vector<Slot> slots;
+			size_t count;
+		};
+
+		uint64_t toTick(Clock::time_point time, bool roundUp) const;
+		Clock::time_point toTime(uint64_t tick) const;
+
+		void place(const Entry & entry);
+		void cascade(Slot & slot);
+		uint64_t nextInterestingTick() const;
+
+		Clock::time_point m_origin;
+		uint64_t m_current;
+
+		std::array<Level, LEVELS> m_levels;
+		Slot m_overflow;
+		Slot m_due;
+		size_t m_size;
+	};
+}
+
+#endif
@@ -0,0 +1,109 @@
+#include "watch-trigger.h"
+
+using namespace watchers;
+
+WatchTrigger::WatchTrigger(scheduling::TimerQueue & timers, timeutil::DurationUnit debounce, 
+						   timeutil::DurationUnit maxDelay, RunCallback run):
+	m_timers(timers), m_debounce(debounce), m_maxDelay(maxDelay), m_run(run), 
+	m_generation(0), m_running(false), m_rerun(false) {}
+
+void
+WatchTrigger::notify(const WatchEvent & event)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	if (m_debounce == timeutil::DurationUnit::zero()) {
+		bool admitted = admit(event);
+		lock.unlock();
+
+		if (admitted)
+			start(event);
+		return;
+	}
+
+	scheduling::Clock::time_point now = scheduling::Clock::now();
+
+	// the first event of a burst is the one reported, later ones only push the run back
+	auto windowIter = m_windows.find(event.path);
+	if (windowIter == m_windows.end())
+		windowIter = m_windows.insert({ event.path, Window { event, now, 0, 0 } }).first;
+
+	Window & window = windowIter->second;
+	window.generation = ++m_generation;
+
+	if (window.timer != 0)
+		m_timers.cancel(window.timer);
+
+	scheduling::Clock::time_point deadline = now + m_debounce;
+	if (m_maxDelay > timeutil::DurationUnit::zero())
+		deadline = std::min(deadline, window.opened + m_maxDelay);
+
+	// a timer which went off just as it was cancelled finds a newer generation
+	std::shared_ptr<WatchTrigger> self = shared_from_this();
+	std::string path = event.path;
+	uint64_t generation = window.generation;
+
+	window.timer = m_timers.scheduleAt(deadline, [self, path, generation]() {
+		self->settle(path, generation);
+	});
+}
+
+void
+WatchTrigger::settle(const std::string & path, uint64_t generation)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	auto windowIter = m_windows.find(path);
+	if (windowIter == m_windows.end() || windowIter->second.generation != generation)
+		return;
+
+	WatchEvent event = windowIter->second.event;
+	m_windows.erase(windowIter);
+
+	bool admitted = admit(event);
+	lock.unlock();
+
+	if (admitted)
+		start(event);
+}
+
+/* Called with the lock held; returns whether the event should run right away */
+bool
+WatchTrigger::admit(const WatchEvent & event)
+{
+	if (!m_running) {
+		m_running = true;
+		return true;
+	}
+
+	m_rerun = true;
+	m_rerunEvent = event;
+
+	return false;
+}
+
+void
+WatchTrigger::start(const WatchEvent & event)
+{
+	std::shared_ptr<WatchTrigger> self = shared_from_this();
+	m_run(event, [self]() {
+		self->finished();
+	});
+}
+
+void
+WatchTrigger::finished()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	if (!m_rerun) {
+		m_running = false;
+		return;
+	}
+
+	m_rerun = false;
+	WatchEvent event = m_rerunEvent;
+	lock.unlock();
+
+	start(event);
+}
@@ -0,0 +1,63 @@
+#ifndef WATCHTRIGGER_H
+#define WATCHTRIGGER_H
+
+#include <string>
+#include <functional>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+
+#include "timeutil.h"
+#include "timer-queue.h"
+#include "file-watch.h"
+
+namespace watchers
+{
+	/*
+	 * Turns the events of one watch job into runs. Events on a path 
+	 * are held until it has been quiet for the debounce period (or 
+	 * until max_delay since the first of them), then make one run.
+	 * Only one run is in flight at a time; however many paths settle
+	 * during it, one more run follows it, for the latest of them.
+	 */
+	class WatchTrigger : public std::enable_shared_from_this<WatchTrigger>
+	{
+	public:
+		/* Has to call done once the run is over */
+		typedef std::function<void(const WatchEvent &, std::function<void()> done)> RunCallback;
+
+		WatchTrigger(scheduling::TimerQueue & timers, timeutil::DurationUnit debounce, 
+					 timeutil::DurationUnit maxDelay, RunCallback run);
+
+		void notify(const WatchEvent & event);
+
+	private:
+		struct Window
+		{
+			WatchEvent event;
+			scheduling::Clock::time_point opened;
+			uint64_t generation;
+			scheduling::TimerId timer;
+		};
+
+		void settle(const std::string & path, uint64_t generation);
+		bool admit(const WatchEvent & event);
+		void start(const WatchEvent & event);
+		void finished();
+
+		scheduling::TimerQueue & m_timers;
+		const timeutil::DurationUnit m_debounce;
+		const timeutil::DurationUnit m_maxDelay;
+		const RunCallback m_run;
+
+		std::unordered_map<std::string, Window> m_windows;
+		uint64_t m_generation;
+
+		bool m_running;
+		bool m_rerun;
+		WatchEvent m_rerunEvent;
+		std::mutex m_mutex;
+	};
+}
+
+#endif
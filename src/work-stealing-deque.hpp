@@ -0,0 +1,130 @@
+#ifndef WORKSTEALINGDEQUE_HPP
+#define WORKSTEALINGDEQUE_HPP
+
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+/*
+ * A Chase-Lev work-stealing deque (following Le et al., "Correct and
+ * Efficient Work-Stealing for Weak Memory Models"). Only the owning
+ * thread may push() and take() at the bottom, any thread may steal()
+ * from the top. T has to be a pointer, empty slots are nullptr.
+ */
+template <typename T>
+class WorkStealingDeque
+{
+private:
+	struct Buffer
+	{
+		const int64_t capacity;
+		std::unique_ptr<std::atomic<T>[]> slots;
+
+		Buffer(int64_t _capacity):
+			capacity(_capacity), slots(new std::atomic<T>[_capacity]) {}
+
+		T get(int64_t index) {
+			return slots[index & (capacity - 1)].load(std::memory_order_relaxed);
+		}
+
+		void put(int64_t index, T value) {
+			slots[index & (capacity - 1)].store(value, std::memory_order_relaxed);
+		}
+	};
+
+	std::atomic<int64_t> m_top;
+	std::atomic<int64_t> m_bottom;
+	std::atomic<Buffer *> m_buffer;
+
+	// thieves might still be reading from an old buffer, so they are kept until the end
+	std::vector<std::unique_ptr<Buffer>> m_buffers;
+
+	Buffer * grow(Buffer * buffer, int64_t bottom, int64_t top) {
+		Buffer * bigger = new Buffer(buffer->capacity * 2);
+		for (int64_t i = top; i < bottom; i++)
+			bigger->put(i, buffer->get(i));
+
+		m_buffers.emplace_back(bigger);
+		m_buffer.store(bigger, std::memory_order_release);
+		return bigger;
+	}
+
+public:
+	WorkStealingDeque(int64_t capacity = 1024):
+		m_top(0), m_bottom(0)
+	{
+		// capacity has to be a power of two for the index masking
+		int64_t rounded = 1;
+		while (rounded < capacity)
+			rounded *= 2;
+
+		m_buffers.emplace_back(new Buffer(rounded));
+		m_buffer.store(m_buffers.back().get(), std::memory_order_relaxed);
+	}
+
+	void push(T value) {
+		int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+		int64_t top = m_top.load(std::memory_order_acquire);
+		Buffer * buffer = m_buffer.load(std::memory_order_relaxed);
+
+		if (bottom - top > buffer->capacity - 1)
+			buffer = grow(buffer, bottom, top);
+
+		buffer->put(bottom, value);
+		std::atomic_thread_fence(std::memory_order_release);
+		m_bottom.store(bottom + 1, std::memory_order_relaxed);
+	}
+
+	T take() {
+		int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+		Buffer * buffer = m_buffer.load(std::memory_order_relaxed);
+		m_bottom.store(bottom, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t top = m_top.load(std::memory_order_relaxed);
+
+		if (top > bottom) {
+			m_bottom.store(bottom + 1, std::memory_order_relaxed);
+			return nullptr;
+		}
+
+		T value = buffer->get(bottom);
+		if (top == bottom) {
+			// the last item, a thief might be racing for it
+			if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+											   std::memory_order_relaxed))
+				value = nullptr;
+
+			m_bottom.store(bottom + 1, std::memory_order_relaxed);
+		}
+
+		return value;
+	}
+
+	T steal() {
+		int64_t top = m_top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t bottom = m_bottom.load(std::memory_order_acquire);
+
+		if (top >= bottom)
+			return nullptr;
+
+		Buffer * buffer = m_buffer.load(std::memory_order_acquire);
+		T value = buffer->get(top);
+
+		// lost the race to the owner or to another thief
+		if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+										   std::memory_order_relaxed))
+			return nullptr;
+
+		return value;
+	}
+
+	bool empty() const {
+		int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+		int64_t top = m_top.load(std::memory_order_relaxed);
+		return bottom <= top;
+	}
+};
+
+#endif
@@ -0,0 +1,567 @@
+#include <sys/socket.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+
+#include "zygote.h"
+
+using namespace processes;
+
+/* Any reasonable statement fits, bigger ones are started directly */
+const size_t MAX_REQUEST = 64 * 1024;
+
+enum ReplyKind
+{
+	STARTED, // the answer to a request, with either a pid or an error
+	EXITED   // a process started earlier was reaped
+};
+
+/* Followed by the path, the arguments and the variable names and values, each ending with a '\0' */
+struct RequestHeader
+{
+	uint64_t id;
+	uint32_t argumentCount;
+	uint32_t variableCount;
+	uint32_t ownGroup;
+	uint32_t inGroup; // the last descriptor passed along is a cgroup to start in
+};
+
+struct Reply
+{
+	uint32_t kind;
+	int32_t error;
+	uint64_t id;
+	int32_t pid;
+	int32_t placed;
+	int32_t code;
+	rusage usage;
+};
+
+std::string
+encodeRequest(uint64_t id, const std::string & path, const std::vector<std::string> & arguments,
+			  const Environment & environment, bool ownGroup, bool inGroup)
+{
+	RequestHeader header { id, (uint32_t) arguments.size(), (uint32_t) environment.size(), ownGroup, inGroup };
+	std::string request(reinterpret_cast<const char *>(&header), sizeof(header));
+
+	auto add = [&request](const std::string & string) {
+		request.append(string);
+		request.push_back('\0');
+	};
+
+	add(path);
+	for (const auto & argument : arguments)
+		add(argument);
+	for (const auto & variable : environment) {
+		add(variable.first);
+		add(variable.second);
+	}
+
+	return request;
+}
+
+bool
+decodeRequest(const char * data, size_t size, std::string & path, std::vector<std::string> & arguments,
+			  Environment & environment)
+{
+	RequestHeader header;
+	std::memcpy(&header, data, sizeof(header));
+	size_t offset = sizeof(header);
+
+	auto next = [&](std::string & string) {
+		const char * end = static_cast<const char *>(std::memchr(data + offset, '\0', size - offset));
+		if (end == nullptr)
+			return false;
+
+		string.assign(data + offset, end);
+		offset = end - data + 1;
+		return true;
+	};
+
+	if (!next(path))
+		return false;
+
+	arguments.resize(header.argumentCount);
+	for (auto & argument : arguments) {
+		if (!next(argument))
+			return false;
+	}
+
+	for (uint32_t i = 0; i < header.variableCount; i++) {
+		std::string name, value;
+		if (!next(name) || !next(value))
+			return false;
+
+		environment[name] = value;
+	}
+
+	return true;
+}
+
+/* Sends one request, passing output and cgroup along with it, those which there are */
+bool
+sendRequest(int socket, const std::string & request, int output, int cgroup)
+{
+	iovec data { const_cast<char *>(request.data()), request.size() };
+
+	msghdr message;
+	std::memset(&message, 0, sizeof(message));
+	message.msg_iov = &data;
+	message.msg_iovlen = 1;
+
+	int fds[2];
+	size_t count = 0;
+	if (output >= 0)
+		fds[count++] = output;
+	if (cgroup >= 0)
+		fds[count++] = cgroup;
+
+	char control[CMSG_SPACE(sizeof(fds))];
+	if (count > 0) {
+		std::memset(control, 0, sizeof(control));
+		message.msg_control = control;
+		message.msg_controllen = CMSG_SPACE(count * sizeof(int));
+
+		cmsghdr * header = CMSG_FIRSTHDR(&message);
+		header->cmsg_level = SOL_SOCKET;
+		header->cmsg_type = SCM_RIGHTS;
+		header->cmsg_len = CMSG_LEN(count * sizeof(int));
+		std::memcpy(CMSG_DATA(header), fds, count * sizeof(int));
+	}
+
+	ssize_t sent;
+	while ((sent = sendmsg(socket, &message, MSG_NOSIGNAL)) < 0 && errno == EINTR) {}
+
+	return sent == (ssize_t) request.size();
+}
+
+/* Receives one request and the descriptors which came with it, -1 for those which didn't */
+ssize_t
+receiveRequest(int socket, char * buffer, size_t size, int & output, int & cgroup, bool & truncated)
+{
+	iovec data { buffer, size };
+
+	msghdr message;
+	std::memset(&message, 0, sizeof(message));
+	message.msg_iov = &data;
+	message.msg_iovlen = 1;
+
+	char control[CMSG_SPACE(2 * sizeof(int))];
+	message.msg_control = control;
+	message.msg_controllen = sizeof(control);
+
+	output = -1;
+	cgroup = -1;
+	ssize_t received = recvmsg(socket, &message, MSG_CMSG_CLOEXEC);
+	if (received <= 0)
+		return received;
+
+	int fds[2];
+	size_t count = 0;
+	for (cmsghdr * header = CMSG_FIRSTHDR(&message); header != nullptr; header = CMSG_NXTHDR(&message, header)) {
+		if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS) {
+			count = std::min<size_t>((header->cmsg_len - CMSG_LEN(0)) / sizeof(int), 2);
+			std::memcpy(fds, CMSG_DATA(header), count * sizeof(int));
+		}
+	}
+
+	RequestHeader header;
+	bool inGroup = false;
+	if ((size_t) received >= sizeof(header)) {
+		std::memcpy(&header, buffer, sizeof(header));
+		inGroup = header.inGroup != 0;
+	}
+
+	if (inGroup && count > 0)
+		cgroup = fds[--count];
+	if (count > 0)
+		output = fds[0];
+
+	truncated = (message.msg_flags & MSG_TRUNC) != 0;
+	return received;
+}
+
+void
+sendReply(int socket, const Reply & reply)
+{
+	while (send(socket, &reply, sizeof(reply), MSG_NOSIGNAL) < 0 && errno == EINTR) {}
+}
+
+Reply
+startRequested(const char * request, size_t size, int output, int cgroup, bool truncated)
+{
+	Reply reply;
+	std::memset(&reply, 0, sizeof(reply));
+	reply.kind = STARTED;
+	reply.pid = -1;
+
+	if (size < sizeof(RequestHeader)) {
+		reply.error = EINVAL;
+		return reply;
+	}
+
+	RequestHeader header;
+	std::memcpy(&header, request, sizeof(header));
+	reply.id = header.id;
+
+	std::string path;
+	std::vector<std::string> arguments;
+	Environment environment;
+
+	if (truncated)
+		reply.error = EMSGSIZE;
+	else if (!decodeRequest(request, size, path, arguments, environment))
+		reply.error = EINVAL;
+	else {
+		bool placed = false;
+		startDirectly(path, arguments, environment, output, header.ownGroup != 0, cgroup, &placed)
+			.onSuccess([&reply, &placed](const pid_t & pid) {
+				reply.pid = pid;
+				reply.placed = placed;
+			})
+			.onFailure([&reply](const Error & error) {
+				reply.error = error.code > 0 ? error.code : EINVAL;
+			});
+	}
+
+	return reply;
+}
+
+void
+reapChildren(int socket)
+{
+	int status;
+	pid_t pid;
+	Reply reply;
+	std::memset(&reply, 0, sizeof(reply));
+	reply.kind = EXITED;
+
+	while ((pid = wait4(-1, &status, WNOHANG, &reply.usage)) > 0) {
+		reply.pid = pid;
+		reply.code = exitCode(status);
+		sendReply(socket, reply);
+	}
+}
+
+/*
+ * The zygote's side, which never returns: starts whatever comes in
+ * over the socket and reaps whatever exits, until the scheduler
+ * closes its end.
+ */
+void
+serve(int socket)
+{
+	sigset_t childSignals;
+	sigemptyset(&childSignals);
+	sigaddset(&childSignals, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &childSignals, nullptr);
+
+	int signals = signalfd(-1, &childSignals, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (signals < 0)
+		_exit(1);
+
+	forkStarts();
+
+	std::vector<char> buffer(MAX_REQUEST);
+	pollfd descriptors[2] = { { socket, POLLIN, 0 }, { signals, POLLIN, 0 } };
+
+	while (1) {
+		if (poll(descriptors, 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		if (descriptors[1].revents & POLLIN) {
+			signalfd_siginfo info;
+			while (read(signals, &info, sizeof(info)) > 0) {}
+
+			reapChildren(socket);
+		}
+
+		if (descriptors[0].revents != 0) {
+			int output, cgroup;
+			bool truncated = false;
+
+			ssize_t size = receiveRequest(socket, buffer.data(), buffer.size(), output, cgroup, truncated);
+			if (size < 0 && errno == EINTR)
+				continue;
+			if (size <= 0)
+				break;
+
+			Reply reply = startRequested(buffer.data(), size, output, cgroup, truncated);
+			if (output >= 0)
+				close(output);
+			if (cgroup >= 0)
+				close(cgroup);
+
+			sendReply(socket, reply);
+		}
+	}
+
+	_exit(0);
+}
+
+/* ---------- */
+
+Zygote::Zygote():
+	m_socket(-1), m_pid(-1), m_connected(false), m_nextId(1) {}
+
+Zygote::~Zygote()
+{
+	stop();
+}
+
+ResultOrError<pid_t>
+Zygote::launch()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_socket >= 0)
+		return succeed(m_pid);
+
+	int sockets[2];
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sockets) < 0) {
+		std::string message = std::string("Couldn't create a socket for the zygote: ") + std::strerror(errno);
+		return fail(Error(errno, message));
+	}
+
+	pid_t pid = fork();
+	if (pid < 0) {
+		int error = errno;
+		std::string message = std::string("Couldn't start the zygote: ") + std::strerror(error);
+		close(sockets[0]);
+		close(sockets[1]);
+		return fail(Error(error, message));
+	}
+
+	if (pid == 0) {
+		close(sockets[0]);
+		serve(sockets[1]);
+	}
+
+	close(sockets[1]);
+	m_socket = sockets[0];
+	m_pid = pid;
+	m_connected = true;
+	m_receiver = std::thread(&Zygote::receive, this);
+
+	return succeed(pid);
+}
+
+void
+Zygote::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_socket < 0)
+			return;
+	}
+
+	// the zygote exits once it sees its end closed, whatever it started keeps running
+	shutdown(m_socket, SHUT_RDWR);
+	if (m_receiver.joinable())
+		m_receiver.join();
+
+	close(m_socket);
+	m_socket = -1;
+
+	while (waitpid(m_pid, nullptr, 0) < 0 && errno == EINTR) {}
+}
+
+bool
+Zygote::running()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_connected;
+}
+
+pid_t
+Zygote::pid()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_socket >= 0 ? m_pid : -1;
+}
+
+ResultOrError<pid_t>
+Zygote::start(const std::string & path, const std::vector<std::string> & arguments,
+			  const Environment & environment, int output, bool ownGroup, int cgroup, bool * placed)
+{
+	if (placed != nullptr)
+		*placed = false;
+
+	if (arguments.empty())
+		return fail("Needs at least one argument");
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	if (!m_connected)
+		return fail(Error(ENOTCONN, "The zygote isn't running"));
+
+	uint64_t id = m_nextId++;
+	m_starting[id] = Starting { false, -1, 0, false };
+	lock.unlock();
+
+	// a datagram is sent whole or not at all, so requests from different threads never mix
+	std::string request = encodeRequest(id, path, arguments, environment, ownGroup, cgroup >= 0);
+	bool sent = request.size() <= MAX_REQUEST && sendRequest(m_socket, request, output, cgroup);
+
+	lock.lock();
+	if (!sent) {
+		m_starting.erase(id);
+		int error = request.size() > MAX_REQUEST ? EMSGSIZE : ENOTCONN;
+		return fail(Error(error, "Couldn't hand the statement over to the zygote"));
+	}
+
+	m_changed.wait(lock, [this, id]() { return m_starting.at(id).done || !m_connected; });
+
+	Starting starting = m_starting.at(id);
+	m_starting.erase(id);
+
+	if (!starting.done)
+		return fail(Error(ENOTCONN, "The zygote went away"));
+
+	if (starting.error != 0) {
+		std::string message = "Couldn't start '" + path + "': " + std::strerror(starting.error);
+		return fail(Error(starting.error, message));
+	}
+
+	if (placed != nullptr)
+		*placed = starting.placed;
+
+	return succeed(starting.pid);
+}
+
+bool
+Zygote::owns(pid_t pid)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_children.count(pid) > 0;
+}
+
+ResultOrError<int>
+Zygote::wait(pid_t pid)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	if (m_children.count(pid) == 0)
+		return fail("The process wasn't started by the zygote");
+
+	m_changed.wait(lock, [this, pid]() { return m_children.at(pid).exited || !m_connected; });
+
+	Child child = m_children.at(pid);
+	m_children.erase(pid);
+
+	if (!child.exited)
+		return fail("Lost track of the process when the zygote went away");
+
+	return succeed(child.exit.code);
+}
+
+bool
+Zygote::onExit(pid_t pid, ExitCallback callback)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	auto childIter = m_children.find(pid);
+	if (childIter == m_children.end())
+		return false;
+
+	if (!childIter->second.exited && m_connected) {
+		childIter->second.callback = std::move(callback);
+		return true;
+	}
+
+	Child child = childIter->second;
+	m_children.erase(childIter);
+	lock.unlock();
+
+	callback(child.exit);
+	return true;
+}
+
+void
+Zygote::receive()
+{
+	Reply reply;
+
+	while (1) {
+		ssize_t size = recv(m_socket, &reply, sizeof(reply), 0);
+		if (size < 0 && errno == EINTR)
+			continue;
+		if (size != sizeof(reply))
+			break;
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+
+		if (reply.kind == STARTED) {
+			auto startingIter = m_starting.find(reply.id);
+			if (startingIter != m_starting.end())
+				startingIter->second = Starting { true, reply.pid, reply.error, reply.placed != 0 };
+
+			// always comes before the process can be reaped
+			if (reply.error == 0)
+				m_children[reply.pid] = Child { false, ProcessExit { reply.pid, -1, rusage() }, nullptr };
+		}
+		else {
+			auto childIter = m_children.find(reply.pid);
+			if (childIter == m_children.end())
+				continue;
+
+			childIter->second.exited = true;
+			childIter->second.exit = ProcessExit { reply.pid, reply.code, reply.usage };
+
+			// nobody is going to wait() for one somebody is called back for
+			if (childIter->second.callback) {
+				ExitCallback callback = std::move(childIter->second.callback);
+				ProcessExit exit = childIter->second.exit;
+				m_children.erase(childIter);
+
+				lock.unlock();
+				callback(exit);
+				continue;
+			}
+		}
+
+		m_changed.notify_all();
+	}
+
+	disconnected();
+}
+
+void
+Zygote::disconnected()
+{
+	std::vector<std::pair<ExitCallback, ProcessExit>> lost;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_connected = false;
+
+		for (auto childIter = m_children.begin(); childIter != m_children.end();) {
+			if (!childIter->second.callback) {
+				childIter++;
+				continue;
+			}
+
+			lost.emplace_back(std::move(childIter->second.callback), childIter->second.exit);
+			childIter = m_children.erase(childIter);
+		}
+
+		m_changed.notify_all();
+	}
+
+	for (auto & callback : lost)
+		callback.first(callback.second);
+}
+
+Zygote &
+processes::zygote()
+{
+	// never destroyed, detached threads might still be waiting on it at exit
+	static Zygote * instance = new Zygote();
+	return *instance;
+}
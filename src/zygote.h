@@ -0,0 +1,99 @@
+#ifndef ZYGOTE_H
+#define ZYGOTE_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <cstdint>
+
+#include <sys/types.h>
+
+#include "failure.hpp"
+#include "process.h"
+
+namespace processes
+{
+	/*
+	 * A small helper process forked at launch, while the scheduler is
+	 * still single-threaded and small, which does all the spawning
+	 * afterwards; the scheduler's threads and memory never go through
+	 * a fork. Requests go over a Unix socket, along with the output
+	 * and cgroup descriptors if there are any, and the helper
+	 * reports back the pid of each process it started and, once
+	 * reaped, its exit code.
+	 *
+	 * The processes are the helper's children rather than the
+	 * scheduler's, so they are waited for through wait() or onExit()
+	 * here; the helper reaps them with wait4() and passes their
+	 * resource usage along.
+	 */
+	class Zygote
+	{
+	public:
+		Zygote();
+		~Zygote();
+
+		/* Has to be called before any other thread is started */
+		ResultOrError<pid_t> launch();
+		void stop();
+
+		bool running();
+
+		/* The zygote's own pid, -1 before it's launched */
+		pid_t pid();
+
+		ResultOrError<pid_t> start(const std::string & path, const std::vector<std::string> & arguments,
+								   const Environment & environment = Environment(), int output = -1,
+								   bool ownGroup = false, int cgroup = -1, bool * placed = nullptr);
+
+		/* Whether pid was started here and hasn't been waited for yet */
+		bool owns(pid_t pid);
+		ResultOrError<int> wait(pid_t pid);
+
+		/*
+		 * Instead of waiting: callback gets the exit, from the thread
+		 * reading the zygote's replies, or right away if the process is
+		 * already gone. Returns false if pid wasn't started here.
+		 */
+		bool onExit(pid_t pid, ExitCallback callback);
+
+	private:
+		struct Starting
+		{
+			bool done;
+			pid_t pid;
+			int error;
+			bool placed;
+		};
+
+		struct Child
+		{
+			bool exited;
+			ProcessExit exit;
+			ExitCallback callback;
+		};
+
+		void receive();
+		void disconnected();
+
+		int m_socket;
+		pid_t m_pid;
+		bool m_connected;
+		uint64_t m_nextId;
+
+		std::unordered_map<uint64_t, Starting> m_starting;
+		std::unordered_map<pid_t, Child> m_children;
+
+		std::mutex m_mutex;
+		std::condition_variable m_changed;
+		std::thread m_receiver;
+	};
+
+	/* The one all statements go through, once it's launched */
+	Zygote & zygote();
+}
+
+#endif